@@ -1,98 +1,475 @@
 /**
  * show_file.c
  *
- * Lee el contenido de un fichero y lo vuelca por pantalla usando fread()/fwrite().
- * Versión optimizada respecto al bucle byte a byte (getc/putc).
+ * Vuelca por pantalla el contenido de uno o varios ficheros, al estilo de cat.
+ * No usa stdio para los datos: cada fichero se copia al descriptor de salida
+ * con el mecanismo más barato que admita el tipo de stdout:
+ *   - stdout es una tubería  -> splice() (el kernel mueve páginas sin copiarlas)
+ *   - stdout es fichero/socket -> sendfile()
+ *   - cualquier otro caso (terminal...) o si lo anterior no está soportado
+ *     -> read()/write() con un buffer grande y alineado a página.
+ *
+ * Con muchos ficheros pequeños lo que domina es la latencia de open() y de
+ * la primera lectura, así que un pool de hilos lectores se adelanta al hilo
+ * principal: abre los siguientes ficheros de la lista, pide al kernel que los
+ * traiga a memoria (posix_fadvise WILLNEED) y, si son pequeños, los lee
+ * enteros. El hilo principal escribe siempre en el orden de los argumentos.
  *
  * Uso:
- *   ./show_file <ruta_del_fichero>
+ *   ./show_file [-v] [-j N] <fichero> [<fichero> ...]
+ *
+ *   -v   Al terminar, muestra por stderr los bytes copiados, el tiempo y la
+ *        velocidad (bytes/s), junto con el método usado para cada fichero.
+ *   -j N Número de hilos lectores que se adelantan (por defecto 4).
+ *
+ * Códigos de salida:
+ *   1 uso incorrecto, 2 no se pudo abrir algún fichero, 3 error de escritura,
+ *   4 error de lectura, 5 error al cerrar.
  *
  * Manuales consultados:
- *   man 3 fopen
- *   man 3 fread
- *   man 3 fwrite
- *   man 3 ferror
+ *   man 2 open, man 2 read, man 2 write
+ *   man 2 splice, man 2 sendfile
+ *   man 2 posix_fadvise
+ *   man 3 posix_memalign
+ *   man 3 pthread_create, man 3 pthread_cond_wait
  *   man 3 err
  */
 
-#include <stdio.h>    // Declaraciones de FILE, fopen, fread, fwrite, fclose, stderr, stdout
-#include <stdlib.h>   // Declaraciones de exit(), EXIT_FAILURE, EXIT_SUCCESS
-#include <err.h>      // err(), errx() (extensión GNU para manejar errores con mensaje)
+#define _GNU_SOURCE
+
+#include <stdio.h>      // fprintf, stderr
+#include <stdlib.h>     // exit(), EXIT_FAILURE, EXIT_SUCCESS, posix_memalign, strtol
+#include <err.h>        // err(), warn() (extensión GNU para manejar errores con mensaje)
+#include <errno.h>      // errno, EINVAL, ENOSYS
+#include <fcntl.h>      // open, O_RDONLY, splice, SPLICE_F_*
+#include <unistd.h>     // read, write, close, getopt
+#include <pthread.h>    // pthread_create, mutex, cond
+#include <time.h>       // clock_gettime
+#include <sys/stat.h>   // fstat, S_ISFIFO, S_ISREG, S_ISSOCK
+#include <sys/sendfile.h>
+
+// Tamaño del buffer del camino read()/write(): 1 MiB reduce las llamadas al
+// sistema a una por MiB y se alinea a página para que el kernel pueda copiar
+// páginas completas.
+#define BUFFER_SIZE (1024 * 1024)
+#define BUFFER_ALIGN 4096
+
+// Máximo que pedimos en cada splice()/sendfile(). El kernel puede devolver
+// menos; simplemente repetimos.
+#define CHUNK_SIZE (16 * 1024 * 1024)
+
+// Métodos de copia, en orden de preferencia.
+typedef enum {
+    COPY_SPLICE,
+    COPY_SENDFILE,
+    COPY_READWRITE
+} copy_method_t;
+
+static const char *method_name[] = { "splice", "sendfile", "read/write" };
+
+// Ficheros de hasta SMALL_FILE bytes los lee entero el hilo lector, de modo
+// que el hilo principal solo hace un write(). Los mayores se dejan abiertos y
+// con la lectura anticipada pedida al kernel.
+#define SMALL_FILE (64 * 1024)
+
+// Número de ficheros que los lectores pueden ir por delante del escritor, por
+// cada hilo lector. Acota los descriptores abiertos y la memoria usada.
+#define SLOTS_PER_READER 8
+
+#define DEFAULT_READERS 4
+
+// Estado de un fichero preparado por un hilo lector.
+//   file: índice del fichero (en la lista de ficheros) que ocupa el hueco
+//   ready: el lector ha terminado con él y el escritor puede usarlo
+//   fd: descriptor abierto posicionado tras 'data', o -1 si ya se leyó entero
+//   data/len: contenido ya leído (hasta SMALL_FILE bytes)
+//   error/err_open: errno del fallo, y si fue al abrir o al leer
+typedef struct {
+    long file;
+    int  ready;
+    int  fd;
+    unsigned char *data;
+    size_t len;
+    int  error;
+    int  err_open;
+} slot_t;
+
+// Cola circular de huecos compartida entre lectores y escritor. Todos los
+// campos están protegidos por 'mutex'.
+//   next_claim: siguiente fichero que tomará un lector
+//   next_out:   siguiente fichero que escribirá el hilo principal
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t  slot_ready;   // un lector terminó un fichero
+    pthread_cond_t  slot_free;    // el escritor liberó un hueco
+    slot_t *slots;
+    long    nslots;
+    long    next_claim;
+    long    next_out;
+    long    nfiles;
+    char  **files;
+} prefetch = {
+    .mutex      = PTHREAD_MUTEX_INITIALIZER,
+    .slot_ready = PTHREAD_COND_INITIALIZER,
+    .slot_free  = PTHREAD_COND_INITIALIZER,
+};
+
+// Buffer del camino read()/write(); se reserva solo si hace falta.
+static unsigned char *buffer = NULL;
+
+/**
+ * copy_readwrite:
+ *   Copia desde 'in' hasta EOF a 'out' con read()/write().
+ *   Devuelve los bytes copiados, o -1 (errno indica si falló la lectura o la
+ *   escritura mediante *write_failed).
+ */
+static long long copy_readwrite(int in, int out, int *write_failed) {
+    long long total = 0;
+    ssize_t n;
+
+    if (buffer == NULL) {
+        void *p;
+        int rc = posix_memalign(&p, BUFFER_ALIGN, BUFFER_SIZE);
+        if (rc != 0) {
+            errno = rc;
+            err(1, "posix_memalign");
+        }
+        buffer = p;
+    }
+
+    while ((n = read(in, buffer, BUFFER_SIZE)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            *write_failed = 0;
+            return -1;
+        }
+        // write() puede escribir menos de lo pedido (tuberías, señales).
+        ssize_t done = 0;
+        while (done < n) {
+            ssize_t w = write(out, buffer + done, n - done);
+            if (w < 0) {
+                if (errno == EINTR)
+                    continue;
+                *write_failed = 1;
+                return -1;
+            }
+            done += w;
+        }
+        total += n;
+    }
+    return total;
+}
+
+/**
+ * copy_kernel:
+ *   Copia desde 'in' hasta EOF a 'out' con splice() o sendfile(), según
+ *   'method'. Si la primera llamada falla con EINVAL/ENOSYS (combinación de
+ *   descriptores no soportada), devuelve -2 para que el llamante use
+ *   read()/write(); en ese caso no se ha consumido nada de 'in'.
+ */
+static long long copy_kernel(int in, int out, copy_method_t method,
+                             int *write_failed) {
+    long long total = 0;
+    ssize_t n;
+
+    for (;;) {
+        if (method == COPY_SPLICE)
+            n = splice(in, NULL, out, NULL, CHUNK_SIZE,
+                       SPLICE_F_MOVE | SPLICE_F_MORE);
+        else
+            n = sendfile(out, in, NULL, CHUNK_SIZE);
+
+        if (n == 0)
+            return total;
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (total == 0 && (errno == EINVAL || errno == ENOSYS))
+                return -2;
+            // Con splice/sendfile no se distingue qué extremo falló:
+            // EPIPE/ENOSPC/EFBIG son errores típicos de escritura.
+            *write_failed = (errno == EPIPE || errno == ENOSPC ||
+                             errno == EFBIG || errno == EAGAIN);
+            return -1;
+        }
+        total += n;
+    }
+}
+
+/**
+ * pick_method:
+ *   Elige el método de copia a partir del tipo de fichero de stdout.
+ */
+static copy_method_t pick_method(int out) {
+    struct stat st;
+    if (fstat(out, &st) != 0)
+        return COPY_READWRITE;
+    if (S_ISFIFO(st.st_mode))
+        return COPY_SPLICE;
+    if (S_ISREG(st.st_mode) || S_ISSOCK(st.st_mode))
+        return COPY_SENDFILE;
+    return COPY_READWRITE;
+}
 
-// Tamaño del buffer: número de bytes que leeremos/escribiremos en cada llamada.
-// 1024 es un compromiso entre overhead de llamadas y uso de memoria.
-#define BUFFER_SIZE 1024
+/**
+ * prepare_file:
+ *   Trabajo de un hilo lector sobre un hueco: abre el fichero y, si es
+ *   pequeño, lo lee entero; si no, pide al kernel que lo vaya leyendo.
+ *   Se ejecuta sin el mutex.
+ */
+static void prepare_file(slot_t *slot, const char *path) {
+    struct stat st;
+
+    slot->fd = open(path, O_RDONLY);
+    if (slot->fd == -1) {
+        slot->error = errno;
+        slot->err_open = 1;
+        return;
+    }
+
+    if (fstat(slot->fd, &st) == 0 && S_ISREG(st.st_mode) &&
+        st.st_size > SMALL_FILE) {
+        // Fichero grande: que el kernel empiece a leerlo ya, en secuencial.
+        posix_fadvise(slot->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        posix_fadvise(slot->fd, 0, 0, POSIX_FADV_WILLNEED);
+        return;
+    }
+
+    // Fichero pequeño (o no regular): leer hasta SMALL_FILE bytes.
+    while (slot->len < SMALL_FILE) {
+        ssize_t n = read(slot->fd, slot->data + slot->len,
+                         SMALL_FILE - slot->len);
+        if (n == 0) {
+            // EOF: el fichero está entero en memoria.
+            close(slot->fd);
+            slot->fd = -1;
+            return;
+        }
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            slot->error = errno;
+            return;
+        }
+        slot->len += n;
+    }
+    // Buffer lleno y puede quedar más (p.ej. el fichero creció): el escritor
+    // seguirá desde la posición actual del descriptor.
+}
+
+/**
+ * reader_thread:
+ *   Bucle de un hilo lector: toma el siguiente fichero de la lista mientras
+ *   no vaya más de 'nslots' ficheros por delante del escritor.
+ */
+static void *reader_thread(void *arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&prefetch.mutex);
+    for (;;) {
+        while (prefetch.next_claim < prefetch.nfiles &&
+               prefetch.next_claim - prefetch.next_out >= prefetch.nslots)
+            pthread_cond_wait(&prefetch.slot_free, &prefetch.mutex);
+        if (prefetch.next_claim >= prefetch.nfiles)
+            break;
+
+        long file = prefetch.next_claim++;
+        slot_t *slot = &prefetch.slots[file % prefetch.nslots];
+        pthread_mutex_unlock(&prefetch.mutex);
+
+        prepare_file(slot, prefetch.files[file]);
+
+        pthread_mutex_lock(&prefetch.mutex);
+        slot->file = file;
+        slot->ready = 1;
+        pthread_cond_broadcast(&prefetch.slot_ready);
+    }
+    pthread_mutex_unlock(&prefetch.mutex);
+    return NULL;
+}
+
+/**
+ * write_all:
+ *   Escribe 'len' bytes de 'buf' en 'out', reintentando escrituras parciales.
+ */
+static int write_all(int out, const unsigned char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t w = write(out, buf, len);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += w;
+        len -= w;
+    }
+    return 0;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-v] [-j readers] <file_name> [<file_name> ...]\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
 
 int main(int argc, char* argv[]) {
-    // Puntero a FILE para la manipulación del fichero.
-    FILE *file = NULL;
-
-    // Buffer donde almacenaremos los datos leídos.
-    unsigned char buffer[BUFFER_SIZE];
-
-    // bytes_read: número real de bytes devueltos por fread en cada iteración.
-    // bytes_written: número de bytes realmente escritos por fwrite.
-    size_t bytes_read, bytes_written;
-
-    // 1) Comprobación de argumentos:
-    //    argc debe ser 2: [0]=nombre programa, [1]=ruta del fichero
-    if (argc != 2) {
-        // fprintf escribe en stderr un mensaje de uso y salimos con código 1
-        fprintf(stderr, "Usage: %s <file_name>\n", argv[0]);
-        exit(EXIT_FAILURE);
+    int opt;
+    int verbose = 0;
+    long readers = DEFAULT_READERS;
+    char *endptr;
+    int status = EXIT_SUCCESS;
+    long long total_bytes = 0;
+
+    // 1) Opciones y comprobación de argumentos: al menos un fichero.
+    while ((opt = getopt(argc, argv, "vj:")) != -1) {
+        switch (opt) {
+        case 'v':
+            verbose = 1;
+            break;
+        case 'j':
+            readers = strtol(optarg, &endptr, 10);
+            if (*endptr != '\0' || readers < 1 || readers > 1024)
+                errx(1, "-j requires a number between 1 and 1024");
+            break;
+        default:
+            usage(argv[0]);
+        }
     }
+    if (optind >= argc)
+        usage(argv[0]);
 
-    // 2) Apertura del fichero en modo "rb" (lectura binaria):
-    //    - El modo "rb" asegura que fread() lea bytes tal cual,
-    //      sin traducción de finales de línea (importante en Windows).
-    //    - fopen() devuelve NULL si no puede abrir el fichero.
-    file = fopen(argv[1], "rb");
-    if (file == NULL) {
-        // err(2, ...) formatea e imprime en stderr:
-        //   progname: mensaje formato strerror(errno)
-        err(2, "No se pudo abrir el fichero de entrada '%s'", argv[1]);
+    // 2) Preparar la cola de huecos y lanzar los hilos lectores. No tiene
+    //    sentido tener más lectores que ficheros.
+    prefetch.files  = &argv[optind];
+    prefetch.nfiles = argc - optind;
+    if (readers > prefetch.nfiles)
+        readers = prefetch.nfiles;
+    prefetch.nslots = readers * SLOTS_PER_READER;
+    prefetch.slots  = calloc(prefetch.nslots, sizeof(slot_t));
+    if (prefetch.slots == NULL)
+        err(1, "calloc");
+    for (long s = 0; s < prefetch.nslots; s++) {
+        prefetch.slots[s].data = malloc(SMALL_FILE);
+        if (prefetch.slots[s].data == NULL)
+            err(1, "malloc");
+        prefetch.slots[s].fd = -1;
     }
 
-    // 3) Bucle de lectura/escritura:
-    //    fread:
-    //      - buffer: dirección donde almacenar datos
-    //      - 1: tamaño de cada elemento (1 byte)
-    //      - BUFFER_SIZE: número máximo de elementos a leer
-    //      - file: puntero al FILE abierto
-    //    Devuelve el número de elementos leídos (bytes en este caso).
-    while ((bytes_read = fread(buffer, 1, BUFFER_SIZE, file)) > 0) {
-        // fwrite:
-        //   - buffer: datos a escribir
-        //   - 1: tamaño de cada elemento (1 byte)
-        //   - bytes_read: número de elementos a escribir
-        //   - stdout: destino de salida (pantalla)
-        bytes_written = fwrite(buffer, 1, bytes_read, stdout);
-
-        // Comprobación de error parcial/total en escritura:
-        //   Si fwrite escribe menos bytes de los que pedimos,
-        //   algo fue mal (disco lleno, pipe roto, etc.).
-        if (bytes_written < bytes_read) {
-            fclose(file);
-            err(3, "Error al escribir en stdout (fwrite)");
+    pthread_t *tids = malloc(readers * sizeof(pthread_t));
+    if (tids == NULL)
+        err(1, "malloc");
+    for (long t = 0; t < readers; t++) {
+        int rc = pthread_create(&tids[t], NULL, reader_thread, NULL);
+        if (rc != 0) {
+            errno = rc;
+            err(1, "pthread_create");
         }
     }
 
-    // 4) Detección de errores de lectura:
-    //    fread deja feof(file)=true si llega al final, o
-    //    ferror(file)=true si ocurrió un error de lectura.
-    if (ferror(file)) {
-        // Cierra el fichero antes de salir
-        fclose(file);
-        err(4, "Error al leer del fichero '%s'", argv[1]);
+    copy_method_t preferred = pick_method(STDOUT_FILENO);
+    double start = now_seconds();
+
+    // 3) Escribir cada fichero en el orden de los argumentos, esperando a que
+    //    su lector lo tenga listo. Si uno no se puede abrir o leer seguimos
+    //    con el siguiente (como cat) y lo reflejamos en el código de salida;
+    //    un error de escritura en stdout es fatal.
+    for (long i = 0; i < prefetch.nfiles; i++) {
+        const char *path = prefetch.files[i];
+        slot_t *slot = &prefetch.slots[i % prefetch.nslots];
+
+        pthread_mutex_lock(&prefetch.mutex);
+        while (!slot->ready || slot->file != i)
+            pthread_cond_wait(&prefetch.slot_ready, &prefetch.mutex);
+        pthread_mutex_unlock(&prefetch.mutex);
+
+        copy_method_t method = COPY_READWRITE;
+        int write_failed = 0;
+        long long n = slot->len;
+
+        if (slot->err_open) {
+            errno = slot->error;
+            warn("No se pudo abrir el fichero de entrada '%s'", path);
+            status = 2;
+            n = -1;
+        } else if (slot->len > 0 &&
+                   write_all(STDOUT_FILENO, slot->data, slot->len) != 0) {
+            err(3, "Error al escribir en stdout");
+        } else if (slot->error) {
+            errno = slot->error;
+            warn("Error al leer del fichero '%s'", path);
+            status = 4;
+            n = -1;
+        } else if (slot->fd != -1) {
+            // Resto del fichero (o el fichero entero si es grande).
+            long long rest = -2;
+            method = preferred;
+            if (method != COPY_READWRITE)
+                rest = copy_kernel(slot->fd, STDOUT_FILENO, method,
+                                   &write_failed);
+            if (rest == -2) {
+                // splice/sendfile no soportado para esta pareja de
+                // descriptores (p.ej. stdout abierto con O_APPEND o entrada
+                // no mapeable).
+                method = COPY_READWRITE;
+                rest = copy_readwrite(slot->fd, STDOUT_FILENO, &write_failed);
+            }
+            if (rest < 0) {
+                if (write_failed)
+                    err(3, "Error al escribir en stdout");
+                warn("Error al leer del fichero '%s'", path);
+                status = 4;
+                n = -1;
+            } else {
+                n += rest;
+            }
+        }
+
+        if (n >= 0) {
+            total_bytes += n;
+            if (verbose)
+                fprintf(stderr, "%s: %lld bytes (%s)\n",
+                        path, n, slot->fd == -1 ? "prefetched" :
+                        method_name[method]);
+        }
+
+        // 4) Cierre del fichero y liberación del hueco para los lectores
+        if (slot->fd != -1 && close(slot->fd) != 0) {
+            warn("Error al cerrar el fichero '%s'", path);
+            status = 5;
+        }
+        slot->fd = -1;
+        slot->len = 0;
+        slot->error = 0;
+        slot->err_open = 0;
+
+        pthread_mutex_lock(&prefetch.mutex);
+        slot->ready = 0;
+        prefetch.next_out++;
+        pthread_cond_broadcast(&prefetch.slot_free);
+        pthread_mutex_unlock(&prefetch.mutex);
     }
 
-    // 5) Cierre del fichero:
-    //    Siempre debemos liberar el descriptor y el búfer interno.
-    if (fclose(file) != 0) {
-        // Si fclose falla (caso muy raro), reportamos.
-        err(5, "Error al cerrar el fichero '%s'", argv[1]);
+    // 5) Estadísticas de rendimiento
+    if (verbose) {
+        double elapsed = now_seconds() - start;
+        fprintf(stderr, "total: %lld bytes in %.6f s (%.0f bytes/s)\n",
+                total_bytes, elapsed,
+                elapsed > 0 ? total_bytes / elapsed : 0.0);
     }
 
-    // 6) Salida normal
-    return EXIT_SUCCESS;
+    for (long t = 0; t < readers; t++)
+        pthread_join(tids[t], NULL);
+    for (long s = 0; s < prefetch.nslots; s++)
+        free(prefetch.slots[s].data);
+    free(prefetch.slots);
+    free(tids);
+    free(buffer);
+    return status;
 }
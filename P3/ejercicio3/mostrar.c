@@ -2,68 +2,852 @@
  * mostrar.c
  *
  * Programa similar a 'cat' que muestra el contenido de un fichero regular,
- * con opción de saltarse los primeros N bytes o de mostrar solo los últimos N bytes.
+ * con opción de saltarse los primeros N bytes, de mostrar solo los últimos N
+ * bytes o de mostrar solo las últimas N líneas (como tail). Con -f sigue
+ * mostrando lo que se añada al fichero después (como tail -F). Con -r/-R
+ * extrae varios rangos de bytes en una sola ejecución.
  *
  * Uso:
- *   ./mostrar [-n N] [-e] <ruta_fichero>
+ *   ./mostrar [-n N] [-e] [-f] <ruta_fichero>
+ *   ./mostrar -l N [-f] <ruta_fichero>
+ *   ./mostrar [-j H] {-r desp:long | -R fichero_rangos}... <ruta_fichero>
  *
  * Opciones:
  *   -n N   Número de bytes a saltar (por defecto 0) o a mostrar si -e está presente
  *   -e     Indica que se deben mostrar los últimos N bytes en lugar de saltar los primeros
+ *   -l N   Muestra las últimas N líneas del fichero
+ *   -f     Tras el volcado inicial, espera con inotify a que el fichero crezca
+ *          y muestra solo los bytes nuevos. Detecta truncados (vuelve al
+ *          principio) y rotaciones (el nombre pasa a otro inodo: se termina
+ *          de volcar el antiguo y se reabre el nuevo).
+ *   -r D:L Muestra L bytes a partir del desplazamiento D. Se puede repetir.
+ *   -R F   Lee rangos "D:L" del fichero F (uno por línea; se ignoran las
+ *          líneas vacías y las que empiezan por '#').
+ *   -j H   Número de hilos lectores para los rangos (por defecto 4).
  *
  * Comportamiento:
  *   1) Abrir el fichero en lectura.
- *   2) Parsear con getopt() las opciones -n y -e.
- *   3) Posicionar el descriptor de fichero con lseek():
+ *   2) Parsear con getopt() las opciones.
+ *   3) Calcular el desplazamiento inicial:
  *        - Si -e: lseek(fd, -N, SEEK_END) para avanzar hasta N desde el final.
  *        - Si no -e: lseek(fd, N, SEEK_SET) para saltar N desde el comienzo.
- *   4) Leer byte a byte (read(fd, &c, 1)) y escribir en stdout (write(1, &c, 1)) hasta EOF.
+ *        - Si -l: recorrer el fichero hacia atrás en bloques grandes con
+ *          pread() contando saltos de línea hasta encontrar el comienzo de
+ *          la N-ésima línea empezando por el final.
+ *   4) Copiar desde ese desplazamiento hasta EOF en bloques de BLOCK_SIZE
+ *      bytes con pread()/write().
+ *   5) Con -f, bloquearse en read() sobre el descriptor de inotify (sin
+ *      sondeo: el proceso no consume CPU mientras el fichero no cambia) y
+ *      repetir 4) desde el último desplazamiento con cada evento.
+ *
+ * Rangos (-r/-R):
+ *   Se ordenan por desplazamiento y los que se solapan o son contiguos se
+ *   funden en un único extent, que se lee una sola vez aunque lo usen varios
+ *   rangos. Cada extent se parte en trozos de BLOCK_SIZE bytes. Un pool de H
+ *   hilos lee los trozos en orden de desplazamiento (localidad en disco),
+ *   mientras el hilo principal escribe cada rango en el orden en que se
+ *   pidió, en cuanto sus trozos están listos. Los lectores no pueden tener
+ *   más de 2*H trozos en memoria: si el hilo principal necesita un trozo al
+ *   que no llegan por falta de sitio, lo lee él mismo y lo escribe directo.
+ *   Así la memoria no depende del tamaño de los rangos.
  *
  * Páginas de manual:
- *   man 2 open, man 2 read, man 2 write, man 2 close, man 2 lseek
- *   man 3 getopt, man 3 perror, man 3 strerror
+ *   man 2 open, man 2 read, man 2 pread, man 2 write, man 2 close, man 2 lseek
+ *   man 3 getopt, man 3 perror, man 3 strerror, man 3 memrchr
+ *   man 7 inotify, man 2 inotify_add_watch
+ *   man 3 qsort, man 3 pthread_create, man 3 pthread_cond_wait
  *
  * Autora: Dorjee
  */
 
+#define _GNU_SOURCE     // memrchr
+
 #include <stdio.h>      // perror, fprintf, stderr
-#include <stdlib.h>     // EXIT_SUCCESS, EXIT_FAILURE, strtol
+#include <stdlib.h>     // EXIT_SUCCESS, EXIT_FAILURE, strtol, malloc
 #include <fcntl.h>      // open, O_RDONLY
-#include <unistd.h>     // read, write, close, lseek, getopt
+#include <unistd.h>     // pread, write, close, lseek, getopt
 #include <errno.h>      // errno
-#include <string.h>     // strerror
+#include <string.h>     // strerror, memrchr
+#include <sys/stat.h>   // fstat, stat
+#include <sys/inotify.h> // inotify_init1, inotify_add_watch
+#include <pthread.h>    // pthread_create, mutex, cond
+
+#ifdef __SSE2__
+#include <emmintrin.h>  // _mm_cmpeq_epi8, _mm_movemask_epi8
+#endif
+
+// Tamaño de cada pread()/write(). Con 1 MiB, mostrar los últimos bytes o
+// líneas de un fichero enorme cuesta unas pocas llamadas al sistema.
+#define BLOCK_SIZE (1024 * 1024)
+
+static unsigned char *block;
+
+#define DEFAULT_RANGE_THREADS 4
+
+// Rango pedido por el usuario. 'extent' es el índice del extent (rango ya
+// fundido) que lo contiene.
+typedef struct {
+    off_t  offset;
+    off_t  length;
+    size_t extent;
+} range_t;
+
+// Zona contigua del fichero (rangos fundidos). Sus trozos son los de
+// extents.chunks a partir de 'first', uno por cada BLOCK_SIZE bytes.
+typedef struct {
+    off_t  offset;
+    off_t  length;
+    size_t first;
+} extent_t;
+
+// Estado de lectura de un trozo
+enum { CHUNK_PENDING, CHUNK_READING, CHUNK_DONE };
+
+// Trozo de un extent, de BLOCK_SIZE bytes como mucho (el último, menos).
+//   data/got: bytes leídos (got < length si el fichero acaba antes)
+//   users:    rangos pendientes de escribir que lo usan; al llegar a 0 se
+//             libera la memoria y deja sitio a los lectores
+//   state/error: estado de la lectura
+// Todo protegido por extents.mutex, salvo leer 'data' cuando ya está en
+// CHUNK_DONE (nadie la libera mientras quien lee cuente en 'users').
+typedef struct {
+    off_t  offset;
+    size_t length;
+    unsigned char *data;
+    size_t got;
+    size_t users;
+    int    state;
+    int    error;
+} chunk_t;
+
+// Estado compartido entre el hilo principal y los lectores de trozos.
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t  done;       // un trozo ha terminado de leerse
+    pthread_cond_t  room;       // se ha liberado un trozo, o hay que parar
+    extent_t *list;
+    size_t    count;
+    chunk_t  *chunks;
+    size_t    nchunks;
+    size_t    next;             // siguiente trozo a leer
+    size_t    buffered;         // trozos leyéndose o leídos sin liberar
+    size_t    limit;            // máximo de 'buffered'
+    int       stop;
+    int       fd;
+} extents = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .done  = PTHREAD_COND_INITIALIZER,
+    .room  = PTHREAD_COND_INITIALIZER,
+};
+
+/**
+ * write_all:
+ *   Escribe 'len' bytes de 'buf' en stdout, reintentando escrituras parciales.
+ *   Devuelve 0 en éxito o -1 en error.
+ */
+static int write_all(const unsigned char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t w = write(STDOUT_FILENO, buf, len);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += w;
+        len -= w;
+    }
+    return 0;
+}
+
+/**
+ * copy_from:
+ *   Copia a stdout el contenido de 'fd' desde 'offset' hasta EOF, en bloques
+ *   de BLOCK_SIZE bytes. Devuelve el desplazamiento final (EOF) o -1 en error
+ *   (mensaje ya impreso).
+ */
+static off_t copy_from(int fd, off_t offset) {
+    ssize_t n;
+    while ((n = pread(fd, block, BLOCK_SIZE, offset)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("Error leyendo fichero");
+            return -1;
+        }
+        if (write_all(block, n) != 0) {
+            perror("Error escribiendo en stdout");
+            return -1;
+        }
+        offset += n;
+    }
+    return offset;
+}
+
+/**
+ * find_newline_back:
+ *   Busca hacia atrás en buf[0..len) el '\n' número *left contando desde el
+ *   final. Si lo encuentra devuelve su posición; si no, descuenta de *left
+ *   los saltos de línea vistos y devuelve -1.
+ *
+ *   Con SSE2 compara 16 bytes por instrucción y recorre los bits de la
+ *   máscara resultante; sin SSE2 usa memrchr() (vectorizada en glibc).
+ */
+static ssize_t find_newline_back(const unsigned char *buf, size_t len,
+                                 long *left) {
+    size_t end = len;
+
+#ifdef __SSE2__
+    const __m128i nl = _mm_set1_epi8('\n');
+    while (end >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(buf + end - 16));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, nl));
+        while (mask != 0) {
+            // El bit más alto es el '\n' más cercano al final del trozo.
+            int bit = 31 - __builtin_clz(mask);
+            if (--*left == 0)
+                return end - 16 + bit;
+            mask &= ~(1u << bit);
+        }
+        end -= 16;
+    }
+#endif
+
+    const unsigned char *p;
+    while (end > 0 && (p = memrchr(buf, '\n', end)) != NULL) {
+        if (--*left == 0)
+            return p - buf;
+        end = p - buf;
+    }
+    return -1;
+}
+
+/**
+ * last_lines_offset:
+ *   Devuelve el desplazamiento donde empiezan las últimas 'lines' líneas de
+ *   un fichero de 'size' bytes, o -1 en error. Igual que tail, un '\n' final
+ *   no abre una línea nueva. Solo se leen los bloques del final necesarios.
+ */
+static off_t last_lines_offset(int fd, off_t size, long lines) {
+    if (lines == 0)
+        return size;
+
+    off_t end = size;
+    int skip_final_newline = 1;
+
+    while (end > 0) {
+        off_t start = end > BLOCK_SIZE ? end - BLOCK_SIZE : 0;
+        size_t want = end - start;
+        size_t got = 0;
+
+        while (got < want) {
+            ssize_t n = pread(fd, block + got, want - got, start + got);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                if (n == 0)
+                    errno = EIO;    // el fichero ha encogido mientras leíamos
+                perror("Error leyendo fichero");
+                return -1;
+            }
+            got += n;
+        }
+
+        size_t len = want;
+        if (skip_final_newline) {
+            if (block[len - 1] == '\n')
+                len--;
+            skip_final_newline = 0;
+        }
+
+        ssize_t pos = find_newline_back(block, len, &lines);
+        if (pos >= 0)
+            return start + pos + 1;
+        end = start;
+    }
+    // Hay menos de 'lines' líneas: se muestra el fichero entero.
+    return 0;
+}
+
+/**
+ * reopen_if_rotated:
+ *   Comprueba si 'path' apunta ahora a otro fichero distinto del abierto en
+ *   *fd (rotación de logs: mv log log.1 && touch log). En ese caso vuelca lo
+ *   que quede del antiguo, lo cierra, abre el nuevo y mueve el watch de
+ *   inotify. Devuelve 0 (con *fd y *offset actualizados) o -1 en error.
+ */
+static int reopen_if_rotated(const char *path, int *fd, off_t *offset,
+                             int ino, int *wd_file) {
+    struct stat cur, now;
+
+    if (stat(path, &now) == -1) {
+        // Aún no existe el nuevo fichero: seguir con el antiguo y esperar
+        // el IN_CREATE del directorio.
+        return 0;
+    }
+    if (fstat(*fd, &cur) == -1) {
+        fprintf(stderr, "Error en fstat: %s\n", strerror(errno));
+        return -1;
+    }
+    if (cur.st_dev == now.st_dev && cur.st_ino == now.st_ino)
+        return 0;
+
+    // Lo escrito en el antiguo antes de rotar también hay que mostrarlo.
+    *offset = copy_from(*fd, *offset);
+    if (*offset == (off_t)-1)
+        return -1;
+
+    int nfd = open(path, O_RDONLY);
+    if (nfd == -1) {
+        if (errno == ENOENT)
+            return 0;   // rotado otra vez entre stat() y open()
+        fprintf(stderr, "Error abriendo '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+    fprintf(stderr, "Fichero '%s' reemplazado; "
+            "siguiendo el nuevo fichero\n", path);
+    close(*fd);
+    *fd = nfd;
+    *offset = 0;
+
+    // El watch antiguo seguía al inodo anterior; lo cambiamos por el nuevo.
+    inotify_rm_watch(ino, *wd_file);
+    *wd_file = inotify_add_watch(ino, path, IN_MODIFY | IN_ATTRIB |
+                                 IN_MOVE_SELF | IN_DELETE_SELF);
+    if (*wd_file == -1) {
+        fprintf(stderr, "Error en inotify_add_watch('%s'): %s\n",
+                path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * follow:
+ *   Modo -f: a partir de 'offset' (fin del volcado inicial) espera eventos de
+ *   inotify y muestra los bytes añadidos. Vigila el propio fichero
+ *   (IN_MODIFY, truncados, movido/borrado) y su directorio (IN_CREATE,
+ *   IN_MOVED_TO) para detectar la aparición de un fichero nuevo con el mismo
+ *   nombre. Solo retorna en caso de error (-1).
+ */
+static int follow(const char *path, int *fd, off_t offset) {
+    // inotify entrega varios eventos por read(); bastan unos pocos KiB.
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    int ino = inotify_init1(IN_CLOEXEC);
+    if (ino == -1) {
+        perror("inotify_init1");
+        return -1;
+    }
+
+    int wd_file = inotify_add_watch(ino, path, IN_MODIFY | IN_ATTRIB |
+                                    IN_MOVE_SELF | IN_DELETE_SELF);
+    if (wd_file == -1) {
+        fprintf(stderr, "Error en inotify_add_watch('%s'): %s\n",
+                path, strerror(errno));
+        close(ino);
+        return -1;
+    }
+
+    // Directorio que contiene el fichero ("." si la ruta no tiene '/').
+    char dir[4096];
+    const char *slash = strrchr(path, '/');
+    if (slash == NULL)
+        snprintf(dir, sizeof(dir), ".");
+    else if (slash == path)
+        snprintf(dir, sizeof(dir), "/");
+    else
+        snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path), path);
+    if (inotify_add_watch(ino, dir, IN_CREATE | IN_MOVED_TO) == -1) {
+        fprintf(stderr, "Error en inotify_add_watch('%s'): %s\n",
+                dir, strerror(errno));
+        close(ino);
+        return -1;
+    }
+
+    for (;;) {
+        // Bloqueante: no se consume CPU mientras no haya cambios. No hace
+        // falta mirar cada evento; todos llevan a la misma comprobación, y
+        // así una ráfaga de escrituras se atiende con una sola pasada.
+        ssize_t n = read(ino, events, sizeof(events));
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("Error leyendo eventos de inotify");
+            break;
+        }
+
+        // Truncado: el fichero es ahora más corto que lo ya mostrado.
+        struct stat st;
+        if (fstat(*fd, &st) == -1) {
+            fprintf(stderr, "Error en fstat: %s\n", strerror(errno));
+            break;
+        }
+        if (st.st_size < offset) {
+            fprintf(stderr, "Fichero '%s' truncado\n", path);
+            offset = 0;
+        }
+
+        offset = copy_from(*fd, offset);
+        if (offset == (off_t)-1)
+            break;
+
+        if (reopen_if_rotated(path, fd, &offset, ino, &wd_file) == -1)
+            break;
+        offset = copy_from(*fd, offset);
+        if (offset == (off_t)-1)
+            break;
+    }
+
+    close(ino);
+    return -1;
+}
+
+/**
+ * parse_range:
+ *   Interpreta "desplazamiento:longitud" y lo añade a *ranges (vector
+ *   dinámico de *count elementos y capacidad *cap). Devuelve 0 o -1 si el
+ *   texto no es válido.
+ */
+static int parse_range(const char *text, range_t **ranges, size_t *count,
+                       size_t *cap) {
+    char *endptr;
+    long long offset = strtoll(text, &endptr, 10);
+    if (endptr == text || *endptr != ':' || offset < 0)
+        return -1;
+    const char *len_text = endptr + 1;
+    long long length = strtoll(len_text, &endptr, 10);
+    if (endptr == len_text || length < 0)
+        return -1;
+    while (*endptr == ' ' || *endptr == '\t' || *endptr == '\n' ||
+           *endptr == '\r')
+        endptr++;
+    if (*endptr != '\0')
+        return -1;
+
+    if (*count == *cap) {
+        *cap = *cap ? *cap * 2 : 16;
+        range_t *bigger = realloc(*ranges, *cap * sizeof(range_t));
+        if (!bigger) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        *ranges = bigger;
+    }
+    (*ranges)[*count].offset = offset;
+    (*ranges)[*count].length = length;
+    (*count)++;
+    return 0;
+}
+
+/**
+ * load_ranges:
+ *   Añade los rangos del fichero 'path' (uno por línea). Devuelve 0 o -1.
+ */
+static int load_ranges(const char *path, range_t **ranges, size_t *count,
+                       size_t *cap) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "Error abriendo '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+    char line[256];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        lineno++;
+        char *p = line;
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p == '#' || *p == '\n' || *p == '\0')
+            continue;
+        if (parse_range(p, ranges, count, cap) != 0) {
+            fprintf(stderr, "%s:%d: rango no válido (se espera desp:long)\n",
+                    path, lineno);
+            fclose(fp);
+            return -1;
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+// Orden de los rangos por desplazamiento (para qsort sobre punteros).
+static int cmp_range_offset(const void *a, const void *b) {
+    const range_t *ra = *(const range_t * const *)a;
+    const range_t *rb = *(const range_t * const *)b;
+    if (ra->offset != rb->offset)
+        return ra->offset < rb->offset ? -1 : 1;
+    return 0;
+}
+
+/**
+ * build_extents:
+ *   Ordena los rangos por desplazamiento y funde los que se solapan o son
+ *   contiguos. Los rangos se recortan al tamaño del fichero para no leer
+ *   bytes que no existen. Rellena extents.list/count, el campo 'extent' de
+ *   cada rango y los trozos (extents.chunks/nchunks), con el número de
+ *   rangos que usa cada uno.
+ */
+static void build_extents(range_t *ranges, size_t n, off_t file_size) {
+    range_t **sorted = malloc(n * sizeof(range_t *));
+    extents.list = malloc(n * sizeof(extent_t));
+    if (!sorted || !extents.list) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < n; i++) {
+        range_t *r = &ranges[i];
+        if (r->offset > file_size)
+            r->offset = file_size;
+        if (r->length > file_size - r->offset)
+            r->length = file_size - r->offset;
+        sorted[i] = r;
+    }
+    qsort(sorted, n, sizeof(range_t *), cmp_range_offset);
+
+    extents.count = 0;
+    for (size_t i = 0; i < n; i++) {
+        range_t *r = sorted[i];
+        extent_t *last = extents.count ? &extents.list[extents.count - 1]
+                                       : NULL;
+        if (last && r->offset <= last->offset + last->length) {
+            off_t end = r->offset + r->length;
+            if (end > last->offset + last->length)
+                last->length = end - last->offset;
+        } else {
+            last = &extents.list[extents.count++];
+            memset(last, 0, sizeof(*last));
+            last->offset = r->offset;
+            last->length = r->length;
+        }
+        r->extent = last - extents.list;
+    }
+    free(sorted);
+
+    extents.nchunks = 0;
+    for (size_t i = 0; i < extents.count; i++) {
+        extent_t *e = &extents.list[i];
+        e->first = extents.nchunks;
+        extents.nchunks += (e->length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    }
+    extents.chunks = calloc(extents.nchunks ? extents.nchunks : 1,
+                            sizeof(chunk_t));
+    if (!extents.chunks) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < extents.count; i++) {
+        extent_t *e = &extents.list[i];
+        for (off_t pos = 0; pos < e->length; pos += BLOCK_SIZE) {
+            chunk_t *c = &extents.chunks[e->first + pos / BLOCK_SIZE];
+            c->offset = e->offset + pos;
+            c->length = e->length - pos < BLOCK_SIZE ? e->length - pos
+                                                     : BLOCK_SIZE;
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        range_t *r = &ranges[i];
+        if (r->length == 0)
+            continue;
+        extent_t *e = &extents.list[r->extent];
+        size_t from = e->first + (r->offset - e->offset) / BLOCK_SIZE;
+        size_t to = e->first + (r->offset + r->length - 1 - e->offset)
+                               / BLOCK_SIZE;
+        for (size_t c = from; c <= to; c++)
+            extents.chunks[c].users++;
+    }
+}
+
+/**
+ * pread_full:
+ *   Lee hasta 'len' bytes de 'fd' desde 'offset' y deja en *got los leídos.
+ *   Un EOF prematuro (fichero que encoge) no es error: *got se queda con los
+ *   bytes que hubiera. Devuelve 0 o el errno del fallo.
+ */
+static int pread_full(int fd, unsigned char *buf, size_t len, off_t offset,
+                      size_t *got) {
+    *got = 0;
+    while (*got < len) {
+        ssize_t n = pread(fd, buf + *got, len - *got, offset + *got);
+        if (n == 0)
+            break;
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        }
+        *got += n;
+    }
+    return 0;
+}
+
+/**
+ * extent_reader:
+ *   Hilo lector: toma trozos en orden de desplazamiento y los lee con
+ *   pread(). Se salta los que ya no usa nadie y espera mientras haya
+ *   extents.limit trozos en memoria, hasta que el hilo principal libere
+ *   alguno o pida parar.
+ */
+static void *extent_reader(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&extents.mutex);
+    for (;;) {
+        // El hilo principal pudo escribirlos leyéndolos él mismo
+        while (extents.next < extents.nchunks &&
+               extents.chunks[extents.next].users == 0)
+            extents.next++;
+        if (extents.stop || extents.next >= extents.nchunks)
+            break;
+        if (extents.buffered >= extents.limit) {
+            pthread_cond_wait(&extents.room, &extents.mutex);
+            continue;
+        }
+        chunk_t *c = &extents.chunks[extents.next++];
+        c->state = CHUNK_READING;
+        extents.buffered++;
+        pthread_mutex_unlock(&extents.mutex);
+
+        size_t got = 0;
+        int error = 0;
+        unsigned char *data = malloc(c->length);
+        if (!data)
+            error = ENOMEM;
+        else
+            error = pread_full(extents.fd, data, c->length, c->offset, &got);
+
+        pthread_mutex_lock(&extents.mutex);
+        c->data = data;
+        c->got = got;
+        c->error = error;
+        c->state = CHUNK_DONE;
+        if (c->users == 0) {
+            // Se escribió mientras lo leíamos
+            free(c->data);
+            c->data = NULL;
+            extents.buffered--;
+            pthread_cond_broadcast(&extents.room);
+        }
+        pthread_cond_broadcast(&extents.done);
+    }
+    pthread_mutex_unlock(&extents.mutex);
+    return NULL;
+}
+
+/**
+ * put_chunk:
+ *   El hilo principal ha terminado con el trozo 'c' para un rango. Si era
+ *   el último que lo usaba, libera su memoria y despierta a los lectores.
+ */
+static void put_chunk(chunk_t *c) {
+    pthread_mutex_lock(&extents.mutex);
+    if (--c->users == 0 && c->state == CHUNK_DONE && c->data) {
+        free(c->data);
+        c->data = NULL;
+        extents.buffered--;
+        pthread_cond_broadcast(&extents.room);
+    }
+    pthread_mutex_unlock(&extents.mutex);
+}
+
+/**
+ * write_part:
+ *   Escribe 'len' bytes del trozo 'c' a partir de 'skip'. Si ya está leído
+ *   los copia de memoria; si nadie lo está leyendo y los lectores no tienen
+ *   sitio para llegar a él, los lee directamente en 'block'. Devuelve los
+ *   bytes escritos (menos de 'len' si el fichero acaba antes) o -1 en error
+ *   (mensaje ya impreso).
+ */
+static ssize_t write_part(chunk_t *c, size_t skip, size_t len) {
+    pthread_mutex_lock(&extents.mutex);
+    while (c->state == CHUNK_READING ||
+           (c->state == CHUNK_PENDING && extents.buffered < extents.limit))
+        pthread_cond_wait(&extents.done, &extents.mutex);
+    int state = c->state;
+    pthread_mutex_unlock(&extents.mutex);
+
+    const unsigned char *data;
+    size_t got;
+    if (state == CHUNK_DONE) {
+        if (c->error) {
+            fprintf(stderr, "Error leyendo fichero: %s\n", strerror(c->error));
+            return -1;
+        }
+        data = c->data + skip;
+        got = skip < c->got ? c->got - skip : 0;
+    } else {
+        int error = pread_full(extents.fd, block, len, c->offset + skip, &got);
+        if (error) {
+            fprintf(stderr, "Error leyendo fichero: %s\n", strerror(error));
+            return -1;
+        }
+        data = block;
+    }
+    if (got > len)
+        got = len;
+    if (write_all(data, got) != 0) {
+        perror("Error escribiendo en stdout");
+        return -1;
+    }
+    return got;
+}
+
+/**
+ * serve_ranges:
+ *   Muestra los 'n' rangos en el orden pedido, leyéndolos con 'nthreads'
+ *   hilos. Devuelve 0 o -1 en error (mensaje ya impreso).
+ */
+static int serve_ranges(int fd, range_t *ranges, size_t n, long nthreads) {
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        fprintf(stderr, "Error en fstat: %s\n", strerror(errno));
+        return -1;
+    }
+    build_extents(ranges, n, st.st_size);
+    extents.fd = fd;
+    extents.next = 0;
+    extents.buffered = 0;
+    extents.stop = 0;
+
+    if ((size_t)nthreads > extents.nchunks)
+        nthreads = extents.nchunks;
+    // Cada lector puede tener un trozo leyéndose y otro esperando a salir
+    extents.limit = 2 * nthreads;
+    pthread_t *tids = malloc((nthreads ? nthreads : 1) * sizeof(pthread_t));
+    if (!tids) {
+        perror("malloc");
+        return -1;
+    }
+    for (long t = 0; t < nthreads; t++) {
+        int rc = pthread_create(&tids[t], NULL, extent_reader, NULL);
+        if (rc != 0) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(rc));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Escribir en el orden de petición, trozo a trozo.
+    int status = 0;
+    for (size_t i = 0; i < n && status == 0; i++) {
+        range_t *r = &ranges[i];
+        extent_t *e = &extents.list[r->extent];
+        off_t pos = r->offset, end = r->offset + r->length;
+        int short_read = 0;
+
+        while (pos < end) {
+            chunk_t *c = &extents.chunks[e->first +
+                                         (pos - e->offset) / BLOCK_SIZE];
+            size_t skip = pos - c->offset;
+            size_t len = c->length - skip;
+            if ((off_t)len > end - pos)
+                len = end - pos;
+            // Tras un EOF prematuro el resto del rango ya no existe
+            if (!short_read && status == 0) {
+                ssize_t w = write_part(c, skip, len);
+                if (w < 0)
+                    status = -1;
+                else if ((size_t)w < len)
+                    short_read = 1;
+            }
+            put_chunk(c);
+            pos += len;
+        }
+    }
+
+    pthread_mutex_lock(&extents.mutex);
+    extents.stop = 1;
+    pthread_cond_broadcast(&extents.room);
+    pthread_mutex_unlock(&extents.mutex);
+    for (long t = 0; t < nthreads; t++)
+        pthread_join(tids[t], NULL);
+    for (size_t i = 0; i < extents.nchunks; i++)
+        free(extents.chunks[i].data);
+    free(extents.chunks);
+    free(extents.list);
+    free(tids);
+    return status;
+}
+
+static long parse_count(const char *arg, char opt) {
+    char *endptr;
+    long value = strtol(arg, &endptr, 10);
+    if (*endptr != '\0' || value < 0) {
+        fprintf(stderr, "Opción -%c requiere un número no negativo\n", opt);
+        exit(EXIT_FAILURE);
+    }
+    return value;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Uso: %s [-n N] [-e] [-f] <fichero>\n", prog);
+    fprintf(stderr, "     %s -l N [-f] <fichero>\n", prog);
+    fprintf(stderr, "     %s [-j H] {-r desp:long | -R fichero}... <fichero>\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
 
 int main(int argc, char *argv[]) {
     int opt;
     long N = 0;
+    long L = -1;
     int show_last = 0;
-    char *endptr;
+    int follow_mode = 0;
+    long nthreads = DEFAULT_RANGE_THREADS;
+    range_t *ranges = NULL;
+    size_t nranges = 0, ranges_cap = 0;
+    int use_ranges = 0;
 
-    // 1) Procesar opciones -n y -e
-    while ((opt = getopt(argc, argv, "n:e")) != -1) {
+    // 1) Procesar opciones
+    while ((opt = getopt(argc, argv, "n:el:fr:R:j:")) != -1) {
         switch (opt) {
         case 'n':
-            // Convertir argumento N a número
-            N = strtol(optarg, &endptr, 10);
-            if (*endptr != '\0' || N < 0) {
-                fprintf(stderr, "Opción -n requiere un número no negativo\n");
-                exit(EXIT_FAILURE);
-            }
+            N = parse_count(optarg, 'n');
             break;
         case 'e':
             show_last = 1;
             break;
+        case 'l':
+            L = parse_count(optarg, 'l');
+            break;
+        case 'f':
+            follow_mode = 1;
+            break;
+        case 'r':
+            use_ranges = 1;
+            if (parse_range(optarg, &ranges, &nranges, &ranges_cap) != 0) {
+                fprintf(stderr, "Rango no válido '%s' (se espera desp:long)\n",
+                        optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'R':
+            use_ranges = 1;
+            if (load_ranges(optarg, &ranges, &nranges, &ranges_cap) != 0)
+                exit(EXIT_FAILURE);
+            break;
+        case 'j':
+            nthreads = parse_count(optarg, 'j');
+            if (nthreads < 1) {
+                fprintf(stderr, "Opción -j requiere al menos 1 hilo\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
         default:
-            fprintf(stderr, "Uso: %s [-n N] [-e] <fichero>\n", argv[0]);
-            exit(EXIT_FAILURE);
+            usage(argv[0]);
         }
     }
+    if (L >= 0 && show_last) {
+        fprintf(stderr, "Las opciones -e y -l son incompatibles\n");
+        usage(argv[0]);
+    }
+    if (use_ranges && (L >= 0 || show_last || N != 0 || follow_mode)) {
+        fprintf(stderr,
+                "Las opciones -r/-R no se combinan con -n, -e, -l ni -f\n");
+        usage(argv[0]);
+    }
 
     // 2) Comprobar argumento fichero
     if (optind >= argc) {
         fprintf(stderr, "Falta especificar el fichero\n");
-        fprintf(stderr, "Uso: %s [-n N] [-e] <fichero>\n", argv[0]);
-        exit(EXIT_FAILURE);
+        usage(argv[0]);
     }
     const char *path = argv[optind];
 
@@ -74,9 +858,38 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    // 4) Posicionar marcador con lseek
+    block = malloc(BLOCK_SIZE);
+    if (!block) {
+        perror("malloc");
+        close(fd);
+        exit(EXIT_FAILURE);
+    }
+
+    // Modo rangos: no hay desplazamiento único
+    if (use_ranges) {
+        int rc = nranges ? serve_ranges(fd, ranges, nranges, nthreads) : 0;
+        free(ranges);
+        free(block);
+        close(fd);
+        return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // 4) Calcular el desplazamiento inicial
     off_t offset;
-    if (show_last) {
+    if (L >= 0) {
+        // Últimas L líneas: buscar hacia atrás desde el final
+        struct stat st;
+        if (fstat(fd, &st) == -1) {
+            fprintf(stderr, "Error en fstat: %s\n", strerror(errno));
+            close(fd);
+            exit(EXIT_FAILURE);
+        }
+        offset = last_lines_offset(fd, st.st_size, L);
+        if (offset == (off_t)-1) {
+            close(fd);
+            exit(EXIT_FAILURE);
+        }
+    } else if (show_last) {
         // Mostrar últimos N bytes: mover N desde final (pos puede ser negativo)
         offset = lseek(fd, -N, SEEK_END);
         if (offset == (off_t)-1) {
@@ -94,23 +907,22 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    // 5) Leer byte a byte y escribir en stdout
-    unsigned char c;
-    ssize_t n;
-    while ((n = read(fd, &c, 1)) > 0) {
-        if (write(STDOUT_FILENO, &c, 1) != 1) {
-            perror("Error escribiendo en stdout");
-            close(fd);
-            exit(EXIT_FAILURE);
-        }
+    // 5) Copiar en bloques desde el desplazamiento hasta EOF
+    offset = copy_from(fd, offset);
+    if (offset == (off_t)-1) {
+        close(fd);
+        exit(EXIT_FAILURE);
     }
-    if (n == -1) {
-        perror("Error leyendo fichero");
+
+    // 6) Modo -f: seguir el fichero indefinidamente (solo vuelve si falla)
+    if (follow_mode) {
+        follow(path, &fd, offset);
         close(fd);
         exit(EXIT_FAILURE);
     }
 
-    // 6) Cerrar fichero
+    // 7) Cerrar fichero
+    free(block);
     if (close(fd) == -1) {
         perror("Error cerrando fichero");
         exit(EXIT_FAILURE);
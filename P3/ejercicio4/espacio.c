@@ -6,96 +6,2185 @@
  * contenidos.
  *
  * Uso:
- *   ./espacio <ruta1> [<ruta2> ...]
+ *   ./espacio [-j N] [-x] [-c caché [--refresh] [--max-age S]]
+ *             [-t N] [--json] [--fd-budget N] <ruta1> [<ruta2> ...]
+ *
+ *   -j N  Recorre los directorios con N hilos (por defecto 1, recorrido
+ *         secuencial).
+ *   -x    No cruza puntos de montaje: los directorios de otro sistema de
+ *         ficheros distinto del de cada argumento ni se cuentan ni se
+ *         recorren (como du -x).
+ *   -c F, --cache=F
+ *         Usa el fichero F como caché persistente de totales por directorio
+ *         (ver abajo). Se lee al empezar y se reescribe al terminar.
+ *   --refresh
+ *         Ignora el contenido de la caché (recorrido completo) y la rehace.
+ *   --max-age S
+ *         Las entradas de la caché con más de S segundos no se usan.
+ *   -t N, --top=N
+ *         Además del total, informe de cada argumento: los N ficheros y los
+ *         N directorios (con todo su contenido) que más ocupan, e
+ *         histogramas de los ficheros por tamaño y por antigüedad.
+ *   --json
+ *         Escribe la salida (totales e informe) en JSON.
+ *   --fd-budget N
+ *         Máximo de directorios abiertos a la vez que se guardan para
+ *         volver a ellos (por defecto 64), en los dos recorridos.
  *
  * Para cada argumento:
  *   - Llama a lstat() para obtener st_blocks (512 B blocks reservados).
  *   - Si es un fichero regular o enlace, acumula st_blocks.
- *   - Si es un directorio, abre con opendir() y recorre entries con readdir(),
- *     ignora "." y ".." y aplica recursión.
+ *   - Si es un directorio, lo abre y lee sus entradas en bloque con
+ *     getdents64(), ignora "." y ".." y baja en cada subdirectorio.
+ *   - El tamaño de cada entrada se obtiene con statx() (o fstatat() si el
+ *     kernel no tiene statx) relativo al descriptor del directorio, pidiendo
+ *     solo tipo y bloques: el kernel no vuelve a resolver la ruta completa
+ *     por cada entrada. Los subdirectorios se abren con openat().
+ *   - Un fichero con varios enlaces duros (st_nlink > 1) solo se cuenta la
+ *     primera vez que aparece su (st_dev, st_ino), también entre argumentos
+ *     distintos, como hace du.
  *   - Convierte total de 512-byte blocks a kilobytes redondeando hacia arriba:
  *       kilobytes = ceil((blocks * 512) / 1024) = (blocks + 1) / 2
  *
+ * Recorrido secuencial:
+ *   En profundidad, sin recursión: una pila explícita en el heap con un
+ *   marco por nivel (el estado de lectura del directorio), así que sirve
+ *   para árboles de cualquier profundidad, incluso con rutas de más de
+ *   PATH_MAX. Solo los --fd-budget marcos más profundos tienen el
+ *   directorio abierto; los demás guardan la posición (d_off) de su última
+ *   entrada leída y, al volver a ellos, se reabren con openat(hijo, "..")
+ *   y lseek() (o, si ".." ya no es el mismo directorio, por nombre desde
+ *   la raíz). En un árbol normal nunca se llega al límite y no cuesta nada.
+ *
+ * Recorrido paralelo (-j N > 1):
+ *   Cada directorio pendiente es una tarea. Cada hilo tiene su propia cola
+ *   doble de tareas: mete y saca los subdirectorios que descubre por el
+ *   final (en profundidad, con buena localidad), y cuando se queda sin
+ *   trabajo roba de la cabeza de la cola de otro hilo (los directorios más
+ *   cercanos a la raíz, que suelen ser los subárboles más grandes). Cada
+ *   hilo suma los bloques en su propio contador y al final se suman todos,
+ *   así que el total es exactamente el mismo que el del recorrido secuencial.
+ *   Cada tarea guarda solo su nombre y una referencia (con contador) a su
+ *   directorio padre, que sigue abierto mientras le queden subdirectorios
+ *   por abrir: se abren con openat(padre, nombre), sin rutas, así que
+ *   también sirve para árboles de cualquier profundidad. Si el presupuesto
+ *   de --fd-budget no deja guardar el descriptor del padre, se reabre con
+ *   openat() nombre a nombre desde el antepasado abierto más cercano. El
+ *   presupuesto se recorta para no pasar de RLIMIT_NOFILE (ulimit -n),
+ *   dejando sitio a los descriptores que los hilos abren de paso.
+ *
+ * Enlaces duros:
+ *   Los inodos ya vistos se guardan en una tabla hash de direccionamiento
+ *   abierto por sistema de ficheros (st_dev): cada hueco es solo el número
+ *   de inodo (8 bytes) y la tabla crece al 75% de ocupación, así que decenas
+ *   de millones de inodos caben en unos cientos de MiB. Solo entran los
+ *   ficheros con más de un enlace; los directorios y los ficheros normales
+ *   no ocupan memoria.
+ *
+ * Caché incremental (-c):
+ *   Para cada directorio recorrido se guarda, con clave (st_dev, st_ino) y
+ *   validada por su mtime y ctime: los bloques de sus ficheros, la lista de
+ *   sus ficheros con varios enlaces (inodo y bloques, para seguir
+ *   descontando enlaces duros) y los nombres de sus subdirectorios. En la
+ *   siguiente ejecución, si el mtime/ctime del directorio no ha cambiado no
+ *   se leen sus entradas ni se hace stat de sus ficheros: solo se hace stat
+ *   de los subdirectorios (cuyos propios mtime/ctime deciden si se baja en
+ *   ellos con la caché o sin ella). Crear, borrar o renombrar entradas
+ *   cambia el mtime del directorio; reescribir un fichero existente no, así
+ *   que ese cambio no se ve hasta que la entrada caduca (--max-age) o se
+ *   usa --refresh. El fichero es binario, en el orden de bytes de la
+ *   máquina, y se sustituye atómicamente con rename().
+ *
+ * Informe (-t N):
+ *   No se guarda el árbol. Los N mayores ficheros y directorios se llevan
+ *   en montículos de mínimos de N huecos: una entrada solo entra si supera
+ *   a la menor, y solo entonces se construye su ruta, así que la memoria es
+ *   O(N) sea cual sea el tamaño del árbol. El total de un directorio se
+ *   conoce al terminar su subárbol: en el recorrido secuencial al volver de
+ *   su marco; en el paralelo cada directorio pendiente cuenta sus
+ *   subdirectorios sin terminar y el último en terminar le pasa su total al
+ *   padre. Los histogramas usan cubetas log2 (cubeta k: [2^(k-1), 2^k)) del
+ *   tamaño aparente (st_size) y de la antigüedad del mtime, con el número
+ *   de ficheros y lo que ocupan. Cada hilo tiene su propio informe y al
+ *   final se mezclan. Un fichero con varios enlaces duros sale una sola
+ *   vez, con la menor de sus rutas (en orden de bytes): todos sus enlaces
+ *   se proponen al top-N y uno del mismo inodo sustituye la ruta del que ya
+ *   estaba si es menor. Así no depende de qué enlace se ve primero, que en
+ *   el recorrido paralelo cambia de una ejecución a otra. Con -t la caché se actualiza pero no se usa para
+ *   saltarse directorios, porque hay que ver cada fichero.
+ *
  * Salida:
- *   Una línea por argumento: "<kilobytes>K <ruta>"
+ *   Una línea por argumento: "<kilobytes>K <ruta>", seguida del informe si
+ *   se pidió. Con --json, un array con un objeto por argumento:
+ *     { "path", "kbytes", "top_files": [{ "path", "kbytes" }],
+ *       "top_dirs": [...], "size_histogram": [{ "min_bytes", "max_bytes",
+ *       "files", "kbytes" }], "age_histogram": [{ "min_seconds",
+ *       "max_seconds", "files", "kbytes" }] }
  *
  * Páginas de manual:
  *   man 2 lstat, struct stat
- *   man 2 opendir, readdir, closedir
+ *   man 2 getdents64, man 2 openat, man 2 statx, man 2 fstatat
  *   man 2 strerror, errno
+ *   man 3 pthread_create, man 3 pthread_cond_wait
+ *   man 3 getopt_long, man 2 rename
  *
  * Autora: Dorjee
  */
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <unistd.h>
-#include <dirent.h>
-#include <string.h>
-#include <errno.h>
-#include <limits.h>
+#define _GNU_SOURCE     // statx, AT_NO_AUTOMOUNT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/sysmacros.h>     // makedev
+#include <getopt.h>
+#include <time.h>
+#include <sys/resource.h>  // getrlimit
+
+// Tamaño del buffer de getdents64(): cientos de entradas por llamada.
+#define DIRBUF_SIZE (64 * 1024)
+
+// Formato de las entradas que devuelve getdents64() (man 2 getdents).
+struct linux_dirent64 {
+    ino64_t        d_ino;
+    off64_t        d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[];
+};
+
+// Lectura por bloques de las entradas de un directorio abierto.
+typedef struct {
+    int   fd;
+    char *buf;
+    long  len;      // bytes válidos en buf
+    long  pos;      // siguiente entrada a devolver
+    off64_t off;    // d_off de la última entrada consumida (para lseek)
+} dir_reader_t;
+
+/**
+ * next_entry:
+ *   Devuelve la siguiente entrada del directorio (saltando "." y ".."),
+ *   rellenando el buffer con getdents64() cuando se agota. Devuelve NULL al
+ *   terminar o en error (con errno != 0 en ese caso).
+ */
+static struct linux_dirent64 *next_entry(dir_reader_t *r) {
+    for (;;) {
+        if (r->pos >= r->len) {
+            long n = syscall(SYS_getdents64, r->fd, r->buf, DIRBUF_SIZE);
+            if (n <= 0) {
+                if (n == 0)
+                    errno = 0;
+                return NULL;
+            }
+            r->len = n;
+            r->pos = 0;
+        }
+        struct linux_dirent64 *d = (struct linux_dirent64 *)(r->buf + r->pos);
+        r->pos += d->d_reclen;
+        r->off = d->d_off;
+        const char *name = d->d_name;
+        if (name[0] == '.' && (name[1] == '\0' ||
+                               (name[1] == '.' && name[2] == '\0')))
+            continue;
+        return d;
+    }
+}
+
+// Lo que necesitamos saber de cada entrada.
+typedef struct {
+    mode_t mode;
+    size_t blocks;
+    off_t  size;        // tamaño aparente, solo para el informe
+    dev_t  dev;
+    ino_t  ino;
+    nlink_t nlink;
+    struct timespec mtime;
+    struct timespec ctime;
+} entry_info_t;
+
+// Opción -x y sistema de ficheros del argumento que se está recorriendo.
+static int one_file_system;
+static dev_t root_dev;
+
+/*
+ * Conjunto de inodos ya contados de un sistema de ficheros: tabla hash de
+ * direccionamiento abierto con sondeo lineal. Un hueco a 0 está libre; el
+ * inodo 0 (que no usan los sistemas de ficheros reales) se marca aparte.
+ */
+typedef struct {
+    dev_t dev;
+    pthread_mutex_t lock;
+    uint64_t *slots;
+    size_t cap;             // potencia de 2
+    size_t used;
+    int has_zero;
+} inode_set_t;
+
+// Un conjunto por dispositivo. Hay pocos, así que basta una lista.
+#define MAX_DEVICES 256
+static inode_set_t inode_sets[MAX_DEVICES];
+static atomic_int ninode_sets;
+static pthread_mutex_t inode_sets_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Mezcla de bits (finalizador de splitmix64): los números de inodo suelen
+// ser consecutivos y sin mezclar se agruparían en la tabla.
+static inline uint64_t hash_ino(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static inode_set_t *inode_set_for(dev_t dev) {
+    int n = atomic_load(&ninode_sets);
+    for (int i = 0; i < n; i++)
+        if (inode_sets[i].dev == dev)
+            return &inode_sets[i];
+
+    pthread_mutex_lock(&inode_sets_lock);
+    n = atomic_load(&ninode_sets);
+    for (int i = 0; i < n; i++) {
+        if (inode_sets[i].dev == dev) {
+            pthread_mutex_unlock(&inode_sets_lock);
+            return &inode_sets[i];
+        }
+    }
+    if (n == MAX_DEVICES) {
+        fprintf(stderr, "Demasiados sistemas de ficheros distintos\n");
+        exit(EXIT_FAILURE);
+    }
+    inode_set_t *set = &inode_sets[n];
+    set->dev = dev;
+    pthread_mutex_init(&set->lock, NULL);
+    atomic_store(&ninode_sets, n + 1);  // publicar ya inicializado
+    pthread_mutex_unlock(&inode_sets_lock);
+    return set;
+}
+
+static void inode_set_grow(inode_set_t *set) {
+    size_t ncap = set->cap ? set->cap * 2 : 1024;
+    uint64_t *slots = calloc(ncap, sizeof(uint64_t));
+    if (!slots) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < set->cap; i++) {
+        uint64_t ino = set->slots[i];
+        if (ino == 0)
+            continue;
+        size_t h = hash_ino(ino) & (ncap - 1);
+        while (slots[h] != 0)
+            h = (h + 1) & (ncap - 1);
+        slots[h] = ino;
+    }
+    free(set->slots);
+    set->slots = slots;
+    set->cap = ncap;
+}
+
+/**
+ * inode_seen:
+ *   Añade (dev, ino) al conjunto. Devuelve 1 si ya estaba (el fichero ya se
+ *   contó por otro enlace) o 0 si es la primera vez.
+ */
+static int inode_seen(dev_t dev, ino_t ino) {
+    inode_set_t *set = inode_set_for(dev);
+    int seen = 0;
+
+    pthread_mutex_lock(&set->lock);
+    if (ino == 0) {
+        seen = set->has_zero;
+        set->has_zero = 1;
+    } else {
+        if ((set->used + 1) * 4 > set->cap * 3)
+            inode_set_grow(set);
+        size_t h = hash_ino(ino) & (set->cap - 1);
+        while (set->slots[h] != 0 && set->slots[h] != ino)
+            h = (h + 1) & (set->cap - 1);
+        if (set->slots[h] == ino) {
+            seen = 1;
+        } else {
+            set->slots[h] = ino;
+            set->used++;
+        }
+    }
+    pthread_mutex_unlock(&set->lock);
+    return seen;
+}
+
+// ¿Es un fichero con otros enlaces duros?
+static int is_linked(const entry_info_t *info) {
+    return !S_ISDIR(info->mode) && info->nlink > 1;
+}
+
+/**
+ * already_counted:
+ *   Indica si la entrada es un enlace duro a un inodo ya contado (y, si no
+ *   lo es, lo apunta como contado).
+ */
+static int already_counted(const entry_info_t *info) {
+    return is_linked(info) && inode_seen(info->dev, info->ino);
+}
+
+/**
+ * entry_blocks:
+ *   Bloques que aporta una entrada al total: 0 si es un enlace duro a un
+ *   inodo ya contado.
+ */
+static size_t entry_blocks(const entry_info_t *info) {
+    return already_counted(info) ? 0 : info->blocks;
+}
+
+/**
+ * skip_mount:
+ *   Con -x, indica si la entrada es un directorio de otro sistema de
+ *   ficheros (punto de montaje) que no hay que contar ni recorrer.
+ */
+static int skip_mount(const entry_info_t *info) {
+    return one_file_system && S_ISDIR(info->mode) && info->dev != root_dev;
+}
+
+static void stat_to_info(const struct stat *st, entry_info_t *info) {
+    info->mode = st->st_mode;
+    info->blocks = st->st_blocks;
+    info->size = st->st_size;
+    info->dev = st->st_dev;
+    info->ino = st->st_ino;
+    info->nlink = st->st_nlink;
+    info->mtime = st->st_mtim;
+    info->ctime = st->st_ctim;
+}
+
+/**
+ * stat_entry:
+ *   Obtiene tipo, tamaño, bloques, dispositivo, inodo, número de enlaces y
+ *   fechas de 'name' dentro del directorio 'dirfd' sin seguir enlaces. Usa
+ *   statx() con la máscara mínima y, si el kernel no lo soporta, fstatat().
+ *   Devuelve 0 o -1 (errno).
+ */
+static int stat_entry(int dirfd, const char *name, entry_info_t *info) {
+    static atomic_int no_statx;
+
+    if (!atomic_load(&no_statx)) {
+        struct statx stx;
+        if (statx(dirfd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT,
+                  STATX_TYPE | STATX_SIZE | STATX_BLOCKS | STATX_INO |
+                  STATX_NLINK | STATX_MTIME | STATX_CTIME, &stx) == 0) {
+            info->mode = stx.stx_mode;
+            info->blocks = stx.stx_blocks;
+            info->size = stx.stx_size;
+            info->dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+            info->ino = stx.stx_ino;
+            info->nlink = stx.stx_nlink;
+            info->mtime.tv_sec = stx.stx_mtime.tv_sec;
+            info->mtime.tv_nsec = stx.stx_mtime.tv_nsec;
+            info->ctime.tv_sec = stx.stx_ctime.tv_sec;
+            info->ctime.tv_nsec = stx.stx_ctime.tv_nsec;
+            return 0;
+        }
+        if (errno != ENOSYS)
+            return -1;
+        atomic_store(&no_statx, 1);
+    }
+
+    struct stat st;
+    if (fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+        return -1;
+    stat_to_info(&st, info);
+    return 0;
+}
+
+/*
+ * Informe (-t N). Un top-N es un montículo de mínimos con N huecos: la raíz
+ * es la menor de las N mayores entradas vistas hasta ahora. Los empates de
+ * tamaño se deciden por la ruta, para que el resultado no dependa del orden
+ * del recorrido (ni del número de hilos).
+ */
+typedef struct {
+    size_t blocks;
+    char *path;
+    int linked;             // fichero con varios enlaces: inodo dev/ino
+    dev_t dev;
+    ino_t ino;
+} top_item_t;
+
+typedef struct {
+    top_item_t *items;      // report_top huecos
+    size_t len;
+} top_heap_t;
+
+// Cubeta 0: valor 0; cubeta k >= 1: valores en [2^(k-1), 2^k).
+#define HIST_BUCKETS 65
+
+typedef struct {
+    uint64_t files[HIST_BUCKETS];
+    uint64_t blocks[HIST_BUCKETS];
+} histogram_t;
+
+typedef struct {
+    top_heap_t files;
+    top_heap_t dirs;
+    histogram_t size_hist;  // por tamaño aparente, en bytes
+    histogram_t age_hist;   // por antigüedad del mtime, en segundos
+} report_t;
+
+static size_t report_top;   // N de -t (0: sin informe)
+static int report_json;
+static time_t report_now;
+static report_t report;     // informe del argumento actual
+
+static void report_init(report_t *rep) {
+    memset(rep, 0, sizeof(*rep));
+    rep->files.items = calloc(report_top, sizeof(top_item_t));
+    rep->dirs.items = calloc(report_top, sizeof(top_item_t));
+    if (!rep->files.items || !rep->dirs.items) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void report_free(report_t *rep) {
+    for (size_t i = 0; i < rep->files.len; i++)
+        free(rep->files.items[i].path);
+    for (size_t i = 0; i < rep->dirs.len; i++)
+        free(rep->dirs.items[i].path);
+    free(rep->files.items);
+    free(rep->dirs.items);
+    memset(rep, 0, sizeof(*rep));
+}
+
+// ¿Va 'a' detrás de 'b' en el top-N? (menos bloques, o igual y ruta mayor)
+static inline int top_below(const top_item_t *a, const top_item_t *b) {
+    if (a->blocks != b->blocks)
+        return a->blocks < b->blocks;
+    return strcmp(a->path, b->path) > 0;
+}
+
+static void heap_sift_down(top_heap_t *h, size_t i) {
+    for (;;) {
+        size_t l = 2 * i + 1, r = l + 1, m = i;
+        if (l < h->len && top_below(&h->items[l], &h->items[m]))
+            m = l;
+        if (r < h->len && top_below(&h->items[r], &h->items[m]))
+            m = r;
+        if (m == i)
+            return;
+        top_item_t tmp = h->items[i];
+        h->items[i] = h->items[m];
+        h->items[m] = tmp;
+        i = m;
+    }
+}
+
+/**
+ * heap_insert:
+ *   Mete una entrada en el top-N, quedándose con la ruta (memoria de
+ *   malloc). Si ya estaba lleno sustituye a la menor, o libera 'path' si la
+ *   nueva no la supera. Si es otro enlace de un inodo que ya está, solo se
+ *   queda con la menor de las dos rutas.
+ */
+static void heap_insert(top_heap_t *h, top_item_t item) {
+    for (size_t i = 0; item.linked && i < h->len; i++) {
+        top_item_t *old = &h->items[i];
+        if (!old->linked || old->dev != item.dev || old->ino != item.ino)
+            continue;
+        if (strcmp(item.path, old->path) < 0) {
+            // Mismo tamaño y ruta menor: sube, se aleja de la raíz
+            free(old->path);
+            old->path = item.path;
+            heap_sift_down(h, i);
+        } else {
+            free(item.path);
+        }
+        return;
+    }
+    if (h->len < report_top) {
+        size_t i = h->len++;
+        h->items[i] = item;
+        while (i > 0) {
+            size_t p = (i - 1) / 2;
+            if (!top_below(&h->items[i], &h->items[p]))
+                break;
+            top_item_t tmp = h->items[i];
+            h->items[i] = h->items[p];
+            h->items[p] = tmp;
+            i = p;
+        }
+    } else if (top_below(&h->items[0], &item)) {
+        free(h->items[0].path);
+        h->items[0] = item;
+        heap_sift_down(h, 0);
+    } else {
+        free(item.path);
+    }
+}
+
+/**
+ * heap_offer:
+ *   Propone la entrada 'dir/name' ('name' puede ser NULL para usar 'dir'
+ *   tal cual). La ruta solo se construye si la entrada puede entrar en el
+ *   top-N (si supera o empata a la menor). 'link' es la información de un
+ *   fichero con varios enlaces, o NULL.
+ */
+static void heap_offer(top_heap_t *h, size_t blocks, const char *dir,
+                       const char *name, const entry_info_t *link) {
+    if (h->len == report_top && blocks < h->items[0].blocks)
+        return;
+    size_t dlen = strlen(dir);
+    size_t nlen = name ? strlen(name) + 1 : 0;
+    char *path = malloc(dlen + nlen + 1);
+    if (!path) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(path, dir, dlen);
+    if (name) {
+        path[dlen] = '/';
+        memcpy(path + dlen + 1, name, nlen);
+    } else {
+        path[dlen] = '\0';
+    }
+    top_item_t item = { blocks, path, link != NULL, 0, 0 };
+    if (link) {
+        item.dev = link->dev;
+        item.ino = link->ino;
+    }
+    heap_insert(h, item);
+}
+
+
+static inline int hist_bucket(uint64_t value) {
+    return value == 0 ? 0 : 64 - __builtin_clzll(value);
+}
+
+/**
+ * report_file:
+ *   Apunta en el informe un fichero (cualquier entrada que no es
+ *   directorio) ya contado, de nombre 'dir/name'.
+ */
+static void report_file(report_t *rep, const char *dir, const char *name,
+                        const entry_info_t *info) {
+    int b = hist_bucket(info->size > 0 ? (uint64_t)info->size : 0);
+    rep->size_hist.files[b]++;
+    rep->size_hist.blocks[b] += info->blocks;
+
+    time_t age = report_now - info->mtime.tv_sec;
+    b = hist_bucket(age > 0 ? (uint64_t)age : 0);
+    rep->age_hist.files[b]++;
+    rep->age_hist.blocks[b] += info->blocks;
+
+    heap_offer(&rep->files, info->blocks, dir, name,
+               is_linked(info) ? info : NULL);
+}
+
+/**
+ * report_link:
+ *   Otro enlace de un fichero ya contado: no cuenta en los histogramas,
+ *   pero su ruta puede ser la que salga en el top-N.
+ */
+static void report_link(report_t *rep, const char *dir, const char *name,
+                        const entry_info_t *info) {
+    heap_offer(&rep->files, info->blocks, dir, name, info);
+}
+
+/**
+ * report_merge:
+ *   Pasa a 'dst' el contenido de 'src' (el informe de un hilo), que queda
+ *   vacío.
+ */
+static void report_merge(report_t *dst, report_t *src) {
+    for (size_t i = 0; i < src->files.len; i++)
+        heap_insert(&dst->files, src->files.items[i]);
+    for (size_t i = 0; i < src->dirs.len; i++)
+        heap_insert(&dst->dirs, src->dirs.items[i]);
+    src->files.len = src->dirs.len = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        dst->size_hist.files[b] += src->size_hist.files[b];
+        dst->size_hist.blocks[b] += src->size_hist.blocks[b];
+        dst->age_hist.files[b] += src->age_hist.files[b];
+        dst->age_hist.blocks[b] += src->age_hist.blocks[b];
+    }
+    report_free(src);
+}
+
+// Orden de salida del top-N: de mayor a menor, y por ruta si empatan.
+static int top_cmp(const void *a, const void *b) {
+    return top_below(a, b) ? 1 : -1;
+}
+
+static void json_string(const char *s) {
+    putchar('"');
+    for (const unsigned char *p = (const unsigned char *)s; *p; p++) {
+        if (*p == '"' || *p == '\\')
+            printf("\\%c", *p);
+        else if (*p < 0x20)
+            printf("\\u%04x", *p);
+        else
+            putchar(*p);
+    }
+    putchar('"');
+}
+
+// Escribe una potencia de 2 con la mayor unidad binaria exacta (1K, 64M...).
+static void print_pow2(int shift) {
+    static const char units[] = "BKMGTPE";
+    printf("%llu%c", 1ULL << (shift % 10), units[shift / 10]);
+}
+
+// Escribe una cantidad de segundos en la mayor unidad en la que es >= 1
+// (con un decimal si es menor que 10).
+static void print_secs(uint64_t secs) {
+    static const struct { uint64_t secs; char unit; } units[] = {
+        { 86400, 'd' }, { 3600, 'h' }, { 60, 'm' }, { 1, 's' },
+    };
+    int u = 0;
+    while (secs < units[u].secs && units[u].secs > 1)
+        u++;
+    double v = (double)secs / units[u].secs;
+    printf(v < 10 && units[u].secs > 1 ? "%.1f%c" : "%.0f%c", v, units[u].unit);
+}
+
+static void print_top_text(const char *title, const top_heap_t *h) {
+    printf("  %s:\n", title);
+    for (size_t i = 0; i < h->len; i++)
+        printf("    %zuK %s\n", (h->items[i].blocks + 1) / 2, h->items[i].path);
+}
+
+static void print_hist_text(const char *title, const histogram_t *hist,
+                            int secs) {
+    printf("  %s:\n", title);
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        if (hist->files[b] == 0)
+            continue;
+        printf("    [");
+        if (b == 0)
+            printf("0");
+        else if (secs)
+            print_secs(1ULL << (b - 1));
+        else
+            print_pow2(b - 1);
+        printf(", ");
+        if (secs)
+            print_secs(b == 0 ? 1 : (b < 64 ? 1ULL << b : UINT64_MAX));
+        else if (b < 64)
+            print_pow2(b);
+        else
+            printf("16E");
+        printf("): %llu ficheros, %lluK\n",
+               (unsigned long long)hist->files[b],
+               (unsigned long long)(hist->blocks[b] + 1) / 2);
+    }
+}
+
+static void print_top_json(const char *key, const top_heap_t *h) {
+    printf(",\n    \"%s\": [", key);
+    for (size_t i = 0; i < h->len; i++) {
+        printf("%s\n      {\"path\": ", i ? "," : "");
+        json_string(h->items[i].path);
+        printf(", \"kbytes\": %zu}", (h->items[i].blocks + 1) / 2);
+    }
+    printf("%s]", h->len ? "\n    " : "");
+}
+
+static void print_hist_json(const char *key, const char *unit,
+                            const histogram_t *hist) {
+    printf(",\n    \"%s\": [", key);
+    int first = 1;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        if (hist->files[b] == 0)
+            continue;
+        unsigned long long lo = b == 0 ? 0 : 1ULL << (b - 1);
+        unsigned long long hi = b == 0 ? 1 : (b < 64 ? 1ULL << b : UINT64_MAX);
+        printf("%s\n      {\"min_%s\": %llu, \"max_%s\": %llu, "
+               "\"files\": %llu, \"kbytes\": %llu}",
+               first ? "" : ",", unit, lo, unit, hi,
+               (unsigned long long)hist->files[b],
+               (unsigned long long)(hist->blocks[b] + 1) / 2);
+        first = 0;
+    }
+    printf("%s]", first ? "" : "\n    ");
+}
+
+/**
+ * print_result:
+ *   Escribe el total de un argumento y, con -t, su informe (los top-N se
+ *   ordenan aquí, lo que deshace los montículos).
+ */
+static void print_result(const char *path, size_t blocks, int first) {
+    size_t kbytes = (blocks + 1) / 2;
+    if (report_top) {
+        qsort(report.files.items, report.files.len, sizeof(top_item_t), top_cmp);
+        qsort(report.dirs.items, report.dirs.len, sizeof(top_item_t), top_cmp);
+    }
+
+    if (!report_json) {
+        printf("%zuK %s\n", kbytes, path);
+        if (report_top) {
+            print_top_text("Ficheros más grandes", &report.files);
+            print_top_text("Directorios más grandes", &report.dirs);
+            print_hist_text("Ficheros por tamaño", &report.size_hist, 0);
+            print_hist_text("Ficheros por antigüedad", &report.age_hist, 1);
+        }
+        return;
+    }
+
+    printf("%s\n  {\n    \"path\": ", first ? "" : ",");
+    json_string(path);
+    printf(",\n    \"kbytes\": %zu", kbytes);
+    if (report_top) {
+        print_top_json("top_files", &report.files);
+        print_top_json("top_dirs", &report.dirs);
+        print_hist_json("size_histogram", "bytes", &report.size_hist);
+        print_hist_json("age_histogram", "seconds", &report.age_hist);
+    }
+    printf("\n  }");
+}
+
+/*
+ * Registro de la caché para un directorio. En el fichero, cada registro va
+ * seguido de 'nlinked' cache_link_t y de 'names_len' bytes con los nombres
+ * de los subdirectorios (cada uno terminado en '\0'), y se rellena hasta
+ * múltiplo de 8 bytes para que el siguiente quede alineado.
+ */
+typedef struct {
+    uint64_t dev;
+    uint64_t ino;
+    int64_t  mtime_sec;
+    int64_t  ctime_sec;
+    uint32_t mtime_nsec;
+    uint32_t ctime_nsec;
+    int64_t  cached_at;     // time() en que se recorrió el directorio
+    uint64_t own_blocks;    // bloques de sus ficheros con un solo enlace
+    uint32_t nlinked;
+    uint32_t names_len;
+} cache_rec_t;
+
+// Fichero con varios enlaces dentro de un directorio cacheado.
+typedef struct {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t blocks;
+} cache_link_t;
+
+#define CACHE_MAGIC "ESPCACH1"
+
+// Estado de la caché.
+//   data/size:  contenido leído del fichero
+//   recs/nrecs: desplazamiento de cada registro dentro de 'data'
+//   index:      tabla hash (dev, ino) -> número de registro + 1
+//   touched:    registros que se han vuelto a emitir en esta ejecución
+//   out:        registros a escribir (nuevos o reutilizados), con su mutex
+static struct {
+    const char *path;
+    int refresh;
+    long long max_age;      // < 0: sin límite
+    time_t now;
+
+    char *data;
+    size_t size;
+    size_t *recs;
+    size_t nrecs;
+    size_t *index;
+    size_t index_cap;
+    atomic_uchar *touched;
+
+    pthread_mutex_t lock;
+    char *out;
+    size_t out_len, out_cap;
+} cache = {
+    .max_age = -1,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static inline size_t rec_size(const cache_rec_t *rec) {
+    size_t len = sizeof(cache_rec_t) + rec->nlinked * sizeof(cache_link_t) +
+                 rec->names_len;
+    return (len + 7) & ~(size_t)7;
+}
+
+static inline size_t cache_slot(uint64_t dev, uint64_t ino) {
+    return hash_ino(ino ^ hash_ino(dev)) & (cache.index_cap - 1);
+}
+
+/**
+ * cache_load:
+ *   Lee el fichero de caché e indexa sus registros. Si no existe empieza
+ *   vacía; si está corrupto se descarta a partir del primer registro malo.
+ */
+static void cache_load(void) {
+    FILE *fp = fopen(cache.path, "rb");
+    if (!fp) {
+        if (errno != ENOENT)
+            fprintf(stderr, "Aviso: no se pudo leer la caché '%s': %s\n",
+                    cache.path, strerror(errno));
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fileno(fp), &st) == 0 && st.st_size > 0) {
+        cache.data = malloc(st.st_size);
+        if (!cache.data) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        cache.size = fread(cache.data, 1, st.st_size, fp);
+    }
+    fclose(fp);
+
+    size_t magic_len = sizeof(CACHE_MAGIC) - 1;
+    if (cache.size < magic_len ||
+        memcmp(cache.data, CACHE_MAGIC, magic_len) != 0) {
+        if (cache.size > 0)
+            fprintf(stderr, "Aviso: '%s' no es una caché de espacio; "
+                    "se ignora\n", cache.path);
+        cache.size = 0;
+        return;
+    }
+
+    // Primera pasada: localizar los registros válidos.
+    size_t cap = 1024;
+    cache.recs = malloc(cap * sizeof(size_t));
+    if (!cache.recs) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    size_t off = (magic_len + 7) & ~(size_t)7;
+    while (off + sizeof(cache_rec_t) <= cache.size) {
+        const cache_rec_t *rec = (const cache_rec_t *)(cache.data + off);
+        size_t len = rec_size(rec);
+        size_t names_end = off + sizeof(cache_rec_t) +
+                           rec->nlinked * sizeof(cache_link_t) + rec->names_len;
+        if (rec->nlinked > cache.size || rec->names_len > cache.size ||
+            off + len > cache.size ||
+            (rec->names_len > 0 && cache.data[names_end - 1] != '\0')) {
+            fprintf(stderr, "Aviso: caché '%s' dañada; se ignora el resto\n",
+                    cache.path);
+            break;
+        }
+        if (cache.nrecs == cap) {
+            cap *= 2;
+            cache.recs = realloc(cache.recs, cap * sizeof(size_t));
+            if (!cache.recs) {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+        cache.recs[cache.nrecs++] = off;
+        off += len;
+    }
+
+    // Segunda pasada: índice hash. Si un directorio aparece varias veces
+    // gana el último registro; los anteriores se marcan para no guardarlos.
+    cache.index_cap = 1024;
+    while (cache.index_cap < cache.nrecs * 2)
+        cache.index_cap *= 2;
+    cache.index = calloc(cache.index_cap, sizeof(size_t));
+    cache.touched = calloc(cache.nrecs ? cache.nrecs : 1, 1);
+    if (!cache.index || !cache.touched) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < cache.nrecs; i++) {
+        const cache_rec_t *rec = (const cache_rec_t *)(cache.data + cache.recs[i]);
+        size_t h = cache_slot(rec->dev, rec->ino);
+        while (cache.index[h] != 0) {
+            const cache_rec_t *other =
+                (const cache_rec_t *)(cache.data + cache.recs[cache.index[h] - 1]);
+            if (other->dev == rec->dev && other->ino == rec->ino) {
+                atomic_store(&cache.touched[cache.index[h] - 1], 1);
+                break;
+            }
+            h = (h + 1) & (cache.index_cap - 1);
+        }
+        cache.index[h] = i + 1;
+    }
+}
+
+/**
+ * cache_lookup:
+ *   Devuelve el registro del directorio 'dir' si existe, no ha caducado y su
+ *   mtime/ctime coinciden con los actuales; NULL en otro caso (también con
+ *   --refresh o -t). Si existe lo marca como visto aunque no se use: o se
+ *   reutiliza o el recorrido emite uno nuevo, y el viejo no debe guardarse.
+ */
+static const cache_rec_t *cache_lookup(const entry_info_t *dir) {
+    if (!cache.path || cache.nrecs == 0)
+        return NULL;
+
+    size_t h = cache_slot(dir->dev, dir->ino);
+    while (cache.index[h] != 0) {
+        size_t i = cache.index[h] - 1;
+        const cache_rec_t *rec = (const cache_rec_t *)(cache.data + cache.recs[i]);
+        if (rec->dev == dir->dev && rec->ino == dir->ino) {
+            atomic_store(&cache.touched[i], 1);
+            if (cache.refresh || report_top)
+                return NULL;
+            if (rec->mtime_sec != dir->mtime.tv_sec ||
+                rec->mtime_nsec != (uint32_t)dir->mtime.tv_nsec ||
+                rec->ctime_sec != dir->ctime.tv_sec ||
+                rec->ctime_nsec != (uint32_t)dir->ctime.tv_nsec)
+                return NULL;
+            if (cache.max_age >= 0 && cache.now - rec->cached_at > cache.max_age)
+                return NULL;
+            return rec;
+        }
+        h = (h + 1) & (cache.index_cap - 1);
+    }
+    return NULL;
+}
+
+/**
+ * cache_emit:
+ *   Añade un registro (cabecera, enlaces y nombres) a la salida.
+ */
+static void cache_emit(const cache_rec_t *rec, const cache_link_t *links,
+                       const char *names) {
+    size_t len = rec_size(rec);
+    size_t links_len = rec->nlinked * sizeof(cache_link_t);
+
+    pthread_mutex_lock(&cache.lock);
+    if (cache.out_len + len > cache.out_cap) {
+        size_t ncap = cache.out_cap ? cache.out_cap : 64 * 1024;
+        while (cache.out_len + len > ncap)
+            ncap *= 2;
+        cache.out = realloc(cache.out, ncap);
+        if (!cache.out) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        cache.out_cap = ncap;
+    }
+    char *p = cache.out + cache.out_len;
+    memcpy(p, rec, sizeof(*rec));
+    memcpy(p + sizeof(*rec), links, links_len);
+    memcpy(p + sizeof(*rec) + links_len, names, rec->names_len);
+    memset(p + sizeof(*rec) + links_len + rec->names_len, 0,
+           len - sizeof(*rec) - links_len - rec->names_len);
+    cache.out_len += len;
+    pthread_mutex_unlock(&cache.lock);
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * cache_save:
+ *   Escribe la caché nueva: los registros emitidos en esta ejecución más los
+ *   de la caché anterior que no se han visitado (otros árboles) y no han
+ *   caducado. Se escribe en un temporal y se renombra encima.
+ */
+static void cache_save(void) {
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp.%d", cache.path, (int)getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        fprintf(stderr, "Aviso: no se pudo escribir la caché '%s': %s\n",
+                tmp, strerror(errno));
+        return;
+    }
+
+    char header[8] = { 0 };
+    memcpy(header, CACHE_MAGIC, sizeof(CACHE_MAGIC) - 1);
+    int rc = write_all(fd, header, sizeof(header));
+    if (rc == 0)
+        rc = write_all(fd, cache.out, cache.out_len);
+    for (size_t i = 0; rc == 0 && i < cache.nrecs; i++) {
+        const cache_rec_t *rec = (const cache_rec_t *)(cache.data + cache.recs[i]);
+        if (atomic_load(&cache.touched[i]))
+            continue;
+        if (cache.max_age >= 0 && cache.now - rec->cached_at > cache.max_age)
+            continue;
+        rc = write_all(fd, (const char *)rec, rec_size(rec));
+    }
+    if (close(fd) != 0)
+        rc = -1;
+    if (rc != 0 || rename(tmp, cache.path) != 0) {
+        fprintf(stderr, "Aviso: no se pudo escribir la caché '%s': %s\n",
+                cache.path, strerror(errno));
+        unlink(tmp);
+    }
+}
+
+// Vector dinámico de bytes para construir un registro mientras se recorre.
+typedef struct {
+    char *buf;
+    size_t len, cap;
+} bytes_t;
+
+static void bytes_add(bytes_t *b, const void *data, size_t len) {
+    if (b->len + len > b->cap) {
+        size_t ncap = b->cap ? b->cap : 256;
+        while (b->len + len > ncap)
+            ncap *= 2;
+        b->buf = realloc(b->buf, ncap);
+        if (!b->buf) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        b->cap = ncap;
+    }
+    memcpy(b->buf + b->len, data, len);
+    b->len += len;
+}
+
+static void fill_rec_key(cache_rec_t *rec, const entry_info_t *dir) {
+    rec->dev = dir->dev;
+    rec->ino = dir->ino;
+    rec->mtime_sec = dir->mtime.tv_sec;
+    rec->mtime_nsec = dir->mtime.tv_nsec;
+    rec->ctime_sec = dir->ctime.tv_sec;
+    rec->ctime_nsec = dir->ctime.tv_nsec;
+}
+
+/*
+ * Recorrido de las entradas de un directorio abierto, parándose en cada
+ * subdirectorio: scan_next() suma los bloques de las entradas y devuelve el
+ * siguiente subdirectorio que hay que recorrer (ya contados sus propios
+ * bloques). El recorrido secuencial baja en él y luego sigue donde se
+ * quedó; el paralelo lo encola. El estado no depende de la pila de C, así
+ * que el descriptor del directorio se puede cerrar entre dos llamadas y
+ * volver a abrir (scan_suspend() / scan_resume()).
+ */
+typedef struct {
+    int dirfd;
+    entry_info_t self;
+    size_t *blocks;
+    report_t *rep;          // NULL sin -t
+
+    // Si se usa un registro de la caché: sus subdirectorios, ya con stat.
+    const cache_rec_t *cached;
+    entry_info_t *subs;
+    const char *next_name, *names_end;
+    size_t k;
+
+    // Si se leen las entradas: lectura y registro nuevo para la caché.
+    dir_reader_t r;
+    cache_rec_t rec;
+    bytes_t links, names;
+} dir_scan_t;
+
+/**
+ * scan_cached_begin:
+ *   Intenta resolver el directorio con su registro de la caché. Primero hace
+ *   stat de todos los subdirectorios cacheados; si alguno ya no es un
+ *   directorio se abandona (devuelve 0) sin haber sumado nada y hay que leer
+ *   las entradas. Si no, suma los bloques de sus ficheros y devuelve 1.
+ */
+static int scan_cached_begin(dir_scan_t *sc, const cache_rec_t *rec) {
+    const cache_link_t *links = (const cache_link_t *)(rec + 1);
+    const char *names = (const char *)(links + rec->nlinked);
+    const char *end = names + rec->names_len;
+
+    size_t nsub = 0;
+    for (const char *n = names; n < end; n += strlen(n) + 1)
+        nsub++;
+    entry_info_t *subs = malloc((nsub ? nsub : 1) * sizeof(entry_info_t));
+    if (!subs) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    size_t k = 0;
+    for (const char *n = names; n < end; n += strlen(n) + 1, k++) {
+        if (stat_entry(sc->dirfd, n, &subs[k]) != 0 || !S_ISDIR(subs[k].mode)) {
+            free(subs);
+            return 0;
+        }
+    }
+
+    *sc->blocks += rec->own_blocks;
+    for (uint32_t i = 0; i < rec->nlinked; i++)
+        if (!inode_seen(links[i].dev, links[i].ino))
+            *sc->blocks += links[i].blocks;
+
+    sc->cached = rec;
+    sc->subs = subs;
+    sc->next_name = names;
+    sc->names_end = end;
+    return 1;
+}
+
+/**
+ * scan_begin:
+ *   Prepara el recorrido del directorio abierto 'dirfd' (descrito por
+ *   'self'). Los bloques se suman a *blocks y los ficheros se apuntan en
+ *   'rep'. 'dirbuf' es el buffer de getdents64(). Usa la caché si es válida
+ *   para este directorio.
+ */
+static void scan_begin(dir_scan_t *sc, int dirfd, const entry_info_t *self,
+                       size_t *blocks, report_t *rep, char *dirbuf) {
+    memset(sc, 0, sizeof(*sc));
+    sc->dirfd = dirfd;
+    sc->self = *self;
+    sc->blocks = blocks;
+    sc->rep = rep;
+    sc->r.fd = dirfd;
+    sc->r.buf = dirbuf;
+    sc->rec.cached_at = cache.now;
+
+    const cache_rec_t *cached = cache_lookup(self);
+    if (cached)
+        scan_cached_begin(sc, cached);
+}
+
+/**
+ * scan_next:
+ *   Avanza hasta el siguiente subdirectorio que hay que recorrer y lo
+ *   devuelve en *name (válido hasta la siguiente llamada) e *info. 'path' es
+ *   la ruta del directorio, para el informe (solo hace falta con -t).
+ *   Devuelve 1 si hay subdirectorio, 0 al terminar o -1 en error (con
+ *   errno, y en *name la entrada que falló o NULL si falló la lectura del
+ *   propio directorio; el mensaje lo imprime el llamante con scan_error()).
+ */
+static int scan_next(dir_scan_t *sc, const char *path, const char **name,
+                     entry_info_t *info) {
+    if (sc->cached) {
+        while (sc->next_name < sc->names_end) {
+            const char *n = sc->next_name;
+            const entry_info_t *sub = &sc->subs[sc->k++];
+            sc->next_name += strlen(n) + 1;
+            if (skip_mount(sub))
+                continue;
+            *sc->blocks += entry_blocks(sub);
+            *name = n;
+            *info = *sub;
+            return 1;
+        }
+        return 0;
+    }
+
+    struct linux_dirent64 *d;
+    while ((d = next_entry(&sc->r)) != NULL) {
+        if (stat_entry(sc->dirfd, d->d_name, info) != 0) {
+            *name = d->d_name;
+            return -1;
+        }
+
+        // Lo que hace falta para la caché: los subdirectorios se guardan
+        // aunque estén en otro sistema de ficheros (-x se aplica al usarla).
+        if (cache.path) {
+            if (S_ISDIR(info->mode)) {
+                bytes_add(&sc->names, d->d_name, strlen(d->d_name) + 1);
+            } else if (info->nlink > 1) {
+                cache_link_t link = { info->dev, info->ino, info->blocks };
+                bytes_add(&sc->links, &link, sizeof(link));
+            } else {
+                sc->rec.own_blocks += info->blocks;
+            }
+        }
+
+        if (skip_mount(info))
+            continue;
+
+        // Acumular bloques del propio fichero o enlace
+        if (already_counted(info)) {
+            if (sc->rep)
+                report_link(sc->rep, path, d->d_name, info);
+            continue;
+        }
+        *sc->blocks += info->blocks;
+
+        if (S_ISDIR(info->mode)) {
+            *name = d->d_name;
+            return 1;
+        }
+        if (sc->rep)
+            report_file(sc->rep, path, d->d_name, info);
+    }
+    if (errno != 0) {
+        *name = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+// Mensaje de un error de scan_next() en el directorio 'path' (errno intacto)
+static void scan_error(const char *path, const char *name) {
+    if (name)
+        fprintf(stderr, "Error en lstat('%s/%s'): %s\n",
+                path, name, strerror(errno));
+    else
+        fprintf(stderr, "Error leyendo directorio '%s': %s\n",
+                path, strerror(errno));
+}
+
+/**
+ * scan_end:
+ *   Termina el recorrido de un directorio. Si ha ido bien ('ok') y la caché
+ *   está activa, emite su registro (el reutilizado o el nuevo). No cierra
+ *   el descriptor.
+ */
+static void scan_end(dir_scan_t *sc, int ok) {
+    if (ok && cache.path) {
+        if (sc->cached) {
+            const cache_link_t *links = (const cache_link_t *)(sc->cached + 1);
+            cache_emit(sc->cached, links,
+                       (const char *)(links + sc->cached->nlinked));
+        } else {
+            fill_rec_key(&sc->rec, &sc->self);
+            sc->rec.nlinked = sc->links.len / sizeof(cache_link_t);
+            sc->rec.names_len = sc->names.len;
+            cache_emit(&sc->rec, (const cache_link_t *)sc->links.buf,
+                       sc->names.buf);
+        }
+    }
+    free(sc->subs);
+    free(sc->links.buf);
+    free(sc->names.buf);
+}
+
+/**
+ * scan_suspend:
+ *   Suelta el descriptor y el buffer de un recorrido a medias (el llamante
+ *   cierra el descriptor y recupera el buffer). Lo que quedaba en el buffer
+ *   se volverá a leer: basta con recordar la posición (d_off) de la última
+ *   entrada consumida.
+ */
+static void scan_suspend(dir_scan_t *sc) {
+    sc->dirfd = sc->r.fd = -1;
+    sc->r.buf = NULL;
+    sc->r.len = sc->r.pos = 0;
+}
+
+/**
+ * scan_resume:
+ *   Continúa un recorrido suspendido con el directorio abierto de nuevo en
+ *   'dirfd', volviendo con lseek() (como seekdir()) a la posición de la
+ *   última entrada consumida. Devuelve 0 o -1 (errno).
+ */
+static int scan_resume(dir_scan_t *sc, int dirfd, char *dirbuf) {
+    if (lseek(dirfd, sc->r.off, SEEK_SET) == -1)
+        return -1;
+    sc->dirfd = sc->r.fd = dirfd;
+    sc->r.buf = dirbuf;
+    return 0;
+}
+
+/**
+ * open_subdir:
+ *   Abre el subdirectorio 'name' de 'dirfd' para leer sus entradas.
+ *   O_NOFOLLOW evita seguir un enlace si la entrada cambió tras el stat.
+ */
+static int open_subdir(int dirfd, const char *name) {
+    return openat(dirfd, name,
+                  O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+}
+
+// ¿Es 'fd' el directorio descrito por 'info'?
+static int same_dir(int fd, const entry_info_t *info) {
+    struct stat st;
+    return fstat(fd, &st) == 0 && st.st_dev == info->dev &&
+           st.st_ino == info->ino;
+}
+
+/*
+ * Recorrido secuencial con pila explícita: un marco por nivel, en un array
+ * que crece en el heap, así que la profundidad no está limitada por la pila
+ * de C ni por PATH_MAX (los directorios se abren con openat() nombre a
+ * nombre). Como mucho 'fd_budget' marcos tienen el descriptor abierto (y un
+ * buffer de getdents64()): al bajar con el presupuesto agotado se suspende
+ * el marco abierto menos profundo. Los abiertos son siempre los de abajo
+ * de la pila, y al volver a un marco suspendido se reabre con
+ * openat(hijo, "..") (comprobando dev/ino); si no coincide, porque algo se
+ * ha movido, se reabre por nombre desde la raíz.
+ */
+typedef struct {
+    dir_scan_t sc;
+    char *name;             // nombre dentro del padre (NULL en la raíz)
+    size_t pathlen;         // longitud de la ruta de este directorio
+    size_t before;          // *blocks al entrar, para su total
+} frame_t;
+
+#define DEFAULT_FD_BUDGET 64
+static size_t fd_budget = DEFAULT_FD_BUDGET;
+
+typedef struct {
+    frame_t *frames;
+    size_t depth, cap;
+    size_t first_open;      // los marcos por debajo están suspendidos
+    char **spare;           // buffers de getdents64() libres
+    size_t nspare;
+    char *path;             // ruta actual (mensajes e informe)
+    size_t pathcap;
+    const char *root;       // ruta del argumento, para reabrir la raíz
+    size_t *blocks;
+    report_t *rep;          // NULL sin -t
+} serial_walk_t;
+
+static char *get_dirbuf(serial_walk_t *sw) {
+    if (sw->nspare > 0)
+        return sw->spare[--sw->nspare];
+    char *buf = malloc(DIRBUF_SIZE);
+    if (!buf) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    return buf;
+}
+
+// Caben fd_budget + 1 buffers: los de los marcos abiertos y el del que se
+// reabre antes de cerrar el hijo.
+static void put_dirbuf(serial_walk_t *sw, char *buf) {
+    sw->spare[sw->nspare++] = buf;
+}
+
+// Deja en sw->path la ruta del directorio padre de longitud 'len' más
+// "/name" y devuelve la longitud nueva.
+static size_t path_push(serial_walk_t *sw, size_t len, const char *name) {
+    size_t nlen = strlen(name);
+    if (len + nlen + 2 > sw->pathcap) {
+        while (len + nlen + 2 > sw->pathcap)
+            sw->pathcap *= 2;
+        sw->path = realloc(sw->path, sw->pathcap);
+        if (!sw->path) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    sw->path[len] = '/';
+    memcpy(sw->path + len + 1, name, nlen + 1);
+    return len + 1 + nlen;
+}
+
+// Suspende el marco abierto menos profundo.
+static void suspend_oldest(serial_walk_t *sw) {
+    frame_t *old = &sw->frames[sw->first_open++];
+    close(old->sc.dirfd);
+    put_dirbuf(sw, old->sc.r.buf);
+    scan_suspend(&old->sc);
+}
+
+/**
+ * push_frame:
+ *   Empieza el recorrido del directorio ya abierto 'fd' ('name' dentro del
+ *   directorio de arriba de la pila, o la raíz si la pila está vacía). Si
+ *   con él se pasa del presupuesto de descriptores, suspende el marco
+ *   abierto menos profundo.
+ */
+static void push_frame(serial_walk_t *sw, int fd, const char *name,
+                       size_t pathlen, const entry_info_t *info) {
+    if (sw->depth == sw->cap) {
+        sw->cap = sw->cap ? sw->cap * 2 : 64;
+        sw->frames = realloc(sw->frames, sw->cap * sizeof(frame_t));
+        if (!sw->frames) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    frame_t *f = &sw->frames[sw->depth++];
+    f->name = name ? strdup(name) : NULL;
+    if (name && !f->name) {
+        perror("strdup");
+        exit(EXIT_FAILURE);
+    }
+    f->pathlen = pathlen;
+    f->before = *sw->blocks;
+    scan_begin(&f->sc, fd, info, sw->blocks, sw->rep, get_dirbuf(sw));
+
+    if (sw->depth - sw->first_open > fd_budget)
+        suspend_oldest(sw);
+}
+
+/**
+ * reopen_by_name:
+ *   Abre el directorio del marco 'i' bajando nombre a nombre desde la
+ *   raíz, comprobando en cada nivel que es el mismo directorio que se
+ *   recorría. Devuelve el descriptor o -1.
+ */
+static int reopen_by_name(serial_walk_t *sw, size_t i) {
+    int fd = open(sw->root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd != -1 && !same_dir(fd, &sw->frames[0].sc.self)) {
+        close(fd);
+        errno = ESTALE;
+        return -1;
+    }
+    for (size_t j = 1; fd != -1 && j <= i; j++) {
+        int sub = open_subdir(fd, sw->frames[j].name);
+        close(fd);
+        fd = sub;
+        if (fd != -1 && !same_dir(fd, &sw->frames[j].sc.self)) {
+            close(fd);
+            errno = ESTALE;
+            fd = -1;
+        }
+    }
+    return fd;
+}
+
+/**
+ * pop_frame:
+ *   Termina el marco de arriba ('ok': sin errores), apunta su total en el
+ *   informe y lo quita de la pila. Si el nuevo marco de arriba estaba
+ *   suspendido lo reabre, antes de cerrar el hijo para poder usar "..".
+ *   Devuelve 0 o -1 si no se pudo reabrir (mensaje impreso).
+ */
+static int pop_frame(serial_walk_t *sw, int ok) {
+    frame_t *f = &sw->frames[sw->depth - 1];
+    int rc = 0;
+
+    scan_end(&f->sc, ok);
+    if (ok && sw->rep) {
+        sw->path[f->pathlen] = '\0';
+        heap_offer(&sw->rep->dirs, f->sc.self.blocks + *sw->blocks - f->before,
+                   sw->path, NULL, NULL);
+    }
+
+    if (ok && sw->depth >= 2 && sw->first_open == sw->depth - 1) {
+        size_t i = sw->depth - 2;
+        frame_t *parent = &sw->frames[i];
+        int fd = openat(f->sc.dirfd, "..", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd != -1 && !same_dir(fd, &parent->sc.self)) {
+            close(fd);
+            fd = -1;
+        }
+        if (fd == -1)
+            fd = reopen_by_name(sw, i);
+        char *buf = get_dirbuf(sw);
+        if (fd == -1 || scan_resume(&parent->sc, fd, buf) != 0) {
+            sw->path[parent->pathlen] = '\0';
+            fprintf(stderr, "Error volviendo a abrir el directorio '%s': %s\n",
+                    sw->path, strerror(errno));
+            if (fd != -1)
+                close(fd);
+            put_dirbuf(sw, buf);
+            rc = -1;
+        } else {
+            sw->first_open = i;
+        }
+    }
+
+    if (f->sc.dirfd != -1) {
+        close(f->sc.dirfd);
+        put_dirbuf(sw, f->sc.r.buf);
+    }
+    free(f->name);
+    sw->depth--;
+    if (sw->first_open > sw->depth)
+        sw->first_open = sw->depth;
+    return rc;
+}
 
 /**
  * get_size_dir:
  *   Añade a *blocks el número de bloques de 512 B de todos los ficheros
- *   contenidos recursivamente en el directorio 'dirpath'.
- *   Incluye los bloques del propio directorio.
+ *   contenidos recursivamente en el directorio 'dirpath', con el recorrido
+ *   secuencial de pila explícita.
+ *   No incluye los bloques del propio directorio (los suma get_size()).
  *
  * Parámetros:
  *   dirpath: ruta al directorio
+ *   self:    datos de stat del directorio (para la caché)
  *   blocks:  puntero al acumulador de bloques (se suman aquí)
  *
  * Retorno:
  *   0 en éxito, -1 en error (mensaje impreso con perror o fprintf).
  */
-int get_size_dir(const char *dirpath, size_t *blocks) {
-    DIR *dir = opendir(dirpath);
-    if (!dir) {
+int get_size_dir(const char *dirpath, const entry_info_t *self,
+                 size_t *blocks) {
+    int fd = open(dirpath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
         fprintf(stderr, "Error abriendo directorio '%s': %s\n",
                 dirpath, strerror(errno));
         return -1;
     }
 
-    struct dirent *entry;
-    char path[PATH_MAX];
+    serial_walk_t sw = {
+        .root = dirpath,
+        .blocks = blocks,
+        .rep = report_top ? &report : NULL,
+    };
+    sw.spare = malloc((fd_budget + 1) * sizeof(char *));
+    sw.pathcap = PATH_MAX;
+    while (sw.pathcap <= strlen(dirpath))
+        sw.pathcap *= 2;
+    sw.path = malloc(sw.pathcap);
+    if (!sw.spare || !sw.path) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    strcpy(sw.path, dirpath);
+    push_frame(&sw, fd, NULL, strlen(dirpath), self);
 
-    // Recorremos cada entrada del directorio
-    while ((entry = readdir(dir)) != NULL) {
-        const char *name = entry->d_name;
-        // Ignorar "." y ".." para evitar recursión infinita
-        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
-            continue;
+    int rc = 0;
+    while (sw.depth > 0) {
+        frame_t *f = &sw.frames[sw.depth - 1];
+        const char *name;
+        entry_info_t info;
 
-        // Construir ruta completa: dirpath + '/' + name
-        snprintf(path, sizeof(path), "%s/%s", dirpath, name);
+        sw.path[f->pathlen] = '\0';
+        int r = scan_next(&f->sc, sw.path, &name, &info);
+        if (r < 0) {
+            scan_error(sw.path, name);
+            rc = -1;
+            break;
+        }
+        if (r == 0) {
+            if (pop_frame(&sw, 1) != 0) {
+                rc = -1;
+                break;
+            }
+            continue;
+        }
 
-        // Obtener tamaño de esta ruta (file o subdirectorio)
-        struct stat st;
-        if (lstat(path, &st) != 0) {
-            fprintf(stderr, "Error en lstat('%s'): %s\n",
-                    path, strerror(errno));
-            closedir(dir);
-            return -1;
+        // Si el proceso se queda sin descriptores (RLIMIT_NOFILE por debajo
+        // del presupuesto), se suspenden más marcos y se reintenta.
+        size_t len = path_push(&sw, f->pathlen, name);
+        int subfd;
+        while ((subfd = open_subdir(f->sc.dirfd, name)) == -1 &&
+               errno == EMFILE && sw.first_open < sw.depth - 1)
+            suspend_oldest(&sw);
+        if (subfd == -1) {
+            fprintf(stderr, "Error abriendo directorio '%s': %s\n",
+                    sw.path, strerror(errno));
+            rc = -1;
+            break;
         }
+        push_frame(&sw, subfd, name, len, &info);
+    }
 
-        // Acumular bloques del propio fichero o enlace
-        *blocks += st.st_blocks;
+    // En error, deshacer la pila sin guardar nada en la caché.
+    while (sw.depth > 0)
+        pop_frame(&sw, 0);
 
-        // Si es un subdirectorio, recursión
-        if (S_ISDIR(st.st_mode)) {
-            if (get_size_dir(path, blocks) != 0) {
-                closedir(dir);
-                return -1;
-            }
+    for (size_t i = 0; i < sw.nspare; i++)
+        free(sw.spare[i]);
+    free(sw.spare);
+    free(sw.frames);
+    free(sw.path);
+    return rc;
+}
+
+/*
+ * Cola doble de directorios pendientes de un hilo. El dueño mete y saca por
+ * el final; los demás hilos roban por la cabeza. La protege su propio mutex;
+ * 'size' es atómico para poder consultarlo sin cogerlo.
+ */
+/*
+ * Con -t, cada directorio aún no terminado tiene un nodo con el total de su
+ * subárbol acumulado hasta ahora y cuántas cosas le faltan: su propio
+ * recorrido más cada subdirectorio sin terminar. Quien deja 'pending' a 0
+ * apunta el total en el informe y se lo suma al padre.
+ */
+typedef struct dir_node {
+    struct dir_node *parent;
+    atomic_size_t blocks;
+    atomic_long pending;
+    char path[];
+} dir_node_t;
+
+/*
+ * Directorio ya abierto cuyos subdirectorios pueden estar aún en las colas.
+ * Los subdirectorios se abren con openat() relativo a su descriptor, así
+ * que no se construye ni se resuelve ninguna ruta desde la raíz, sea cual
+ * sea la profundidad.
+ *
+ * 'opens' cuenta quién puede necesitar 'fd': el recorrido del propio
+ * directorio, cada subdirectorio encolado aún sin abrir y cada
+ * subdirectorio que se quedó sin descriptor; el último lo cierra. 'refs'
+ * mantiene viva la estructura mientras quede algo de su subárbol, porque
+ * la cadena de nombres hace falta para los mensajes de error.
+ *
+ * Como mucho --fd-budget directorios guardan su descriptor a la vez. El que
+ * no cabe se queda con fd = -1 y retiene el de su padre (un uso más en
+ * 'opens'); para abrir sus subdirectorios se reabre con openat() nombre a
+ * nombre desde el antepasado más cercano con descriptor, que por eso no se
+ * puede cerrar mientras tanto.
+ */
+typedef struct dir_ref {
+    struct dir_ref *parent;     // NULL en la raíz
+    atomic_long refs;
+    atomic_long opens;
+    int fd;                     // -1 si no cupo en el presupuesto
+    dev_t dev;                  // para comprobar al reabrir
+    ino_t ino;
+    char name[];                // nombre en el padre; en la raíz, su ruta
+} dir_ref_t;
+
+// Directorio pendiente: sus datos de stat (para la caché), su nodo (solo
+// con -t), el directorio que lo contiene (con un uso de su descriptor y
+// una referencia) y su nombre en él.
+typedef struct {
+    entry_info_t info;
+    dir_node_t *node;
+    dir_ref_t *parent;          // NULL en la raíz: 'name' es la ruta
+    char name[];
+} dir_task_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    dir_task_t **items;     // buffer circular de tareas (reservadas con malloc)
+    size_t cap;
+    size_t head;            // posición del elemento más antiguo
+    atomic_size_t size;
+} dir_deque_t;
+
+// Estado de cada hilo del recorrido paralelo.
+typedef struct {
+    int id;
+    pthread_t tid;
+    dir_deque_t dq;
+    size_t blocks;          // bloques contados por este hilo
+    char *dirbuf;           // buffer de getdents64() de este hilo
+    report_t rep;           // informe de este hilo (con -t)
+} walker_t;
+
+// Estado compartido del recorrido paralelo de un argumento.
+//   pending: directorios descubiertos y aún no terminados; al llegar a 0 el
+//            recorrido ha acabado
+//   idle:    hilos dormidos esperando trabajo
+//   failed:  algún hilo encontró un error; el resto deja de recorrer
+//   open_refs: directorios que guardan su descriptor (dir_ref_t)
+//   budget:  máximo de open_refs (ver parallel_budget())
+static struct {
+    walker_t *walkers;
+    int nwalkers;
+    atomic_long pending;
+    atomic_long open_refs;
+    long budget;
+    atomic_int idle;
+    atomic_int failed;
+    pthread_mutex_t idle_mutex;
+    pthread_cond_t idle_cond;
+} walk = {
+    .idle_mutex = PTHREAD_MUTEX_INITIALIZER,
+    .idle_cond  = PTHREAD_COND_INITIALIZER,
+};
+
+static void deque_push(dir_deque_t *dq, dir_task_t *task) {
+    pthread_mutex_lock(&dq->lock);
+    size_t size = atomic_load(&dq->size);
+    if (size == dq->cap) {
+        // Duplicar la capacidad desenrollando el buffer circular.
+        size_t ncap = dq->cap ? dq->cap * 2 : 64;
+        dir_task_t **items = malloc(ncap * sizeof(dir_task_t *));
+        if (!items) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
         }
+        for (size_t i = 0; i < size; i++)
+            items[i] = dq->items[(dq->head + i) % dq->cap];
+        free(dq->items);
+        dq->items = items;
+        dq->cap = ncap;
+        dq->head = 0;
+    }
+    dq->items[(dq->head + size) % dq->cap] = task;
+    atomic_store(&dq->size, size + 1);
+    pthread_mutex_unlock(&dq->lock);
+}
+
+// Saca por el final (solo el dueño). Devuelve NULL si está vacía.
+static dir_task_t *deque_pop(dir_deque_t *dq) {
+    dir_task_t *task = NULL;
+    pthread_mutex_lock(&dq->lock);
+    size_t size = atomic_load(&dq->size);
+    if (size > 0) {
+        task = dq->items[(dq->head + size - 1) % dq->cap];
+        atomic_store(&dq->size, size - 1);
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return task;
+}
+
+// Roba por la cabeza (otros hilos). Devuelve NULL si está vacía.
+static dir_task_t *deque_steal(dir_deque_t *dq) {
+    dir_task_t *task = NULL;
+    if (atomic_load(&dq->size) == 0)
+        return NULL;
+    pthread_mutex_lock(&dq->lock);
+    size_t size = atomic_load(&dq->size);
+    if (size > 0) {
+        task = dq->items[dq->head];
+        dq->head = (dq->head + 1) % dq->cap;
+        atomic_store(&dq->size, size - 1);
     }
+    pthread_mutex_unlock(&dq->lock);
+    return task;
+}
 
-    closedir(dir);
+// ¿Hay algún directorio en alguna cola?
+static int work_available(void) {
+    for (int i = 0; i < walk.nwalkers; i++)
+        if (atomic_load(&walk.walkers[i].dq.size) > 0)
+            return 1;
     return 0;
 }
 
+/**
+ * push_dir:
+ *   Añade un directorio pendiente a la cola del hilo 'w' y despierta a un
+ *   hilo dormido, si lo hay. 'pending' se incrementa antes de publicar la
+ *   tarea para que nunca llegue a 0 con trabajo en vuelo.
+ */
+static void push_dir(walker_t *w, dir_task_t *task) {
+    atomic_fetch_add(&walk.pending, 1);
+    deque_push(&w->dq, task);
+    if (atomic_load(&walk.idle) > 0) {
+        pthread_mutex_lock(&walk.idle_mutex);
+        pthread_cond_signal(&walk.idle_cond);
+        pthread_mutex_unlock(&walk.idle_mutex);
+    }
+}
+
+// Marca un directorio como terminado; el último despierta a todos.
+static void finish_dir(void) {
+    if (atomic_fetch_sub(&walk.pending, 1) == 1) {
+        pthread_mutex_lock(&walk.idle_mutex);
+        pthread_cond_broadcast(&walk.idle_cond);
+        pthread_mutex_unlock(&walk.idle_mutex);
+    }
+}
+
+/**
+ * new_task:
+ *   Crea la tarea para el subdirectorio 'name' de 'parent' (o, con 'parent'
+ *   NULL, para el directorio de ruta 'name').
+ */
+static dir_task_t *new_task(dir_ref_t *parent, const char *name,
+                            const entry_info_t *info) {
+    size_t len = strlen(name) + 1;
+    dir_task_t *task = malloc(sizeof(dir_task_t) + len);
+    if (!task) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    task->info = *info;
+    task->node = NULL;
+    task->parent = parent;
+    memcpy(task->name, name, len);
+    if (parent) {
+        atomic_fetch_add(&parent->refs, 1);
+        atomic_fetch_add(&parent->opens, 1);
+    }
+    return task;
+}
+
+/**
+ * new_ref:
+ *   Crea la referencia del directorio de 'task', recién abierto en 'fd',
+ *   con un uso y una referencia para su propio recorrido. Guarda 'fd' si
+ *   cabe en el presupuesto; si no, retiene el descriptor del padre.
+ */
+static dir_ref_t *new_ref(const dir_task_t *task, int fd) {
+    size_t len = strlen(task->name) + 1;
+    dir_ref_t *ref = malloc(sizeof(dir_ref_t) + len);
+    if (!ref) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    ref->parent = task->parent;
+    atomic_init(&ref->refs, 1);
+    atomic_init(&ref->opens, 1);
+    ref->dev = task->info.dev;
+    ref->ino = task->info.ino;
+    memcpy(ref->name, task->name, len);
+
+    ref->fd = fd;
+    if (atomic_fetch_add(&walk.open_refs, 1) >= walk.budget) {
+        atomic_fetch_sub(&walk.open_refs, 1);
+        ref->fd = -1;
+        if (ref->parent)
+            atomic_fetch_add(&ref->parent->opens, 1);
+    }
+    if (ref->parent)
+        atomic_fetch_add(&ref->parent->refs, 1);
+    return ref;
+}
+
+// Suelta una referencia; la última libera la estructura y sigue hacia arriba.
+static void ref_put(dir_ref_t *ref) {
+    while (ref && atomic_fetch_sub(&ref->refs, 1) == 1) {
+        dir_ref_t *parent = ref->parent;
+        free(ref);
+        ref = parent;
+    }
+}
+
+// Suelta un uso del descriptor; el último lo cierra o, si no tenía, suelta
+// el del padre que retenía.
+static void ref_unuse(dir_ref_t *ref) {
+    while (ref && atomic_fetch_sub(&ref->opens, 1) == 1) {
+        if (ref->fd != -1) {
+            close(ref->fd);
+            atomic_fetch_sub(&walk.open_refs, 1);
+            break;
+        }
+        ref = ref->parent;
+    }
+}
+
+/**
+ * ref_path:
+ *   Ruta de la entrada 'name' del directorio 'ref' (o 'name' tal cual si
+ *   'ref' es NULL), solo para mensajes: se construye con malloc() siguiendo
+ *   la cadena de padres.
+ */
+static char *ref_path(const dir_ref_t *ref, const char *name) {
+    size_t len = strlen(name);
+    for (const dir_ref_t *r = ref; r; r = r->parent)
+        len += strlen(r->name) + 1;
+    char *path = malloc(len + 1);
+    if (!path) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    size_t pos = len - strlen(name);
+    memcpy(path + pos, name, strlen(name) + 1);
+    for (const dir_ref_t *r = ref; r; r = r->parent) {
+        path[--pos] = '/';
+        pos -= strlen(r->name);
+        memcpy(path + pos, r->name, strlen(r->name));
+    }
+    return path;
+}
+
+// ¿Es 'fd' el directorio de 'ref'?
+static int is_ref(int fd, const dir_ref_t *ref) {
+    struct stat st;
+    return fstat(fd, &st) == 0 && st.st_dev == ref->dev &&
+           st.st_ino == ref->ino;
+}
+
+/**
+ * reopen_ref:
+ *   Abre el directorio de 'ref', que no tiene descriptor, bajando nombre a
+ *   nombre con openat() desde su antepasado más cercano con descriptor (o
+ *   desde la ruta de la raíz) y comprobando en cada nivel que es el mismo
+ *   directorio. Devuelve el descriptor o -1 (errno).
+ */
+static int reopen_ref(const dir_ref_t *ref) {
+    size_t n = 0;
+    const dir_ref_t *top = ref;
+    while (top->fd == -1 && top->parent) {
+        top = top->parent;
+        n++;
+    }
+    const dir_ref_t **chain = malloc((n + 1) * sizeof(dir_ref_t *));
+    if (!chain) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    const dir_ref_t *r = ref;
+    for (size_t i = n + 1; i-- > 0; r = r->parent)
+        chain[i] = r;
+
+    // chain[0] es 'top': si tiene descriptor se usa prestado (no se cierra)
+    int fd = top->fd;
+    if (fd == -1) {
+        fd = open_subdir(AT_FDCWD, top->name);
+        if (fd != -1 && !is_ref(fd, top)) {
+            close(fd);
+            errno = ESTALE;
+            fd = -1;
+        }
+    }
+    for (size_t i = 1; fd != -1 && i <= n; i++) {
+        int sub = open_subdir(fd, chain[i]->name);
+        int err = errno;
+        if (fd != top->fd)
+            close(fd);
+        errno = err;
+        fd = sub;
+        if (fd != -1 && !is_ref(fd, chain[i])) {
+            close(fd);
+            errno = ESTALE;
+            fd = -1;
+        }
+    }
+    free(chain);
+    return fd;
+}
+
+/**
+ * open_task:
+ *   Abre el directorio de una tarea: openat() relativo a su padre y, si el
+ *   padre no guarda descriptor, reabriéndolo antes con reopen_ref().
+ */
+static int open_task(const dir_task_t *task) {
+    const dir_ref_t *parent = task->parent;
+    if (!parent)
+        return open_subdir(AT_FDCWD, task->name);
+    if (parent->fd != -1)
+        return open_subdir(parent->fd, task->name);
+
+    int pfd = reopen_ref(parent);
+    if (pfd == -1)
+        return -1;
+    int fd = open_subdir(pfd, task->name);
+    int err = errno;
+    close(pfd);
+    errno = err;
+    return fd;
+}
+
+/**
+ * new_node:
+ *   Crea el nodo del directorio 'dir/name' ('name' puede ser NULL para usar
+ *   'dir' tal cual), que empieza sumando sus propios 'blocks', y lo cuenta
+ *   como pendiente en su padre.
+ */
+static dir_node_t *new_node(dir_node_t *parent, const char *dir,
+                            const char *name, size_t blocks) {
+    size_t dlen = strlen(dir);
+    size_t nlen = name ? strlen(name) + 1 : 0;
+    dir_node_t *node = malloc(sizeof(dir_node_t) + dlen + nlen + 1);
+    if (!node) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    node->parent = parent;
+    atomic_init(&node->blocks, blocks);
+    atomic_init(&node->pending, 1);
+    memcpy(node->path, dir, dlen);
+    if (name) {
+        node->path[dlen] = '/';
+        memcpy(node->path + dlen + 1, name, nlen);
+    } else {
+        node->path[dlen] = '\0';
+    }
+    if (parent)
+        atomic_fetch_add(&parent->pending, 1);
+    return node;
+}
+
+/**
+ * node_done:
+ *   Descuenta una cosa pendiente del nodo. Si era la última, su total ya
+ *   está completo: se apunta en el informe del hilo, se suma al padre y se
+ *   sigue hacia arriba.
+ */
+static void node_done(walker_t *w, dir_node_t *node) {
+    while (node && atomic_fetch_sub(&node->pending, 1) == 1) {
+        size_t total = atomic_load(&node->blocks);
+        heap_offer(&w->rep.dirs, total, node->path, NULL, NULL);
+        dir_node_t *parent = node->parent;
+        if (parent)
+            atomic_fetch_add(&parent->blocks, total);
+        free(node);
+        node = parent;
+    }
+}
+
+/**
+ * scan_dir:
+ *   Recorre las entradas de un directorio pendiente (sin recursión): suma
+ *   sus bloques al contador del hilo y encola los subdirectorios. El
+ *   directorio se abre con openat() relativo a su padre y sus entradas se
+ *   consultan con statx() relativo a su descriptor, que se queda abierto
+ *   (si cabe en el presupuesto) para abrir los subdirectorios encolados.
+ *   Suelta el uso que la tarea tenía del descriptor del padre.
+ *   Devuelve 0 o -1.
+ */
+static int scan_dir(walker_t *w, const dir_task_t *task) {
+    int fd = open_task(task);
+    if (fd == -1) {
+        int err = errno;
+        char *path = ref_path(task->parent, task->name);
+        fprintf(stderr, "Error abriendo directorio '%s': %s\n",
+                path, strerror(err));
+        free(path);
+        ref_unuse(task->parent);
+        return -1;
+    }
+    dir_ref_t *ref = new_ref(task, fd);
+    ref_unuse(task->parent);
+
+    // Con -t, los bloques de los subdirectorios encolados ya cuentan en el
+    // nodo de cada uno; al nodo de este solo va el resto.
+    size_t before = w->blocks, subdir_blocks = 0;
+    const char *path = task->node ? task->node->path : NULL;
+    dir_scan_t sc;
+    const char *name;
+    entry_info_t info;
+    int rc;
+
+    scan_begin(&sc, fd, &task->info, &w->blocks, task->node ? &w->rep : NULL,
+               w->dirbuf);
+    while ((rc = scan_next(&sc, path, &name, &info)) == 1) {
+        dir_task_t *sub = new_task(ref, name, &info);
+        if (task->node) {
+            sub->node = new_node(task->node, path, name, info.blocks);
+            subdir_blocks += info.blocks;
+        }
+        push_dir(w, sub);
+    }
+    if (rc < 0) {
+        int err = errno;
+        char *p = ref_path(task->parent, task->name);
+        errno = err;
+        scan_error(p, name);
+        free(p);
+    }
+    scan_end(&sc, rc == 0);
+    if (task->node)
+        atomic_fetch_add(&task->node->blocks,
+                         w->blocks - before - subdir_blocks);
+
+    // Si se lo ha quedado la referencia, lo cierra el último que lo use
+    if (ref->fd != fd)
+        close(fd);
+    ref_unuse(ref);
+    ref_put(ref);
+    return rc;
+}
+
+/**
+ * walker_main:
+ *   Bucle de un hilo: saca directorios de su cola o los roba de otras y los
+ *   recorre. Si no encuentra trabajo duerme hasta que alguien encole algo o
+ *   hasta que 'pending' llegue a 0.
+ */
+static void *walker_main(void *arg) {
+    walker_t *w = arg;
+
+    for (;;) {
+        dir_task_t *task = deque_pop(&w->dq);
+        for (int k = 1; !task && k < walk.nwalkers; k++)
+            task = deque_steal(&walk.walkers[(w->id + k) % walk.nwalkers].dq);
+
+        if (task) {
+            if (atomic_load(&walk.failed))
+                ref_unuse(task->parent);
+            else if (scan_dir(w, task) != 0)
+                atomic_store(&walk.failed, 1);
+            if (task->node)
+                node_done(w, task->node);
+            ref_put(task->parent);
+            free(task);
+            finish_dir();
+            continue;
+        }
+
+        // Sin trabajo: dormir. 'idle' se incrementa antes de volver a mirar
+        // las colas, y push_dir() encola antes de mirar 'idle', así que o
+        // vemos la tarea nueva o push_dir() nos despierta.
+        pthread_mutex_lock(&walk.idle_mutex);
+        atomic_fetch_add(&walk.idle, 1);
+        while (atomic_load(&walk.pending) > 0 && !work_available())
+            pthread_cond_wait(&walk.idle_cond, &walk.idle_mutex);
+        atomic_fetch_sub(&walk.idle, 1);
+        int done = atomic_load(&walk.pending) == 0;
+        pthread_mutex_unlock(&walk.idle_mutex);
+        if (done)
+            break;
+    }
+    return NULL;
+}
+
+// Descriptores fuera del presupuesto: entrada/salida estándar, caché...
+#define FD_RESERVE 8
+
+/**
+ * parallel_budget:
+ *   Directorios que pueden guardar su descriptor en el recorrido paralelo:
+ *   --fd-budget, pero sin pasar de RLIMIT_NOFILE. El recorrido secuencial
+ *   se adapta al ver EMFILE; aquí otros hilos pueden estar usando los
+ *   descriptores guardados, así que se reserva de antemano lo que no cuenta
+ *   en el presupuesto: FD_RESERVE y dos por hilo (al reabrir un padre, el
+ *   de un nivel y el del siguiente; al abrir la tarea, el del padre
+ *   reabierto y el suyo). Puede quedar en 0: entonces todo se reabre desde
+ *   la raíz.
+ */
+static long parallel_budget(int nthreads) {
+    long budget = fd_budget;
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) {
+        long avail = (long)rl.rlim_cur - FD_RESERVE - 2L * nthreads;
+        if (budget > avail)
+            budget = avail > 0 ? avail : 0;
+    }
+    return budget;
+}
+
+/**
+ * get_size_dir_parallel:
+ *   Igual que get_size_dir() pero repartiendo los subdirectorios entre
+ *   'nthreads' hilos. El hilo que llama hace de hilo 0.
+ *
+ * Retorno:
+ *   0 en éxito, -1 en error (mensaje impreso).
+ */
+int get_size_dir_parallel(const char *dirpath, const entry_info_t *self,
+                          size_t *blocks, int nthreads) {
+    walk.walkers = calloc(nthreads, sizeof(walker_t));
+    if (!walk.walkers) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    walk.nwalkers = nthreads;
+    atomic_store(&walk.pending, 0);
+    atomic_store(&walk.open_refs, 0);
+    walk.budget = parallel_budget(nthreads);
+    atomic_store(&walk.idle, 0);
+    atomic_store(&walk.failed, 0);
+    for (int i = 0; i < nthreads; i++) {
+        walk.walkers[i].id = i;
+        pthread_mutex_init(&walk.walkers[i].dq.lock, NULL);
+        walk.walkers[i].dirbuf = malloc(DIRBUF_SIZE);
+        if (!walk.walkers[i].dirbuf) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        if (report_top)
+            report_init(&walk.walkers[i].rep);
+    }
+
+    dir_task_t *root = new_task(NULL, dirpath, self);
+    if (report_top)
+        root->node = new_node(NULL, dirpath, NULL, self->blocks);
+    push_dir(&walk.walkers[0], root);
+
+    for (int i = 1; i < nthreads; i++) {
+        int rc = pthread_create(&walk.walkers[i].tid, NULL, walker_main,
+                                &walk.walkers[i]);
+        if (rc != 0) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(rc));
+            exit(EXIT_FAILURE);
+        }
+    }
+    walker_main(&walk.walkers[0]);
+
+    // Unir los contadores de todos los hilos.
+    for (int i = 0; i < nthreads; i++) {
+        if (i > 0)
+            pthread_join(walk.walkers[i].tid, NULL);
+        *blocks += walk.walkers[i].blocks;
+        if (report_top)
+            report_merge(&report, &walk.walkers[i].rep);
+        pthread_mutex_destroy(&walk.walkers[i].dq.lock);
+        free(walk.walkers[i].dq.items);
+        free(walk.walkers[i].dirbuf);
+    }
+    free(walk.walkers);
+    walk.walkers = NULL;
+
+    return atomic_load(&walk.failed) ? -1 : 0;
+}
+
 /**
  * get_size:
  *   Calcula el número total de bloques de 512 B reservados para 'path'.
@@ -103,13 +2192,14 @@ int get_size_dir(const char *dirpath, size_t *blocks) {
  *   - Si es fichero normal o enlace, toma st_blocks.
  *
  * Parámetros:
- *   path:   ruta al fichero o directorio
- *   blocks: puntero donde se almacenan los bloques (inicializado a 0)
+ *   path:     ruta al fichero o directorio
+ *   blocks:   puntero donde se almacenan los bloques (inicializado a 0)
+ *   nthreads: hilos para recorrer directorios (1 = secuencial)
  *
  * Retorno:
  *   0 en éxito, -1 en error.
  */
-int get_size(const char *path, size_t *blocks) {
+int get_size(const char *path, size_t *blocks, int nthreads) {
     struct stat st;
     // lstat para no seguir enlaces simbólicos
     if (lstat(path, &st) != 0) {
@@ -119,41 +2209,143 @@ int get_size(const char *path, size_t *blocks) {
     }
 
     // Empezamos sumando los bloques del propio path
-    *blocks = st.st_blocks;
+    entry_info_t info;
+    stat_to_info(&st, &info);
+    int counted = already_counted(&info);
+    *blocks = counted ? 0 : info.blocks;
+    root_dev = st.st_dev;
+    if (report_top && !counted && !S_ISDIR(st.st_mode))
+        report_file(&report, path, NULL, &info);
 
     // Si es directorio, procesar recursivamente su contenido
     if (S_ISDIR(st.st_mode)) {
-        if (get_size_dir(path, blocks) != 0)
+        int rc = nthreads > 1
+                 ? get_size_dir_parallel(path, &info, blocks, nthreads)
+                 : get_size_dir(path, &info, blocks);
+        if (rc != 0)
             return -1;
     }
 
     return 0;
 }
 
+static void usage(const char *prog) {
+    fprintf(stderr, "Uso: %s [-j N] [-x] [-c caché [--refresh] [--max-age S]]\n"
+            "       [-t N] [--json] [--fd-budget N]\n"
+            "       <fichero_o_directorio> [<otro> ...]\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+// Opciones largas (las que no tienen letra usan valores fuera de ASCII).
+enum { OPT_REFRESH = 256, OPT_MAX_AGE, OPT_JSON, OPT_FD_BUDGET };
+
+static const struct option long_options[] = {
+    { "cache",   required_argument, NULL, 'c' },
+    { "refresh", no_argument,       NULL, OPT_REFRESH },
+    { "max-age", required_argument, NULL, OPT_MAX_AGE },
+    { "top",     required_argument, NULL, 't' },
+    { "json",    no_argument,       NULL, OPT_JSON },
+    { "fd-budget", required_argument, NULL, OPT_FD_BUDGET },
+    { NULL, 0, NULL, 0 }
+};
+
 /**
  * main: procesa la lista de argumentos y muestra tamaño en KB.
  */
 int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Uso: %s <fichero_o_directorio> [<otro> ...]\n",
-                argv[0]);
-        exit(EXIT_FAILURE);
+    int opt;
+    int nthreads = 1;
+    char *endptr;
+
+    while ((opt = getopt_long(argc, argv, "j:xc:t:", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'j':
+            nthreads = strtol(optarg, &endptr, 10);
+            if (*endptr != '\0' || nthreads < 1 || nthreads > 1024) {
+                fprintf(stderr, "Opción -j requiere un número entre 1 y 1024\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'x':
+            one_file_system = 1;
+            break;
+        case 'c':
+            cache.path = optarg;
+            break;
+        case OPT_REFRESH:
+            cache.refresh = 1;
+            break;
+        case OPT_MAX_AGE:
+            cache.max_age = strtoll(optarg, &endptr, 10);
+            if (*endptr != '\0' || cache.max_age < 0) {
+                fprintf(stderr, "Opción --max-age requiere un número de "
+                        "segundos no negativo\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 't': {
+            long n = strtol(optarg, &endptr, 10);
+            if (*endptr != '\0' || n < 1 || n > 1000000) {
+                fprintf(stderr, "Opción -t requiere un número entre 1 y 1000000\n");
+                exit(EXIT_FAILURE);
+            }
+            report_top = n;
+            break;
+        }
+        case OPT_JSON:
+            report_json = 1;
+            break;
+        case OPT_FD_BUDGET: {
+            long n = strtol(optarg, &endptr, 10);
+            if (*endptr != '\0' || n < 1 || n > 65536) {
+                fprintf(stderr, "Opción --fd-budget requiere un número entre 1 y 65536\n");
+                exit(EXIT_FAILURE);
+            }
+            fd_budget = n;
+            break;
+        }
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind >= argc)
+        usage(argv[0]);
+
+    if (!cache.path && (cache.refresh || cache.max_age >= 0)) {
+        fprintf(stderr, "--refresh y --max-age requieren -c\n");
+        usage(argv[0]);
     }
 
+    cache.now = report_now = time(NULL);
+    if (cache.path)
+        cache_load();
+
+    if (report_json)
+        printf("[");
+
     // Para cada argumento: calcular y mostrar tamaño
-    for (int i = 1; i < argc; ++i) {
+    int first = 1;
+    for (int i = optind; i < argc; ++i) {
         const char *path = argv[i];
         size_t blocks = 0;
 
-        if (get_size(path, &blocks) != 0) {
-            // En caso de error, seguimos con el siguiente
-            continue;
+        if (report_top)
+            report_init(&report);
+        if (get_size(path, &blocks, nthreads) == 0) {
+            print_result(path, blocks, first);
+            first = 0;
         }
-
-        // Convertir bloques de 512B a kilobytes (ceil)
-        size_t kbytes = (blocks + 1) / 2;
-        printf("%zuK %s\n", kbytes, path);
+        // En caso de error, seguimos con el siguiente
+        if (report_top)
+            report_free(&report);
     }
 
+    if (report_json)
+        printf("%s]\n", first ? "" : "\n");
+
+    if (cache.path)
+        cache_save();
+
     return EXIT_SUCCESS;
 }
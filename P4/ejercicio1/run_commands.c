@@ -6,21 +6,157 @@
  * y status.
  *
  * Uso:
- *   ./run_commands [-x "comando"] [-s fichero] [-b]
+ *   ./run_commands [-m spawn|fork] [-x "comando"] [-s fichero [-d]] [-b | -j N]
+ *                  [-p | -g | --ordered | -o dir] [-r]
+ *   ./run_commands -B n [-M MB] [-x "comando"]
  *
  *   -x <comando>  Ejecuta un único comando y espera a que termine.
  *   -s <fichero>  Lee el fichero línea a línea, cada línea es un comando.
  *                 Por defecto: secuencial (espera a cada uno antes de lanzar el siguiente).
- *   -b            Solo con -s: lanza todos los comandos sin esperar, y luego
- *                 informa cada vez que uno termina.
+ *   -b            Solo con -s: lanza los comandos sin esperar, sin límite, y
+ *                 luego informa cada vez que uno termina.
+ *   -j <N>        Solo con -s: como -b pero con N comandos en marcha como
+ *                 mucho; en cuanto uno termina se lanza el siguiente.
+ *   -p            Solo con -s: la salida estándar y de error de cada comando
+ *                 pasa por el padre, que la escribe línea a línea precedida
+ *                 de "[#n] " (n = número de comando), para que las líneas de
+ *                 comandos simultáneos no se mezclen.
+ *   -g, --group   Solo con -s: la salida de cada comando se guarda y se
+ *                 escribe entera, junto con sus líneas "@@", cuando termina.
+ *   --ordered     Como -g, pero en el orden de los comandos en el fichero:
+ *                 la salida de un comando sale en cuanto han terminado él y
+ *                 todos los anteriores.
+ *   -o, --capture <dir>
+ *                 Solo con -s: la salida estándar y de error del comando n
+ *                 se guardan en dir/n.out y dir/n.err.
+ *   -d, --dag     Solo con -s: el fichero es un grafo de tareas (ver abajo).
+ *   -r, --rusage  Tras cada comando informa de su tiempo real, CPU de
+ *                 usuario y de sistema, memoria máxima (RSS) y cambios de
+ *                 contexto; con -s, al final escribe un resumen con los
+ *                 percentiles 50, 95 y 99 y un histograma del tiempo real y
+ *                 de CPU, y los comandos más lentos.
+ *
+ * Las opciones largas equivalentes a las de una letra son --command (-x),
+ * --script (-s), --background (-b), --jobs (-j), --prefix (-p),
+ * --launcher (-m), --bench (-B) y --bench-mb (-M).
+ *   -m <modo>     Cómo se crean los hijos: "spawn" (por defecto) con
+ *                 posix_spawn(), o "fork" con fork() + execvp().
+ *   -B <n>        Prueba de rendimiento: lanza n veces el comando de -x (por
+ *                 defecto "true") con cada modo, esperando a cada uno, e
+ *                 informa de los lanzamientos por segundo.
+ *   -M <MB>       Con -B: reserva y toca antes MB megas, para ver cómo crece
+ *                 el coste de fork() con el tamaño del padre.
+ *
+ * Lanzamiento:
+ *   fork() copia las tablas de páginas del padre (y las marca copy-on-write),
+ *   así que cuanto más memoria tiene el padre más tarda cada lanzamiento.
+ *   posix_spawn() en glibc usa clone(CLONE_VM | CLONE_VFORK): el hijo
+ *   comparte la memoria del padre hasta el exec y no se copia nada. La
+ *   búsqueda en el PATH se hace una vez por cada argv[0] distinto y se
+ *   guarda en una tabla hash (también los que no se encuentran); si el
+ *   fichero encontrado desaparece, se vuelve a buscar.
+ *
+ * Espera (-s):
+ *   Un único bucle con epoll espera a la vez a todos los hijos, cada uno con
+ *   un pidfd (pidfd_open(), que se vuelve legible cuando el proceso termina)
+ *   y, con -p, a sus tuberías de salida. Cada comando en marcha ocupa un
+ *   hueco de una tabla, y el evento de epoll lleva el número de hueco, así
+ *   que encontrar el comando de un evento es O(1) aunque haya miles en
+ *   marcha. Un comando se da por terminado cuando ha acabado el proceso y
+ *   se han vaciado sus tuberías. Se sube el límite de descriptores abiertos
+ *   al máximo permitido, porque cada comando usa hasta tres. Si el kernel
+ *   no tiene pidfd_open() (anterior a 5.3) se recogen los hijos con
+ *   waitpid(WNOHANG) cada 50 ms.
+ *
+ * Contabilidad (-r):
+ *   Los hijos se recogen con wait4(), que devuelve su struct rusage. El
+ *   tiempo real va del lanzamiento a la recogida del proceso. Para los
+ *   percentiles, los tiempos (en microsegundos) se guardan en un histograma
+ *   logarítmico-lineal como el de HdrHistogram: cada potencia de dos se
+ *   parte en 32 cubos iguales, así que el error relativo es menor del 3 %
+ *   con memoria fija (unos 2000 contadores) sea cual sea el número de
+ *   comandos.
+ *
+ * Captura (-g, --ordered, -o):
+ *   Cada comando escribe en tuberías y el padre pasa los datos con splice()
+ *   de la tubería al destino sin copiarlos a memoria de usuario: a un
+ *   memfd por salida (-g, --ordered) o a los ficheros de -o. Al escribir un
+ *   grupo, el memfd se copia a la salida con sendfile(), también dentro del
+ *   kernel. Con --ordered los comandos terminados esperan su turno en un
+ *   anillo indexado por número de comando; para no acumular descriptores sin
+ *   límite, no se lanza un comando si está a más de una ventana (que depende
+ *   del límite de descriptores) del primero que falta por escribir.
+ *
+ * Sintaxis de los comandos:
+ *   Como en sh, pero sin variables, redirecciones ni tuberías: los
+ *   argumentos se separan con espacios, '...' agrupa texto literal, "..."
+ *   agrupa texto en el que '\' escapa $ ` " y '\', y fuera de comillas '\'
+ *   escapa cualquier carácter. Cada línea se divide en argv[] en un único
+ *   bloque (punteros y cadenas juntos): con -s se reutiliza el mismo bloque
+ *   para todas las líneas, y con -d se dividen todas al cargar el grafo, así
+ *   que lanzar un comando no reserva memoria.
+ *
+ * Atributos (-s):
+ *   Cada línea puede empezar por atributos "clave:valor" (o "clave=valor")
+ *   antes del comando:
+ *     timeout:T   tiempo máximo (30, 500ms, 2m, 1h); al vencer se manda
+ *                 SIGTERM al comando y a su grupo de procesos y, 2 s
+ *                 después, SIGKILL a todo lo que quede
+ *     retries:N   si termina con status distinto de 0 (o por timeout) se
+ *                 vuelve a lanzar hasta N veces
+ *     mem:M       memoria máxima (512M, 2G) de todo el comando
+ *     cpu:C       CPUs como mucho (0.5 = medio procesador)
+ *   y, solo con -d:
+ *     name:N      nombre de la tarea, para referirse a ella en after:
+ *     after:A,B   no se lanza hasta que A y B hayan terminado con status 0
+ *     cost:S      duración estimada en segundos (por defecto 1)
+ *
+ * Límites (timeout, mem, cpu):
+ *   Todos los timeout= comparten una rueda de temporizadores: un único
+ *   timerfd en el bucle de epoll, que solo está armado si hay algún
+ *   temporizador, y 256 casillas de 100 ms; añadir y quitar un temporizador
+ *   es O(1) y no hace falta una alarma ni una señal por comando. Un comando
+ *   con límites va, si hay cgroup v2, en una hoja propia
+ *   (<cgroup>/run_commands.<pid>/<n>) con memory.max y cpu.max; el hijo
+ *   entra en ella antes del exec (por eso se lanza con fork()), así que
+ *   todo lo que cree cuenta para el límite y al vencer el timeout se mata
+ *   entero con cgroup.kill. Al terminar el comando se mata lo que quede en
+ *   su hoja y se borra. Si no hay cgroup v2, o le faltan los controladores
+ *   memory o cpu, se avisa y mem= se aplica con RLIMIT_AS a cada proceso, y
+ *   cpu= no tiene efecto.
+ *
+ * Grafo de tareas (-d):
+ *   Las tareas usan los atributos name:, after: y cost: (ver arriba).
+ *   Las líneas vacías y las que empiezan por '#' se ignoran. El fichero se
+ *   lee entero y se ordena con el algoritmo de Kahn: cada tarea cuenta las
+ *   dependencias que le faltan y pasa a la cola de listas cuando llega a 0.
+ *   La cola es un montículo ordenado por camino crítico (la suma de "cost"
+ *   más larga desde la tarea hasta el final del grafo), de modo que con -j
+ *   se lanza primero lo que más retrasaría el final. Si una tarea falla (o
+ *   no se puede lanzar), las que dependen de ella, directa o
+ *   indirectamente, no se lanzan y se informa de ellas como "skipped". Un
+ *   ciclo o un nombre desconocido en after: es un error y no se lanza nada.
+ *   Con --ordered se escribe en el orden del fichero y la ventana es todo
+ *   el grafo.
+ *
+ * El fichero se lee a medida que se lanzan los comandos (no hay máximo de
+ * líneas ni de longitud de línea), y solo se guardan los comandos en
+ * marcha: con -j N la memoria y los procesos vivos no pasan de N, aunque el
+ * fichero tenga cientos de miles de líneas. Sin -b ni -j es lo mismo que
+ * -j 1 (salvo con -d, que necesita el grafo entero).
  *
  * Ejemplos:
  *   ./run_commands -x "ls -l /"
  *   ./run_commands -s comandos.txt
  *   ./run_commands -b -s comandos.txt
+ *   ./run_commands -j 16 -s comandos.txt
+ *   ./run_commands -j 8 --ordered -s comandos.txt
+ *   ./run_commands -j 4 -d -s test_dag
+ *   echo 'timeout:5s retries:2 mem:1G ./simulacion' | ./run_commands -s /dev/stdin
+ *   ./run_commands -B 2000 -M 1024
  */
 
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE     // pipe2, syscall, wait4
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -28,52 +164,298 @@
 #include <ctype.h>
 #include <unistd.h>     // getopt, fork, execvp
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <errno.h>
+#include <spawn.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>       // memfd_create
+#include <sys/sendfile.h>
+#include <getopt.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <dirent.h>
+#include <signal.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+extern char **environ;
 
-#define MAX_CMDS 1024
-#define LINEBUF 1024
+// Añade un carácter al argumento en curso (o solo lo cuenta, sin destino).
+// 'ch' se evalúa siempre una vez: puede llevar p++.
+#define PUT(ch) do {                    \
+        char put_c = (ch);              \
+        if (strings)                    \
+            strings[used] = put_c;      \
+        used++;                         \
+    } while (0)
 
 /**
- * parse_command:
- *   Divide la línea cmd en tokens separados por espacios, construye argv[]
- *   terminado en NULL y devuelve también la cuenta de argumentos en *argc.
+ * tokenize:
+ *   Separa cmd en argumentos como sh: los espacios separan, entre '...' todo
+ *   es literal, entre "..." la '\' solo escapa $ ` " \ y el salto de línea,
+ *   y fuera de comillas la '\' escapa el carácter siguiente. Si argv y
+ *   strings no son NULL escribe ahí los argumentos, uno tras otro y
+ *   terminados en '\0'. Devuelve el número de argumentos y en *bytes lo que
+ *   ocupan, o -1 si hay comillas sin cerrar o una '\' al final.
  */
-char **parse_command(const char *cmd, int *argc) {
-    size_t argv_size = 10;
-    char **argv = malloc(argv_size * sizeof(char *));
-    if (!argv) { perror("malloc"); exit(EXIT_FAILURE); }
+int tokenize(const char *cmd, char **argv, char *strings, size_t *bytes) {
+    const char *p = cmd;
+    size_t used = 0;
     int count = 0;
-    const char *start = cmd;
-    while (*start && isspace((unsigned char)*start)) start++;
-    while (*start) {
-        if (count >= (int)argv_size - 1) {
-            argv_size *= 2;
-            argv = realloc(argv, argv_size * sizeof(char *));
-            if (!argv) { perror("realloc"); exit(EXIT_FAILURE); }
-        }
-        const char *end = start;
-        while (*end && !isspace((unsigned char)*end)) end++;
-        size_t len = end - start;
-        argv[count] = malloc(len + 1);
-        if (!argv[count]) { perror("malloc"); exit(EXIT_FAILURE); }
-        memcpy(argv[count], start, len);
-        argv[count][len] = '\0';
+
+    for (;;) {
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == '\0')
+            break;
+        if (argv)
+            argv[count] = strings + used;
         count++;
-        start = end;
-        while (*start && isspace((unsigned char)*start)) start++;
+        while (*p && !isspace((unsigned char)*p)) {
+            char c = *p++;
+            if (c == '\'') {
+                while (*p && *p != '\'')
+                    PUT(*p++);
+                if (*p++ == '\0')
+                    return -1;
+            } else if (c == '"') {
+                while (*p && *p != '"') {
+                    if (*p == '\\' && p[1] && strchr("$`\"\\\n", p[1]))
+                        p++;
+                    PUT(*p++);
+                }
+                if (*p++ == '\0')
+                    return -1;
+            } else if (c == '\\') {
+                if (*p == '\0')
+                    return -1;
+                PUT(*p++);
+            } else {
+                PUT(c);
+            }
+        }
+        PUT('\0');
     }
+    *bytes = used;
+    return count;
+}
+
+#undef PUT
+
+/**
+ * parse_command_into:
+ *   Divide la línea cmd en argumentos (ver tokenize()) y construye argv[]
+ *   terminado en NULL en un solo bloque: los punteros y detrás las cadenas.
+ *   El bloque es *arena, de *cap bytes, que se agranda si no cabe y se
+ *   puede reutilizar de una línea a otra. Devuelve argv (== *arena) con la
+ *   cuenta en *argc, o NULL si la línea no es válida (mensaje impreso).
+ */
+char **parse_command_into(const char *cmd, int *argc, void **arena, size_t *cap) {
+    size_t bytes;
+    int count = tokenize(cmd, NULL, NULL, &bytes);
+    if (count < 0) {
+        fprintf(stderr, "Comillas sin cerrar o '\\' al final: %s\n", cmd);
+        return NULL;
+    }
+    size_t need = (count + 1) * sizeof(char *) + bytes;
+    if (need > *cap) {
+        void *bigger = realloc(*arena, need);
+        if (!bigger) { perror("realloc"); exit(EXIT_FAILURE); }
+        *arena = bigger;
+        *cap = need;
+    }
+    char **argv = *arena;
+    tokenize(cmd, argv, (char *)(argv + count + 1), &bytes);
     argv[count] = NULL;
     *argc = count;
     return argv;
 }
 
+/**
+ * parse_command:
+ *   Como parse_command_into() pero en un bloque nuevo, que se libera con un
+ *   único free().
+ */
+char **parse_command(const char *cmd, int *argc) {
+    void *arena = NULL;
+    size_t cap = 0;
+    return parse_command_into(cmd, argc, &arena, &cap);
+}
+
+// Cómo se crean los hijos (-m).
+typedef enum { LAUNCH_SPAWN, LAUNCH_FORK } launch_mode_t;
+launch_mode_t launch_mode = LAUNCH_SPAWN;
+
+/*
+ * Caché de búsquedas en el PATH: tabla hash con listas, de argv[0] a la ruta
+ * del ejecutable (NULL si no se encontró).
+ */
+typedef struct path_entry {
+    char *name;
+    char *path;
+    struct path_entry *next;
+} path_entry_t;
+
+#define PATH_BUCKETS 256
+path_entry_t *path_cache[PATH_BUCKETS];
+
+unsigned hash_name(const char *s) {
+    unsigned h = 5381;
+    while (*s)
+        h = h * 33 + (unsigned char)*s++;
+    return h;
+}
+
+/**
+ * search_path:
+ *   Busca 'name' en los directorios del PATH como haría execvp(): devuelve
+ *   la primera ruta que es un fichero regular ejecutable (memoria de
+ *   malloc) o NULL.
+ */
+char *search_path(const char *name) {
+    const char *path = getenv("PATH");
+    if (!path)
+        path = "/bin:/usr/bin";
+    size_t nlen = strlen(name);
+
+    while (1) {
+        const char *end = strchr(path, ':');
+        size_t dlen = end ? (size_t)(end - path) : strlen(path);
+        char *file = malloc(dlen + nlen + 2);
+        if (!file) { perror("malloc"); exit(EXIT_FAILURE); }
+        // Un elemento vacío del PATH es el directorio actual
+        if (dlen == 0) {
+            memcpy(file, name, nlen + 1);
+        } else {
+            memcpy(file, path, dlen);
+            file[dlen] = '/';
+            memcpy(file + dlen + 1, name, nlen + 1);
+        }
+        struct stat st;
+        if (stat(file, &st) == 0 && S_ISREG(st.st_mode) &&
+            access(file, X_OK) == 0)
+            return file;
+        free(file);
+        if (!end)
+            return NULL;
+        path = end + 1;
+    }
+}
+
+/**
+ * resolve_command:
+ *   Devuelve la ruta del ejecutable de argv[0]: tal cual si lleva '/', o la
+ *   del PATH, buscándola solo la primera vez. 'refresh' fuerza a buscar de
+ *   nuevo. NULL si no está.
+ */
+const char *resolve_command(const char *name, int refresh) {
+    if (strchr(name, '/'))
+        return name;
+
+    path_entry_t **bucket = &path_cache[hash_name(name) % PATH_BUCKETS];
+    path_entry_t *e;
+    for (e = *bucket; e; e = e->next)
+        if (strcmp(e->name, name) == 0)
+            break;
+    if (e && !refresh)
+        return e->path;
+
+    if (!e) {
+        e = malloc(sizeof(path_entry_t));
+        if (!e) { perror("malloc"); exit(EXIT_FAILURE); }
+        e->name = strdup(name);
+        if (!e->name) { perror("strdup"); exit(EXIT_FAILURE); }
+        e->next = *bucket;
+        *bucket = e;
+    } else {
+        free(e->path);
+    }
+    e->path = search_path(name);
+    return e->path;
+}
+
+// Dónde se coloca un hijo además de su salida (límites por comando).
+typedef struct {
+    int own_group;      // en un grupo de procesos propio, para matar su árbol
+    int cgroup_procs;   // cgroup.procs de su hoja de cgroup v2, o -1
+} placement_t;
+
+/**
+ * spawn_command:
+ *   Lanza argv con posix_spawn() usando la ruta cacheada y, si 'redirect'
+ *   no es NULL, con su salida estándar y de error en redirect[0] y
+ *   redirect[1]. Si place->own_group, el hijo tiene su propio grupo de
+ *   procesos. Devuelve el PID o -1 si no se pudo lanzar (sin mensaje:
+ *   launch_command() lo reintenta con fork()).
+ */
+pid_t spawn_command(char **argv, const int *redirect, const placement_t *place) {
+    pid_t pid;
+    int err = ENOENT;
+    posix_spawn_file_actions_t actions, *pa = NULL;
+    posix_spawnattr_t attr, *pattr = NULL;
+
+    if (redirect) {
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, redirect[0], STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, redirect[1], STDERR_FILENO);
+        pa = &actions;
+    }
+    if (place && place->own_group) {
+        posix_spawnattr_init(&attr);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+        posix_spawnattr_setpgroup(&attr, 0);
+        pattr = &attr;
+    }
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        const char *file = resolve_command(argv[0], attempt > 0);
+        if (!file)
+            break;
+        err = posix_spawn(&pid, file, pa, pattr, argv, environ);
+        if (err == 0)
+            break;
+        // Solo se vuelve a buscar si el ejecutable cacheado ya no está
+        if ((err != ENOENT && err != EACCES) || strchr(argv[0], '/'))
+            break;
+    }
+    if (pa)
+        posix_spawn_file_actions_destroy(pa);
+    if (pattr)
+        posix_spawnattr_destroy(pattr);
+    return err == 0 ? pid : -1;
+}
+
 /**
  * launch_command:
- *   Crea un hijo con fork(), y en el hijo hace execvp(argv[0], argv).
- *   El padre retorna inmediatamente el PID del hijo.
+ *   Crea un hijo que ejecuta argv[0] con los argumentos argv, con
+ *   posix_spawn() o con fork() + execvp() según launch_mode. Si 'redirect'
+ *   no es NULL, el hijo escribe su salida estándar en redirect[0] y la de
+ *   error en redirect[1]. 'place' (o NULL) dice si va en su propio grupo de
+ *   procesos y en qué cgroup; para entrar en el cgroup antes del exec hay
+ *   que usar fork(), porque posix_spawn() no sabe hacerlo. Si posix_spawn()
+ *   falla también se usa fork(), y el hijo sale con 127 si execvp() falla.
+ *   El padre retorna inmediatamente el PID del hijo (o -1).
  */
-pid_t launch_command(char **argv) {
+pid_t launch_command(char **argv, const int *redirect, const placement_t *place) {
+    if (!argv[0]) {
+        fprintf(stderr, "Comando vacío\n");
+        return -1;
+    }
+    int cgroup_procs = place ? place->cgroup_procs : -1;
+    if (launch_mode == LAUNCH_SPAWN && cgroup_procs < 0) {
+        pid_t pid = spawn_command(argv, redirect, place);
+        if (pid >= 0)
+            return pid;
+        // No se pudo ejecutar (no existe, sin permiso...): se repite con
+        // fork() + execvp() para que el fallo se vea igual que con -m fork,
+        // con el mensaje en la salida del comando y status 127.
+    }
+
     pid_t pid = fork();
     if (pid < 0) {
         perror("fork");
@@ -81,6 +463,17 @@ pid_t launch_command(char **argv) {
     }
     if (pid == 0) {
         // hijo
+        if (place && place->own_group)
+            setpgid(0, 0);
+        // Escribir "0" en cgroup.procs mete en la hoja al que escribe
+        if (cgroup_procs >= 0 && write(cgroup_procs, "0", 1) < 0) {
+            perror("cgroup.procs");
+            _exit(126);
+        }
+        if (redirect) {
+            dup2(redirect[0], STDOUT_FILENO);
+            dup2(redirect[1], STDERR_FILENO);
+        }
         execvp(argv[0], argv);
         // si execvp falla:
         fprintf(stderr, "execvp('%s') failed: %s\n",
@@ -91,14 +484,1761 @@ pid_t launch_command(char **argv) {
     return pid;
 }
 
+double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * benchmark:
+ *   Lanza 'n' veces el comando 'cmd' con cada modo, esperando a cada uno, y
+ *   muestra los lanzamientos por segundo. Si 'mb' > 0, antes reserva y toca
+ *   esa memoria para que el padre tenga un espacio de direcciones grande.
+ */
+void benchmark(const char *cmd, int n, long mb) {
+    char *ballast = NULL;
+    if (mb > 0) {
+        size_t size = (size_t)mb << 20;
+        ballast = malloc(size);
+        if (!ballast) { perror("malloc"); exit(EXIT_FAILURE); }
+        memset(ballast, 1, size);
+    }
+
+    int cargc;
+    char **cargv = parse_command(cmd, &cargc);
+    if (!cargv)
+        exit(EXIT_FAILURE);
+    static const struct { launch_mode_t mode; const char *name; } modes[] = {
+        { LAUNCH_FORK,  "fork"  },
+        { LAUNCH_SPAWN, "spawn" },
+    };
+
+    printf("@@ Benchmark: %d x \"%s\", padre con %ld MB\n", n, cmd, mb);
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        launch_mode = modes[m].mode;
+        double start = now_seconds();
+        int failed = 0;
+        for (int i = 0; i < n; i++) {
+            pid_t pid = launch_command(cargv, NULL, NULL);
+            int status;
+            if (pid < 0 || waitpid(pid, &status, 0) < 0 ||
+                !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                failed++;
+        }
+        double secs = now_seconds() - start;
+        printf("@@ %-5s: %8.0f lanzamientos/s (%.1f us cada uno)%s\n",
+               modes[m].name, n / secs, secs / n * 1e6,
+               failed ? " [con fallos]" : "");
+    }
+
+    free(cargv);
+    free(ballast);
+}
+
+// Atributos de un comando de -s, al principio de su línea.
+typedef struct {
+    char     *name;     // -d: nombre de la tarea (NULL si no tiene)
+    char     *after;    // -d: valor de after: tal cual (hasta resolverlo)
+    double    cost;     // -d: duración estimada (segundos)
+    double    timeout;  // segundos (0 = sin límite)
+    int       retries;  // reintentos si falla
+    long long mem;      // bytes (0 = sin límite)
+    double    cpu;      // CPUs (0 = sin límite)
+} job_attrs_t;
+
+// Segundos con unidad opcional (ms, s, m, h). Devuelve -1 si no es válido.
+double parse_seconds(const char *text) {
+    static const struct { const char *unit; double secs; } units[] = {
+        { "", 1 }, { "ms", 1e-3 }, { "s", 1 }, { "m", 60 }, { "h", 3600 },
+    };
+    char *end;
+    double v = strtod(text, &end);
+    if (end == text || v < 0)
+        return -1;
+    for (size_t i = 0; i < sizeof(units) / sizeof(units[0]); i++)
+        if (strcmp(end, units[i].unit) == 0)
+            return v * units[i].secs;
+    return -1;
+}
+
+// Bytes con sufijo opcional K, M o G (potencias de 1024). -1 si no vale.
+long long parse_bytes(const char *text) {
+    char *end;
+    double v = strtod(text, &end);
+    if (end == text || v < 0)
+        return -1;
+    const char *suffixes = "KMG";
+    if (*end) {
+        const char *s = strchr(suffixes, toupper((unsigned char)*end));
+        if (!s || end[1] != '\0')
+            return -1;
+        v *= (double)(1LL << (10 * (s - suffixes + 1)));
+    }
+    return (long long)v;
+}
+
+/**
+ * parse_attrs:
+ *   Separa los atributos "clave:valor" (o "clave=valor") del principio de
+ *   la línea 'line', que se modifica, y los deja en *a. Devuelve el resto
+ *   de la línea (el comando) o NULL si un atributo no es válido (mensaje
+ *   impreso con el número de línea).
+ */
+char *parse_attrs(char *line, job_attrs_t *a, int lineno) {
+    static const char *const keys[] = {
+        "name", "after", "cost", "timeout", "retries", "mem", "cpu",
+    };
+    memset(a, 0, sizeof(*a));
+    a->cost = 1;
+
+    char *p = line;
+    for (;;) {
+        while (isspace((unsigned char)*p)) p++;
+        size_t key = 0, klen = 0;
+        for (; key < sizeof(keys) / sizeof(keys[0]); key++) {
+            klen = strlen(keys[key]);
+            if (strncmp(p, keys[key], klen) == 0 &&
+                (p[klen] == ':' || p[klen] == '='))
+                break;
+        }
+        if (key == sizeof(keys) / sizeof(keys[0]))
+            return p;
+
+        char *attr = p;
+        char *value = p + klen + 1;
+        p += strcspn(p, " \t");
+        if (*p)
+            *p++ = '\0';
+        if (*value == '\0') {
+            fprintf(stderr, "línea %d: atributo '%s' sin valor\n", lineno, attr);
+            return NULL;
+        }
+        char *end = NULL;
+        int bad = 0;
+        switch (key) {
+        case 0: a->name = value; break;
+        case 1: a->after = value; break;
+        case 2: bad = (a->cost = parse_seconds(value)) < 0; break;
+        case 3: bad = (a->timeout = parse_seconds(value)) <= 0; break;
+        case 4:
+            a->retries = strtol(value, &end, 10);
+            bad = *end != '\0' || a->retries < 0;
+            break;
+        case 5: bad = (a->mem = parse_bytes(value)) <= 0; break;
+        case 6:
+            a->cpu = strtod(value, &end);
+            bad = *end != '\0' || a->cpu <= 0;
+            break;
+        }
+        if (bad) {
+            fprintf(stderr, "línea %d: valor no válido en '%s'\n", lineno, attr);
+            return NULL;
+        }
+    }
+}
+
+// Qué se hace con la salida de los comandos de -s.
+typedef enum {
+    OUT_INHERIT,        // la heredan tal cual
+    OUT_PREFIX,         // -p
+    OUT_GROUP,          // -g
+    OUT_ORDERED,        // --ordered
+    OUT_CAPTURE,        // -o
+} output_mode_t;
+
+output_mode_t output_mode = OUT_INHERIT;
+const char *capture_dir;
+
+// Salida de un comando: tubería y la línea a medio recibir (-p) o el
+// destino del splice() (resto de modos).
+typedef struct {
+    int    fd;          // extremo de lectura (-1 si ya se cerró)
+    int    sink;        // memfd o fichero de -o (-1 si no hay)
+    char  *buf;
+    size_t len, cap;
+} stream_t;
+
+#define MAX_LINE (64 * 1024)   // una línea más larga se parte
+
+// Comando en marcha (un hueco de la tabla de comandos).
+typedef struct {
+    pid_t    pid;
+    int      cmdno;
+    int      pidfd;     // -1 si ya se recogió (o no hay pidfd)
+    int      status;
+    int      pending;   // proceso + tuberías que faltan por terminar
+    stream_t out[2];    // salida estándar y de error (si no se heredan)
+    char    *line;      // el comando, para -g, --ordered y -r; el búfer
+    size_t   linecap;   // es del hueco y se reutiliza
+    int      skipped_by; // con -d: no lanzado porque falló este comando
+    double   timeout;   // límites del comando (ver job_attrs_t)
+    long long mem;
+    int      retries;   // reintentos que quedan
+    int      attempts;  // intentos fallidos ya hechos
+    int      timed_out; // 1 = SIGTERM enviado, 2 = SIGKILL
+    int      oom;       // el kernel mató algo de su cgroup por memoria
+    int      cg;        // directorio de su hoja de cgroup, o -1
+    long long expire;   // tic de la rueda en que vence (si armed)
+    int      armed;     // está en la rueda de temporizadores
+    int      tnext, tprev; // lista de su casilla de la rueda
+    double   start;     // momento del lanzamiento (now_seconds())
+    double   wall;      // tiempo real hasta que se recogió el proceso
+    struct rusage ru;   // recursos consumidos (wait4())
+    int      next_free; // siguiente hueco libre (si está libre)
+} job_t;
+
+// Qué descriptor de un comando ha dado el evento: va en los 2 bits bajos
+// del dato de epoll, y el hueco en el resto. EV_TIMER es el timerfd de la
+// rueda (hueco 0).
+enum { EV_PROC, EV_STDOUT, EV_STDERR, EV_TIMER };
+
+// Tabla de comandos en marcha: huecos reutilizables con lista de libres.
+job_t *jobs;
+int    jobs_cap;
+int    jobs_free = -1;
+int    epfd;
+int    use_pidfd;
+
+// --ordered: comandos terminados esperando su turno. ordered_ring[n %
+// ordered_window] es el hueco del comando n más 1 (0 = aún no ha terminado).
+int *ordered_ring;
+int  ordered_window;
+int  next_print;        // primer comando que falta por escribir
+
+int job_alloc(void) {
+    if (jobs_free < 0) {
+        int ncap = jobs_cap ? jobs_cap * 2 : 64;
+        jobs = realloc(jobs, ncap * sizeof(job_t));
+        if (!jobs) { perror("realloc"); exit(EXIT_FAILURE); }
+        for (int i = ncap - 1; i >= jobs_cap; i--) {
+            jobs[i].pending = 0;
+            jobs[i].line = NULL;
+            jobs[i].linecap = 0;
+            jobs[i].next_free = jobs_free;
+            jobs_free = i;
+        }
+        jobs_cap = ncap;
+    }
+    int slot = jobs_free;
+    jobs_free = jobs[slot].next_free;
+    jobs[slot].skipped_by = -1;
+    return slot;
+}
+
+void job_release(int slot) {
+    jobs[slot].next_free = jobs_free;
+    jobs_free = slot;
+}
+
+// Copia el texto del comando en el búfer del hueco.
+void job_set_line(int slot, const char *text) {
+    size_t len = strlen(text) + 1;
+    if (len > jobs[slot].linecap) {
+        char *bigger = realloc(jobs[slot].line, len);
+        if (!bigger) { perror("realloc"); exit(EXIT_FAILURE); }
+        jobs[slot].line = bigger;
+        jobs[slot].linecap = len;
+    }
+    memcpy(jobs[slot].line, text, len);
+}
+
+void watch_fd(int fd, int slot, int kind) {
+    struct epoll_event ev = {
+        .events = EPOLLIN,
+        .data.u64 = (uint64_t)slot << 2 | kind,
+    };
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        perror("epoll_ctl");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Quita fd de epoll y lo cierra. close() solo lo quitaría si no quedase
+// ninguna otra referencia al fichero abierto, y eso no se puede asegurar.
+void unwatch_close(int fd) {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+    close(fd);
+}
+
+/**
+ * raise_fd_limit:
+ *   Sube el límite blando de descriptores abiertos hasta el duro: cada
+ *   comando en marcha puede ocupar tres (pidfd y dos tuberías).
+ */
+void raise_fd_limit(void) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+// cgroup v2 para mem= y cpu=: cada comando con límites va en su hoja
+// <nuestro cgroup>/run_commands.<pid>/<n>.
+int   cg_state;         // 0 = sin probar, 1 = disponible, -1 = no disponible
+int   cg_root = -1;     // directorio run_commands.<pid>
+char *cg_root_path;
+int   cg_memory, cg_cpu; // controladores que tienen las hojas
+
+// Escribe 'text' en el fichero 'name' del directorio de cgroup 'dir'.
+int cg_write(int dir, const char *name, const char *text) {
+    int fd = openat(dir, name, O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ssize_t n = write(fd, text, strlen(text));
+    int err = errno;
+    close(fd);
+    errno = err;
+    return n < 0 ? -1 : 0;
+}
+
+// ¿Aparece la palabra 'word' en el fichero 'name' de 'dir'?
+int cg_has(int dir, const char *name, const char *word) {
+    char buf[512];
+    int fd = openat(dir, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0)
+        return 0;
+    buf[n] = '\0';
+    for (char *tok = strtok(buf, " \n"); tok; tok = strtok(NULL, " \n"))
+        if (strcmp(tok, word) == 0)
+            return 1;
+    return 0;
+}
+
+/**
+ * cg_find:
+ *   Devuelve (malloc) la ruta de nuestro cgroup v2: el punto de montaje
+ *   de cgroup2 (de /proc/self/mountinfo) más la ruta de la línea "0::"
+ *   de /proc/self/cgroup. NULL si no hay cgroup v2.
+ */
+char *cg_find(void) {
+    char *line = NULL, *mnt = NULL, *rel = NULL, *path = NULL;
+    size_t cap = 0;
+    FILE *fp = fopen("/proc/self/mountinfo", "r");
+    while (fp && !mnt && getline(&line, &cap, fp) != -1) {
+        // id padre maj:min raíz punto opciones... - tipo origen opciones
+        char point[4096], type[64];
+        const char *dash = strstr(line, " - ");
+        if (dash && sscanf(dash, " - %63s", type) == 1 &&
+            strcmp(type, "cgroup2") == 0 &&
+            sscanf(line, "%*s %*s %*s %*s %4095s", point) == 1)
+            mnt = strdup(point);
+    }
+    if (fp)
+        fclose(fp);
+    fp = fopen("/proc/self/cgroup", "r");
+    while (fp && !rel && getline(&line, &cap, fp) != -1)
+        if (strncmp(line, "0::", 3) == 0) {
+            line[strcspn(line, "\n")] = '\0';
+            rel = strdup(line + 3);
+        }
+    if (fp)
+        fclose(fp);
+    if (mnt && rel) {
+        size_t len = strlen(mnt) + strlen(rel) + 1;
+        if ((path = malloc(len)))
+            snprintf(path, len, "%s%s", mnt, strcmp(rel, "/") ? rel : "");
+    }
+    free(line);
+    free(mnt);
+    free(rel);
+    return path;
+}
+
+/**
+ * cg_setup:
+ *   Crea run_commands.<pid> dentro de nuestro cgroup v2 y activa para sus
+ *   hijas los controladores memory y cpu que se puedan. Si no hay cgroup
+ *   v2 o no se puede escribir en él, avisa y los límites se aplican como
+ *   se pueda sin cgroups (ver limit_warning()).
+ */
+void cg_setup(void) {
+    cg_state = -1;
+    char *base = cg_find();
+    if (!base) {
+        fprintf(stderr, "Aviso: no hay cgroup v2; mem= y cpu= sin cgroups\n");
+        return;
+    }
+    int basefd = open(base, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    size_t len = strlen(base) + 64;
+    cg_root_path = malloc(len);
+    if (!cg_root_path) { perror("malloc"); exit(EXIT_FAILURE); }
+    snprintf(cg_root_path, len, "%s/run_commands.%d", base, (int)getpid());
+    if (basefd < 0 || mkdir(cg_root_path, 0755) < 0 ||
+        (cg_root = open(cg_root_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+        fprintf(stderr, "Aviso: no se puede crear un cgroup en %s (%s); "
+                "mem= y cpu= sin cgroups\n", base, strerror(errno));
+        if (basefd >= 0)
+            close(basefd);
+        free(base);
+        free(cg_root_path);
+        cg_root_path = NULL;
+        return;
+    }
+    // Nuestro cgroup tiene procesos, así que en él solo se puede activar
+    // un controlador si ya lo está o si es la raíz
+    static const char *const ctl[] = { "memory", "cpu" };
+    int *have[] = { &cg_memory, &cg_cpu };
+    for (int i = 0; i < 2; i++) {
+        char plus[16];
+        snprintf(plus, sizeof(plus), "+%s", ctl[i]);
+        if (!cg_has(basefd, "cgroup.subtree_control", ctl[i]) &&
+            cg_has(basefd, "cgroup.controllers", ctl[i]))
+            cg_write(basefd, "cgroup.subtree_control", plus);
+        *have[i] = cg_has(cg_root, "cgroup.controllers", ctl[i]) &&
+                   cg_write(cg_root, "cgroup.subtree_control", plus) == 0;
+    }
+    close(basefd);
+    free(base);
+    cg_state = 1;
+}
+
+// Avisa (una vez) de los límites que no se pueden aplicar con cgroups.
+void limit_warning(const job_attrs_t *a) {
+    static int warned_mem, warned_cpu;
+    if (a->mem && !cg_memory && !warned_mem) {
+        warned_mem = 1;
+        fprintf(stderr, "Aviso: sin el controlador memory de cgroup v2, mem= "
+                "se aplica con RLIMIT_AS a cada proceso\n");
+    }
+    if (a->cpu > 0 && !cg_cpu && !warned_cpu) {
+        warned_cpu = 1;
+        fprintf(stderr, "Aviso: sin el controlador cpu de cgroup v2, cpu= "
+                "no tiene efecto\n");
+    }
+}
+
+/**
+ * cg_leaf:
+ *   Crea la hoja de cgroup del comando 'cmdno' con sus límites. Devuelve
+ *   su directorio o -1 si no hay cgroups (o no se pudo crear).
+ */
+int cg_leaf(int cmdno, const job_attrs_t *a) {
+    if (cg_state == 0)
+        cg_setup();
+    limit_warning(a);
+    if (cg_state < 0)
+        return -1;
+
+    char name[16], value[64];
+    snprintf(name, sizeof(name), "%d", cmdno);
+    if (mkdirat(cg_root, name, 0755) < 0 && errno != EEXIST) {
+        fprintf(stderr, "mkdir %s/%s: %s\n", cg_root_path, name, strerror(errno));
+        return -1;
+    }
+    int dir = openat(cg_root, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir < 0)
+        return -1;
+    if (a->mem && cg_memory) {
+        snprintf(value, sizeof(value), "%lld", a->mem);
+        if (cg_write(dir, "memory.max", value) < 0)
+            perror("memory.max");
+        cg_write(dir, "memory.swap.max", "0");  // puede no haber swap
+    }
+    if (a->cpu > 0 && cg_cpu) {
+        snprintf(value, sizeof(value), "%.0f 100000", a->cpu * 100000);
+        if (cg_write(dir, "cpu.max", value) < 0)
+            perror("cpu.max");
+    }
+    return dir;
+}
+
+// ¿Ha matado el kernel algún proceso de la hoja por falta de memoria?
+int cg_oom(int dir) {
+    char buf[1024];
+    int fd = openat(dir, "memory.events", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0)
+        return 0;
+    buf[n] = '\0';
+    const char *p = strstr(buf, "oom_kill ");
+    return p && atoll(p + 9) > 0;
+}
+
+// Borra la hoja 'name' matando antes lo que quede en ella. Un proceso
+// matado tarda un poco en salir del cgroup: se reintenta unas veces.
+void cg_remove(const char *name) {
+    int dir = openat(cg_root, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir >= 0) {
+        cg_write(dir, "cgroup.kill", "1");
+        close(dir);
+    }
+    for (int i = 0; i < 50; i++) {
+        if (unlinkat(cg_root, name, AT_REMOVEDIR) == 0 || errno != EBUSY)
+            return;
+        usleep(1000);
+    }
+    fprintf(stderr, "No se pudo borrar el cgroup %s/%s\n", cg_root_path, name);
+}
+
+// Cierra la hoja de un comando terminado (cuando ya no se va a reintentar).
+void cg_release(int slot) {
+    job_t *job = &jobs[slot];
+    if (job->cg < 0)
+        return;
+    char name[16];
+    snprintf(name, sizeof(name), "%d", job->cmdno);
+    job->oom = cg_memory && cg_oom(job->cg);
+    close(job->cg);
+    job->cg = -1;
+    cg_remove(name);
+}
+
+// Borra run_commands.<pid> (y las hojas que quedasen) al terminar.
+void cg_cleanup(void) {
+    if (cg_state <= 0)
+        return;
+    DIR *d = fdopendir(dup(cg_root));
+    struct dirent *e;
+    while (d && (e = readdir(d)) != NULL)
+        if (e->d_type == DT_DIR && e->d_name[0] != '.')
+            cg_remove(e->d_name);
+    if (d)
+        closedir(d);
+    close(cg_root);
+    if (rmdir(cg_root_path) < 0)
+        fprintf(stderr, "rmdir %s: %s\n", cg_root_path, strerror(errno));
+    free(cg_root_path);
+    cg_root_path = NULL;
+    cg_root = -1;
+    cg_state = 0;
+}
+
+// Rueda de temporizadores para timeout=: un solo timerfd periódico (solo
+// armado si hay algún temporizador) y WHEEL_SLOTS casillas de WHEEL_TICK
+// segundos. Un comando va en la casilla de su tic de vencimiento módulo
+// WHEEL_SLOTS; los que vencen dentro de más de una vuelta se quedan en la
+// casilla hasta que llega su tic. Añadir y quitar es O(1).
+#define WHEEL_SLOTS 256
+#define WHEEL_TICK  0.1
+#define KILL_GRACE  2.0         // de SIGTERM a SIGKILL
+
+int       wheel[WHEEL_SLOTS];   // primer hueco de cada casilla, -1 = vacía
+long long wheel_tick;           // último tic procesado
+double    wheel_base;           // instante del tic 0
+int       wheel_fd = -1;
+int       timers_armed;
+
+long long wheel_now(void) {
+    return (long long)((now_seconds() - wheel_base) / WHEEL_TICK);
+}
+
+// Arranca o para el timerfd.
+void wheel_arm(int on) {
+    struct itimerspec its = { { 0, 0 }, { 0, 0 } };
+    if (on) {
+        its.it_interval.tv_nsec = WHEEL_TICK * 1e9;
+        its.it_value = its.it_interval;
+    }
+    if (timerfd_settime(wheel_fd, 0, &its, NULL) < 0)
+        perror("timerfd_settime");
+}
+
+void timer_add(int slot, double secs) {
+    job_t *job = &jobs[slot];
+    long long ticks = secs / WHEEL_TICK + 0.999;     // redondeo hacia arriba
+    job->expire = wheel_now() + (ticks > 0 ? ticks : 1);
+    int *head = &wheel[job->expire % WHEEL_SLOTS];
+    job->tprev = -1;
+    job->tnext = *head;
+    if (*head >= 0)
+        jobs[*head].tprev = slot;
+    *head = slot;
+    job->armed = 1;
+    if (timers_armed++ == 0)
+        wheel_arm(1);
+}
+
+void timer_del(int slot) {
+    job_t *job = &jobs[slot];
+    if (!job->armed)
+        return;
+    if (job->tprev >= 0)
+        jobs[job->tprev].tnext = job->tnext;
+    else
+        wheel[job->expire % WHEEL_SLOTS] = job->tnext;
+    if (job->tnext >= 0)
+        jobs[job->tnext].tprev = job->tprev;
+    job->armed = 0;
+    if (--timers_armed == 0)
+        wheel_arm(0);
+}
+
+/**
+ * timeout_fire:
+ *   El comando ha superado su timeout=: se le manda SIGTERM a él y a su
+ *   grupo de procesos y, si sigue ahí al cabo de KILL_GRACE segundos,
+ *   SIGKILL (a toda su hoja de cgroup si la tiene, con cgroup.kill).
+ */
+void timeout_fire(int slot) {
+    job_t *job = &jobs[slot];
+    if (job->timed_out == 0) {
+        job->timed_out = 1;
+        kill(-job->pid, SIGTERM);
+        timer_add(slot, KILL_GRACE);
+        return;
+    }
+    job->timed_out = 2;
+    if (job->cg < 0 || cg_write(job->cg, "cgroup.kill", "1") < 0)
+        kill(-job->pid, SIGKILL);
+}
+
+// El timerfd ha vencido: procesar las casillas de los tics pasados.
+void wheel_expire(void) {
+    uint64_t overruns;
+    if (read(wheel_fd, &overruns, sizeof(overruns)) < 0 && errno != EAGAIN)
+        perror("read timerfd");
+    long long now = wheel_now();
+    long long from = wheel_tick + 1;
+    if (now - from >= WHEEL_SLOTS)
+        from = now - WHEEL_SLOTS + 1;   // una vuelta entera ya lo cubre todo
+    for (long long t = from; t <= now; t++) {
+        int slot = wheel[t % WHEEL_SLOTS];
+        while (slot >= 0) {
+            int next = jobs[slot].tnext;
+            if (jobs[slot].expire <= now) {
+                timer_del(slot);
+                timeout_fire(slot);
+            }
+            slot = next;
+        }
+    }
+    if (now > wheel_tick)
+        wheel_tick = now;
+}
+
+/**
+ * open_sink:
+ *   Crea el destino de la salida k (0 = estándar, 1 = error) del comando
+ *   'cmdno': un memfd o, con -o, el fichero dir/cmdno.out o .err.
+ *   Devuelve el descriptor o -1 (mensaje impreso).
+ */
+int open_sink(int cmdno, int k) {
+    const char *ext = k == 0 ? "out" : "err";
+    char name[64];
+    int fd;
+
+    if (output_mode == OUT_CAPTURE) {
+        size_t len = strlen(capture_dir) + sizeof(name);
+        char *path = malloc(len);
+        if (!path) { perror("malloc"); exit(EXIT_FAILURE); }
+        snprintf(path, len, "%s/%d.%s", capture_dir, cmdno, ext);
+        fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+            fprintf(stderr, "No se pudo crear '%s': %s\n", path, strerror(errno));
+        free(path);
+    } else {
+        snprintf(name, sizeof(name), "run_commands-%d.%s", cmdno, ext);
+        fd = memfd_create(name, MFD_CLOEXEC);
+        if (fd < 0)
+            perror("memfd_create");
+    }
+    return fd;
+}
+
+/**
+ * spawn_job:
+ *   Lanza 'argv' en el hueco 'slot' (ya con sus destinos de salida, límites
+ *   y hoja de cgroup) y lo registra en epoll y, si tiene timeout=, en la
+ *   rueda. Se usa para el primer intento y para los reintentos. Devuelve 0
+ *   o -1 si no se pudo lanzar (mensaje impreso).
+ */
+int spawn_job(int slot, char **argv) {
+    job_t *job = &jobs[slot];
+    int pipes[2][2] = { { -1, -1 }, { -1, -1 } };
+    int redirect[2];
+    int use_pipes = output_mode != OUT_INHERIT;
+    placement_t place = { job->timeout > 0, -1 };
+    pid_t pid = -1;
+
+    for (int k = 0; use_pipes && k < 2; k++) {
+        if (pipe2(pipes[k], O_CLOEXEC) < 0) {
+            perror("pipe2");
+            goto fail;
+        }
+        redirect[k] = pipes[k][1];
+    }
+    if (job->cg >= 0 &&
+        (place.cgroup_procs = openat(job->cg, "cgroup.procs",
+                                     O_WRONLY | O_CLOEXEC)) < 0) {
+        perror("cgroup.procs");
+        goto fail;
+    }
+
+    // Antes de lanzar: posix_spawn() no vuelve hasta que el hijo ha hecho exec
+    double start = now_seconds();
+    pid = launch_command(argv, use_pipes ? redirect : NULL, &place);
+
+fail:
+    if (place.cgroup_procs >= 0)
+        close(place.cgroup_procs);
+    // El padre no escribe en las tuberías: cerrar su extremo para ver EOF
+    // cuando el hijo acabe.
+    for (int k = 0; k < 2; k++) {
+        if (pipes[k][1] >= 0)
+            close(pipes[k][1]);
+        if (pid < 0 && pipes[k][0] >= 0)
+            close(pipes[k][0]);
+    }
+    if (pid < 0)
+        return -1;
+
+    // Sin el controlador memory, el límite va a cada proceso (lo heredan
+    // sus hijos). Se pone ya lanzado: el exec ya pasó, pero lo que reserve
+    // a partir de ahora cuenta.
+    if (job->mem && !cg_memory) {
+        struct rlimit rl = { job->mem, job->mem };
+        if (prlimit(pid, RLIMIT_AS, &rl, NULL) < 0)
+            perror("prlimit");
+    }
+
+    job->pid = pid;
+    job->status = 0;
+    job->pending = 1;
+    job->pidfd = -1;
+    job->start = start;
+    job->timed_out = 0;
+    if (use_pidfd) {
+        job->pidfd = syscall(SYS_pidfd_open, pid, 0);
+        if (job->pidfd < 0) {
+            perror("pidfd_open");
+            exit(EXIT_FAILURE);
+        }
+        fcntl(job->pidfd, F_SETFD, FD_CLOEXEC);
+        watch_fd(job->pidfd, slot, EV_PROC);
+    }
+    for (int k = 0; use_pipes && k < 2; k++) {
+        stream_t *st = &job->out[k];
+        st->fd = pipes[k][0];
+        st->len = 0;
+        job->pending++;
+        watch_fd(st->fd, slot, k == 0 ? EV_STDOUT : EV_STDERR);
+    }
+    if (job->timeout > 0)
+        timer_add(slot, job->timeout);
+    return 0;
+}
+
+/**
+ * start_job:
+ *   Ocupa un hueco para el comando número 'cmdno' con atributos 'a', le
+ *   prepara los destinos de salida y la hoja de cgroup si hacen falta, y
+ *   lo lanza. Devuelve su hueco, o -1 si no se pudo lanzar (mensaje
+ *   impreso).
+ */
+int start_job(char **argv, int cmdno, const job_attrs_t *a) {
+    int slot = job_alloc();
+    job_t *job = &jobs[slot];
+    int use_sinks = output_mode != OUT_INHERIT && output_mode != OUT_PREFIX;
+
+    job->cmdno = cmdno;
+    job->timeout = a->timeout;
+    job->mem = a->mem;
+    job->retries = a->retries;
+    job->attempts = 0;
+    job->oom = 0;
+    job->cg = -1;
+    job->armed = 0;
+    for (int k = 0; k < 2; k++) {
+        job->out[k].fd = -1;
+        job->out[k].buf = NULL;
+        job->out[k].len = job->out[k].cap = 0;
+        job->out[k].sink = use_sinks ? open_sink(cmdno, k) : -1;
+        if (use_sinks && job->out[k].sink < 0)
+            goto fail;
+    }
+    // Hoja de cgroup para los límites y para matar todo su árbol al vencer
+    if (a->mem || a->cpu > 0 || a->timeout > 0)
+        job->cg = cg_leaf(cmdno, a);
+    if (spawn_job(slot, argv) == 0)
+        return slot;
+
+fail:
+    for (int k = 0; k < 2; k++)
+        if (jobs[slot].out[k].sink >= 0)
+            close(jobs[slot].out[k].sink);
+    cg_release(slot);
+    job_release(slot);
+    return -1;
+}
+
+// Escribe un trozo de salida de un comando con su prefijo.
+void emit_line(FILE *out, int cmdno, const char *data, size_t len) {
+    fprintf(out, "[#%d] ", cmdno);
+    fwrite(data, 1, len, out);
+    if (len == 0 || data[len - 1] != '\n')
+        fputc('\n', out);
+}
+
+int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * splice_stream:
+ *   Pasa lo disponible en la tubería de un comando a su destino con
+ *   splice(). Si el destino no admite splice() (EINVAL) se copia con
+ *   read()/write(). Devuelve 1 en EOF (tubería cerrada) o 0.
+ */
+int splice_stream(stream_t *st) {
+    ssize_t n = splice(st->fd, NULL, st->sink, NULL, 1 << 20,
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n < 0 && errno == EINVAL) {
+        char buf[64 * 1024];
+        n = read(st->fd, buf, sizeof(buf));
+        if (n > 0 && write_all(st->sink, buf, n) < 0)
+            perror("write");
+    }
+    if (n < 0 && (errno == EINTR || errno == EAGAIN))
+        return 0;
+    if (n < 0)
+        perror("splice");
+    if (n <= 0) {
+        unwatch_close(st->fd);
+        st->fd = -1;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * drain_stream:
+ *   Lee lo disponible de una tubería de un comando: con -p escribe las
+ *   líneas completas; en los demás modos lo pasa a su destino. Devuelve 1
+ *   si la tubería ha llegado a EOF (y se ha cerrado, escribiendo lo que
+ *   quedase) o 0.
+ */
+int drain_stream(job_t *job, int k) {
+    stream_t *st = &job->out[k];
+    FILE *out = k == 0 ? stdout : stderr;
+
+    if (st->sink >= 0)
+        return splice_stream(st);
+
+    if (st->cap - st->len < 4096) {
+        st->cap = st->cap ? st->cap * 2 : 8192;
+        st->buf = realloc(st->buf, st->cap);
+        if (!st->buf) { perror("realloc"); exit(EXIT_FAILURE); }
+    }
+    ssize_t n = read(st->fd, st->buf + st->len, st->cap - st->len);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN))
+        return 0;
+    if (n <= 0) {
+        if (st->len > 0)
+            emit_line(out, job->cmdno, st->buf, st->len);
+        unwatch_close(st->fd);
+        st->fd = -1;
+        free(st->buf);
+        st->buf = NULL;
+        st->len = st->cap = 0;
+        return 1;
+    }
+    st->len += n;
+
+    // Escribir las líneas completas y dejar el resto para la próxima vez
+    size_t start = 0;
+    for (;;) {
+        char *nl = memchr(st->buf + start, '\n', st->len - start);
+        if (!nl)
+            break;
+        size_t end = nl - st->buf + 1;
+        emit_line(out, job->cmdno, st->buf + start, end - start);
+        start = end;
+    }
+    if (st->len - start >= MAX_LINE) {
+        emit_line(out, job->cmdno, st->buf + start, st->len - start);
+        start = st->len;
+    }
+    memmove(st->buf, st->buf + start, st->len - start);
+    st->len -= start;
+    return 0;
+}
+
+/**
+ * copy_sink:
+ *   Escribe en 'out' todo lo guardado en el memfd 'fd', con sendfile() (sin
+ *   pasar por memoria de usuario) o, si no se puede, con pread()/write().
+ */
+void copy_sink(int fd, int out) {
+    off_t off = 0;
+    for (;;) {
+        ssize_t n = sendfile(out, fd, &off, 1 << 30);
+        if (n > 0)
+            continue;
+        if (n == 0)
+            return;
+        if (errno == EINTR || errno == EAGAIN)
+            continue;
+        if (errno != EINVAL && errno != ENOSYS)
+            break;
+        char buf[64 * 1024];
+        while ((n = pread(fd, buf, sizeof(buf), off)) > 0) {
+            if (write_all(out, buf, n) < 0)
+                break;
+            off += n;
+        }
+        if (n == 0)
+            return;
+        break;
+    }
+    perror("sendfile");
+}
+
+// Histograma logarítmico-lineal de valores en microsegundos: los valores
+// menores que 2 * HIST_SUB tienen cubo propio y a partir de ahí cada
+// potencia de dos se parte en HIST_SUB cubos.
+#define HIST_SUB_BITS 5
+#define HIST_SUB      (1 << HIST_SUB_BITS)
+#define HIST_SIZE     ((64 - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+typedef struct {
+    long long counts[HIST_SIZE];
+    long long total, min, max;
+    double    sum;
+} histogram_t;
+
+int hist_index(unsigned long long v) {
+    if (v < 2 * HIST_SUB)
+        return v;
+    int shift = 63 - __builtin_clzll(v) - HIST_SUB_BITS;
+    return ((shift + 1) << HIST_SUB_BITS) + (v >> shift) - HIST_SUB;
+}
+
+// Mayor valor que cae en el cubo idx.
+unsigned long long hist_upper(int idx) {
+    if (idx < 2 * HIST_SUB)
+        return idx;
+    int shift = (idx >> HIST_SUB_BITS) - 1;
+    return ((unsigned long long)((idx & (HIST_SUB - 1)) + HIST_SUB + 1) << shift) - 1;
+}
+
+void hist_record(histogram_t *h, long long v) {
+    if (v < 0)
+        v = 0;
+    h->counts[hist_index(v)]++;
+    if (h->total == 0 || v < h->min)
+        h->min = v;
+    if (v > h->max)
+        h->max = v;
+    h->total++;
+    h->sum += v;
+}
+
+// Valor por debajo del cual queda el tanto por ciento 'pct' de los datos.
+long long hist_percentile(const histogram_t *h, double pct) {
+    long long rank = (long long)(pct / 100.0 * h->total + 0.5);
+    long long seen = 0;
+    if (rank < 1)
+        rank = 1;
+    for (int i = 0; i < HIST_SIZE; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            long long v = hist_upper(i);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+// Escribe 'us' microsegundos con la unidad adecuada.
+const char *fmt_usec(char *buf, size_t len, long long us) {
+    if (us < 1000)
+        snprintf(buf, len, "%lld us", us);
+    else if (us < 1000000)
+        snprintf(buf, len, "%.3g ms", us / 1e3);
+    else
+        snprintf(buf, len, "%.3g s", us / 1e6);
+    return buf;
+}
+
+long long tv_usec(struct timeval tv) {
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+#define SLOWEST 5       // comandos más lentos que se listan en el resumen
+
+// Resumen de -r.
+typedef struct {
+    histogram_t wall, cpu;
+    long        max_rss;        // KiB
+    int         max_rss_cmd;
+    long long   nvcsw, nivcsw;
+    int         failed;         // status distinto de 0
+    int         not_launched;
+    int         skipped;        // -d
+    struct { long long wall; int cmdno; char *line; } slowest[SLOWEST];
+    int         nslowest;
+} summary_t;
+
+int rusage_report;      // -r
+summary_t summary;
+
+/**
+ * account_job:
+ *   Escribe la línea de recursos de un comando y lo suma al resumen.
+ */
+void account_job(const job_t *job) {
+    long long wall = job->wall * 1e6;
+    long long user = tv_usec(job->ru.ru_utime);
+    long long sys = tv_usec(job->ru.ru_stime);
+    char b1[32], b2[32], b3[32];
+
+    printf("@@ Command #%d resources: wall %s, user %s, sys %s, "
+           "max RSS %ld KiB, ctx switches %ld/%ld (vol/invol)\n",
+           job->cmdno, fmt_usec(b1, sizeof(b1), wall),
+           fmt_usec(b2, sizeof(b2), user), fmt_usec(b3, sizeof(b3), sys),
+           job->ru.ru_maxrss, job->ru.ru_nvcsw, job->ru.ru_nivcsw);
+
+    summary_t *sm = &summary;
+    hist_record(&sm->wall, wall);
+    hist_record(&sm->cpu, user + sys);
+    if (job->ru.ru_maxrss > sm->max_rss) {
+        sm->max_rss = job->ru.ru_maxrss;
+        sm->max_rss_cmd = job->cmdno;
+    }
+    sm->nvcsw += job->ru.ru_nvcsw;
+    sm->nivcsw += job->ru.ru_nivcsw;
+    if (job->status != 0)
+        sm->failed++;
+
+    // Los más lentos, ordenados de mayor a menor (inserción: son pocos)
+    int i = sm->nslowest < SLOWEST ? sm->nslowest++ : SLOWEST;
+    if (i == SLOWEST) {
+        if (wall <= sm->slowest[SLOWEST - 1].wall)
+            return;
+        free(sm->slowest[--i].line);
+    }
+    for (; i > 0 && sm->slowest[i - 1].wall < wall; i--)
+        sm->slowest[i] = sm->slowest[i - 1];
+    sm->slowest[i].wall = wall;
+    sm->slowest[i].cmdno = job->cmdno;
+    sm->slowest[i].line = strdup(job->line ? job->line : "");
+}
+
+// Percentiles y barras por potencia de dos de un histograma.
+void print_histogram(const char *name, const histogram_t *h) {
+    char b[5][32];
+    printf("@@   %-4s: min %s, p50 %s, p95 %s, p99 %s, max %s\n", name,
+           fmt_usec(b[0], sizeof(b[0]), h->min),
+           fmt_usec(b[1], sizeof(b[1]), hist_percentile(h, 50)),
+           fmt_usec(b[2], sizeof(b[2]), hist_percentile(h, 95)),
+           fmt_usec(b[3], sizeof(b[3]), hist_percentile(h, 99)),
+           fmt_usec(b[4], sizeof(b[4]), h->max));
+
+    // Agrupado por potencias de dos para que quepa en pantalla
+    long long rows[63] = { 0 }, top = 0;
+    for (int i = 0; i < HIST_SIZE; i++) {
+        if (h->counts[i] == 0)
+            continue;
+        unsigned long long v = hist_upper(i);
+        int r = v ? 64 - __builtin_clzll(v) : 0;
+        if (r > 62)
+            r = 62;
+        rows[r] += h->counts[i];
+        if (rows[r] > top)
+            top = rows[r];
+    }
+    for (int r = 0; r < 63; r++) {
+        if (rows[r] == 0)
+            continue;
+        int bar = (rows[r] * 40 + top - 1) / top;
+        printf("@@     < %-8s %8lld %.*s\n",
+               fmt_usec(b[0], sizeof(b[0]), 1LL << r), rows[r],
+               bar, "########################################");
+    }
+}
+
+// Resumen final de -r (con -s).
+void print_summary(double elapsed) {
+    summary_t *sm = &summary;
+    char b[32];
+
+    printf("@@ Summary: %lld commands run, %d failed, %d not launched, %d skipped, "
+           "%s in total\n",
+           sm->wall.total, sm->failed, sm->not_launched, sm->skipped,
+           fmt_usec(b, sizeof(b), elapsed * 1e6));
+    if (sm->wall.total == 0)
+        return;
+    print_histogram("wall", &sm->wall);
+    print_histogram("cpu", &sm->cpu);
+    printf("@@   max RSS %ld KiB (command #%d), ctx switches %lld/%lld (vol/invol)\n",
+           sm->max_rss, sm->max_rss_cmd, sm->nvcsw, sm->nivcsw);
+    printf("@@   slowest:\n");
+    for (int i = 0; i < sm->nslowest; i++) {
+        printf("@@     #%-5d %10s  %s\n", sm->slowest[i].cmdno,
+               fmt_usec(b, sizeof(b), sm->slowest[i].wall),
+               sm->slowest[i].line);
+        free(sm->slowest[i].line);
+    }
+    sm->nslowest = 0;
+}
+
+/**
+ * report_job:
+ *   Informa de un comando terminado y libera su hueco. Con -g y --ordered
+ *   escribe antes su línea "Running" y su salida guardada. Un comando que
+ *   no se pudo lanzar (pid < 0) solo tiene línea "Running", y uno que no se
+ *   lanzó por una dependencia fallida (-d), la línea "skipped".
+ */
+void report_job(int slot) {
+    job_t *job = &jobs[slot];
+    int grouped = output_mode == OUT_GROUP || output_mode == OUT_ORDERED;
+
+    if (job->skipped_by >= 0) {
+        printf("@@ Command #%d skipped (command #%d failed): %s\n",
+               job->cmdno, job->skipped_by, job->line);
+        summary.skipped++;
+        job_release(slot);
+        return;
+    }
+    if (grouped) {
+        printf("@@ Running command #%d: %s\n", job->cmdno, job->line);
+        fflush(stdout);
+    }
+    for (int k = 0; job->pid > 0 && k < 2; k++) {
+        if (job->out[k].sink < 0)
+            continue;
+        if (grouped)
+            copy_sink(job->out[k].sink, k == 0 ? STDOUT_FILENO : STDERR_FILENO);
+        close(job->out[k].sink);
+    }
+    if (job->pid > 0 && grouped && job->attempts > 0)
+        printf("@@ Command #%d retried %d times\n", job->cmdno, job->attempts);
+    if (job->timed_out)
+        printf("@@ Command #%d timed out after %.1f s%s\n", job->cmdno,
+               job->timeout, job->timed_out > 1 ? " (killed)" : "");
+    if (job->oom)
+        printf("@@ Command #%d hit its memory limit (OOM kill)\n", job->cmdno);
+    if (job->pid > 0) {
+        printf("@@ Command #%d terminated (pid: %d, status: %d)\n",
+               job->cmdno, job->pid, job->status);
+        if (rusage_report)
+            account_job(job);
+    }
+    job_release(slot);
+}
+
+/**
+ * finish_job:
+ *   Un comando ha terminado del todo. Con --ordered se guarda en el anillo
+ *   y se escriben todos los que ya tienen su turno; en otro caso se
+ *   escribe ya.
+ */
+void finish_job(int slot) {
+    if (output_mode != OUT_ORDERED) {
+        report_job(slot);
+        return;
+    }
+    ordered_ring[jobs[slot].cmdno % ordered_window] = slot + 1;
+    int *next;
+    while (*(next = &ordered_ring[next_print % ordered_window]) != 0) {
+        int ready = *next - 1;
+        *next = 0;
+        report_job(ready);
+        next_print++;
+    }
+}
+
+/**
+ * placeholder_job:
+ *   Ocupa un hueco sin proceso para el comando 'cmdno', que no se lanzó
+ *   (skipped_by = -1) o se saltó por el fallo de 'skipped_by', y lo da por
+ *   terminado: así sale en su turno con --ordered.
+ */
+void placeholder_job(int cmdno, const char *line, int skipped_by) {
+    int slot = job_alloc();
+    jobs[slot].pid = -1;
+    jobs[slot].cmdno = cmdno;
+    jobs[slot].skipped_by = skipped_by;
+    jobs[slot].timed_out = 0;
+    jobs[slot].oom = 0;
+    job_set_line(slot, line);
+    finish_job(slot);
+}
+
+// Tarea del grafo de -d.
+typedef struct {
+    char   *text;       // copia de la línea; cmd y los atributos apuntan dentro
+    char   *cmd;        // la línea sin los atributos
+    char  **argv;       // cmd ya dividido (un bloque, ver parse_command())
+    job_attrs_t attrs;
+    int    *next;       // tareas que dependen de esta
+    int     nnext, capnext;
+    int     waiting;    // dependencias que faltan por terminar
+    int     skipped;
+    double  rank;       // camino crítico desde esta tarea hasta el final
+} dag_task_t;
+
+// Grafo de -d y su cola de tareas listas (montículo por rank).
+typedef struct {
+    dag_task_t *tasks;
+    int         ntasks, cap;
+    int        *ready;
+    int         nready;
+} dag_t;
+
+dag_t dag;
+int   dag_mode;         // -d
+
+// Añade la arista 'from' -> 'to' ('to' depende de 'from').
+void dag_edge(int from, int to) {
+    dag_task_t *t = &dag.tasks[from];
+    if (t->nnext == t->capnext) {
+        t->capnext = t->capnext ? t->capnext * 2 : 4;
+        t->next = realloc(t->next, t->capnext * sizeof(int));
+        if (!t->next) { perror("realloc"); exit(EXIT_FAILURE); }
+    }
+    t->next[t->nnext++] = to;
+    dag.tasks[to].waiting++;
+}
+
+/**
+ * dag_parse_line:
+ *   Separa los atributos del principio de la línea (parse_attrs()) y añade
+ *   la tarea.
+ *   Devuelve 0 o -1 si un atributo no es válido (mensaje impreso).
+ */
+int dag_parse_line(char *line, int lineno) {
+    if (dag.ntasks == dag.cap) {
+        dag.cap = dag.cap ? dag.cap * 2 : 64;
+        dag.tasks = realloc(dag.tasks, dag.cap * sizeof(dag_task_t));
+        if (!dag.tasks) { perror("realloc"); exit(EXIT_FAILURE); }
+    }
+    dag_task_t *t = &dag.tasks[dag.ntasks];
+    memset(t, 0, sizeof(*t));
+
+    char *p = parse_attrs(line, &t->attrs, lineno);
+    if (!p)
+        return -1;
+    int argc;
+    t->text = line;
+    t->cmd = p;
+    t->argv = parse_command(p, &argc);
+    if (!t->argv) {
+        fprintf(stderr, "línea %d: comando no válido\n", lineno);
+        return -1;
+    }
+    t->skipped = -1;
+    dag.ntasks++;
+    return 0;
+}
+
+// ¿Se lanza antes la tarea a que la b? Mayor camino crítico y, a igualdad,
+// la que aparece antes en el fichero.
+int dag_before(int a, int b) {
+    if (dag.tasks[a].rank != dag.tasks[b].rank)
+        return dag.tasks[a].rank > dag.tasks[b].rank;
+    return a < b;
+}
+
+void dag_push(int t) {
+    int i = dag.nready++;
+    while (i > 0 && dag_before(t, dag.ready[(i - 1) / 2])) {
+        dag.ready[i] = dag.ready[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    dag.ready[i] = t;
+}
+
+// Saca la tarea lista con más prioridad, o -1 si no hay ninguna.
+int dag_pop(void) {
+    if (dag.nready == 0)
+        return -1;
+    int top = dag.ready[0];
+    int last = dag.ready[--dag.nready];
+    int i = 0;
+    for (;;) {
+        int c = 2 * i + 1;
+        if (c >= dag.nready)
+            break;
+        if (c + 1 < dag.nready && dag_before(dag.ready[c + 1], dag.ready[c]))
+            c++;
+        if (!dag_before(dag.ready[c], last))
+            break;
+        dag.ready[i] = dag.ready[c];
+        i = c;
+    }
+    dag.ready[i] = last;
+    return top;
+}
+
+/**
+ * dag_load:
+ *   Lee el grafo del fichero fp, resuelve los after:, comprueba que no hay
+ *   ciclos, calcula el camino crítico de cada tarea y deja en la cola las
+ *   que no tienen dependencias. Devuelve 0 o -1 si el grafo no es válido.
+ */
+int dag_load(FILE *fp) {
+    char *line = NULL;
+    size_t linecap = 0;
+    int lineno = 0;
+
+    while (getline(&line, &linecap, fp) != -1) {
+        lineno++;
+        line[strcspn(line, "\n")] = '\0';
+        const char *p = line;
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == '\0' || *p == '#')
+            continue;
+        char *copy = strdup(line);
+        if (!copy) { perror("strdup"); exit(EXIT_FAILURE); }
+        if (dag_parse_line(copy, lineno) < 0) {
+            free(copy);
+            free(line);
+            return -1;
+        }
+    }
+    free(line);
+
+    int n = dag.ntasks;
+    int ok = 0;
+
+    // Nombres a índices: tabla hash con direccionamiento abierto
+    int nbuckets = 16;
+    while (nbuckets < 2 * n) nbuckets *= 2;
+    int *byname = malloc(nbuckets * sizeof(int));
+    int *order = malloc((n ? n : 1) * sizeof(int));
+    dag.ready = malloc((n ? n : 1) * sizeof(int));
+    if (!byname || !order || !dag.ready) { perror("malloc"); exit(EXIT_FAILURE); }
+    memset(byname, -1, nbuckets * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        const char *name = dag.tasks[i].attrs.name;
+        if (!name)
+            continue;
+        unsigned h = hash_name(name) & (nbuckets - 1);
+        for (; byname[h] >= 0; h = (h + 1) & (nbuckets - 1)) {
+            if (strcmp(dag.tasks[byname[h]].attrs.name, name) == 0) {
+                fprintf(stderr, "La tarea '%s' está repetida (#%d y #%d)\n",
+                        name, byname[h], i);
+                goto out;
+            }
+        }
+        byname[h] = i;
+    }
+    for (int i = 0; i < n; i++) {
+        char *after = dag.tasks[i].attrs.after;
+        while (after && *after) {
+            size_t len = strcspn(after, ",");
+            char sep = after[len];
+            after[len] = '\0';
+            unsigned h = hash_name(after) & (nbuckets - 1);
+            while (byname[h] >= 0 &&
+                   strcmp(dag.tasks[byname[h]].attrs.name, after) != 0)
+                h = (h + 1) & (nbuckets - 1);
+            if (byname[h] < 0) {
+                fprintf(stderr, "Comando #%d: after:%s no es ninguna tarea\n",
+                        i, after);
+                goto out;
+            }
+            dag_edge(byname[h], i);
+            after[len] = sep;
+            after += len + (sep != '\0');
+        }
+    }
+
+    // Kahn: orden topológico; si no salen todas, hay un ciclo
+    int head = 0, tail = 0;
+    int *waiting = malloc((n ? n : 1) * sizeof(int));
+    if (!waiting) { perror("malloc"); exit(EXIT_FAILURE); }
+    for (int i = 0; i < n; i++)
+        if ((waiting[i] = dag.tasks[i].waiting) == 0)
+            order[tail++] = i;
+    while (head < tail) {
+        dag_task_t *t = &dag.tasks[order[head++]];
+        for (int k = 0; k < t->nnext; k++)
+            if (--waiting[t->next[k]] == 0)
+                order[tail++] = t->next[k];
+    }
+    if (tail < n) {
+        fprintf(stderr, "Hay un ciclo de dependencias entre los comandos:");
+        for (int i = 0; i < n; i++)
+            if (waiting[i] > 0)
+                fprintf(stderr, " #%d", i);
+        fprintf(stderr, "\n");
+        free(waiting);
+        goto out;
+    }
+    free(waiting);
+
+    // Camino crítico, de las últimas hacia atrás
+    for (int j = n - 1; j >= 0; j--) {
+        dag_task_t *t = &dag.tasks[order[j]];
+        double longest = 0;
+        for (int k = 0; k < t->nnext; k++)
+            if (dag.tasks[t->next[k]].rank > longest)
+                longest = dag.tasks[t->next[k]].rank;
+        t->rank = t->attrs.cost + longest;
+    }
+    for (int i = 0; i < n; i++)
+        if (dag.tasks[i].waiting == 0)
+            dag_push(i);
+    ok = 1;
+
+out:
+    free(byname);
+    free(order);
+    return ok ? 0 : -1;
+}
+
+void dag_free(void) {
+    for (int i = 0; i < dag.ntasks; i++) {
+        free(dag.tasks[i].text);
+        free(dag.tasks[i].argv);
+        free(dag.tasks[i].next);
+    }
+    free(dag.tasks);
+    free(dag.ready);
+    memset(&dag, 0, sizeof(dag));
+}
+
+/**
+ * dag_finish:
+ *   La tarea 't' ha terminado, bien ('ok') o mal. Si acabó bien, las que
+ *   dependen de ella y ya no esperan a nadie pasan a la cola; si no, se
+ *   saltan ella y todo lo que cuelga de ella.
+ */
+void dag_finish(int t, int ok) {
+    dag_task_t *task = &dag.tasks[t];
+    if (ok) {
+        for (int k = 0; k < task->nnext; k++) {
+            dag_task_t *next = &dag.tasks[task->next[k]];
+            if (--next->waiting == 0 && next->skipped < 0)
+                dag_push(task->next[k]);
+        }
+        return;
+    }
+
+    // Recorrido en profundidad con pila explícita (las cadenas pueden ser
+    // muy largas); cada tarea se salta una sola vez.
+    int *stack = malloc((dag.ntasks ? dag.ntasks : 1) * sizeof(int));
+    if (!stack) { perror("malloc"); exit(EXIT_FAILURE); }
+    int top = 0;
+    for (int k = 0; k < task->nnext; k++)
+        stack[top++] = task->next[k];
+    while (top > 0) {
+        int s = stack[--top];
+        dag_task_t *skip = &dag.tasks[s];
+        if (skip->skipped >= 0)
+            continue;
+        skip->skipped = t;
+        placeholder_job(s, skip->cmd, t);
+        for (int k = 0; k < skip->nnext; k++)
+            if (dag.tasks[skip->next[k]].skipped < 0)
+                stack[top++] = skip->next[k];
+    }
+    free(stack);
+}
+
+void *retry_arena;      // argv de los reintentos (se reutiliza)
+size_t retry_arena_cap;
+
+/**
+ * retry_job:
+ *   Si el comando del hueco ha fallado y le quedan reintentos, lo vuelve a
+ *   lanzar en el mismo hueco (con -g, --ordered y -o se descarta la salida
+ *   del intento fallido). Devuelve 1 si se ha relanzado.
+ */
+int retry_job(int slot) {
+    job_t *job = &jobs[slot];
+    int argc;
+    char **argv;
+
+    if (job->status == 0 || job->retries == 0)
+        return 0;
+    job->retries--;
+    job->attempts++;
+    if (output_mode == OUT_INHERIT || output_mode == OUT_PREFIX ||
+        output_mode == OUT_CAPTURE)
+        printf("@@ Command #%d failed (status: %d%s), retrying (%d left)\n",
+               job->cmdno, job->status, job->timed_out ? ", timed out" : "",
+               job->retries);
+    for (int k = 0; k < 2; k++) {
+        int sink = job->out[k].sink;
+        if (sink >= 0 && (ftruncate(sink, 0) < 0 || lseek(sink, 0, SEEK_SET) < 0))
+            perror("ftruncate");
+    }
+    // Lo que quede del intento anterior en su hoja no debe seguir corriendo
+    if (job->cg >= 0)
+        cg_write(job->cg, "cgroup.kill", "1");
+    argv = parse_command_into(job->line, &argc, &retry_arena, &retry_arena_cap);
+    return argv && spawn_job(slot, argv) == 0;
+}
+
+// Una cosa menos pendiente del comando; si era la última, está terminado
+// (o se reintenta).
+void job_step(int slot, int *running) {
+    job_t *job = &jobs[slot];
+    if (--job->pending > 0)
+        return;
+    timer_del(slot);
+    if (retry_job(slot))
+        return;
+    job = &jobs[slot];
+    cg_release(slot);
+    (*running)--;
+    // finish_job() libera el hueco: antes se guarda lo que necesita -d
+    int cmdno = job->cmdno;
+    int ok = job->status == 0;
+    finish_job(slot);
+    if (dag_mode)
+        dag_finish(cmdno, ok);
+}
+
+/**
+ * run_jobs:
+ *   Lanza los comandos del fichero fp manteniendo como mucho max_jobs en
+ *   marcha (0 = sin límite). Cada vez que termina uno se informa y se lanza
+ *   la siguiente línea, hasta agotar el fichero y esperar a todos.
+ */
+void run_jobs(FILE *fp, int max_jobs) {
+    raise_fd_limit();
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        perror("epoll_create1");
+        exit(EXIT_FAILURE);
+    }
+
+    if (output_mode == OUT_ORDERED) {
+        struct rlimit rl;
+        // Un comando de la ventana usa hasta 5 descriptores (pidfd, dos
+        // tuberías y dos memfd); se dejan unos cuantos para el resto.
+        ordered_window = 1024;
+        if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+            ordered_window = ((long)rl.rlim_cur - 16) / 5;
+        if (ordered_window < 1)
+            ordered_window = 1;
+        if (ordered_window > 65536)
+            ordered_window = 65536;
+        // Con -d el orden de lanzamiento no es el del fichero: una ventana
+        // menor que el grafo podría bloquear el comando que falta por escribir
+        if (dag_mode)
+            ordered_window = dag.ntasks > 0 ? dag.ntasks : 1;
+        ordered_ring = calloc(ordered_window, sizeof(int));
+        if (!ordered_ring) { perror("calloc"); exit(EXIT_FAILURE); }
+        next_print = 0;
+    }
+    int grouped = output_mode == OUT_GROUP || output_mode == OUT_ORDERED;
+    double started = now_seconds();
+
+    // Rueda de temporizadores de timeout=
+    wheel_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (wheel_fd < 0) {
+        perror("timerfd_create");
+        exit(EXIT_FAILURE);
+    }
+    watch_fd(wheel_fd, 0, EV_TIMER);
+    for (int i = 0; i < WHEEL_SLOTS; i++)
+        wheel[i] = -1;
+    wheel_base = now_seconds();
+    wheel_tick = 0;
+
+    // ¿Hay pidfd_open()? Se prueba con nuestro propio PID.
+    use_pidfd = 1;
+    int probe = syscall(SYS_pidfd_open, getpid(), 0);
+    if (probe < 0)
+        use_pidfd = 0;
+    else
+        close(probe);
+
+    char *line = NULL;
+    size_t linecap = 0;
+    void *arena = NULL;     // argv de la línea actual (se reutiliza)
+    size_t arena_cap = 0;
+    int cmdno = 0;
+    int running = 0;
+    int eof = 0;
+    struct epoll_event events[64];
+
+    for (;;) {
+        // Lanzar comandos hasta llenar los huecos libres (con --ordered,
+        // sin alejarse más de una ventana del primero por escribir)
+        while (!eof && (max_jobs == 0 || running < max_jobs) &&
+               (output_mode != OUT_ORDERED ||
+                cmdno - next_print < ordered_window)) {
+            const char *cmd;
+            char **cargv = NULL;
+            int no, cargc;
+            job_attrs_t attrs, *a = &attrs;
+            if (dag_mode) {
+                // Las listas, por camino crítico (vacía no es el final)
+                if ((no = dag_pop()) < 0)
+                    break;
+                cmd = dag.tasks[no].cmd;
+                cargv = dag.tasks[no].argv;
+                a = &dag.tasks[no].attrs;
+            } else {
+                if (getline(&line, &linecap, fp) == -1) {
+                    eof = 1;
+                    break;
+                }
+                // quitamos '\n'
+                line[strcspn(line, "\n")] = '\0';
+                no = cmdno++;
+                cmd = parse_attrs(line, &attrs, no + 1);
+                if (cmd && attrs.after) {
+                    fprintf(stderr, "línea %d: after: solo tiene sentido con -d\n",
+                            no + 1);
+                    cmd = NULL;
+                }
+                if (cmd)
+                    cargv = parse_command_into(cmd, &cargc, &arena, &arena_cap);
+                else
+                    cmd = line;
+            }
+            if (!grouped) {
+                printf("@@ Running command #%d: %s\n", no, cmd);
+                fflush(stdout);     // antes que la salida del propio comando
+            }
+
+            int slot = cargv ? start_job(cargv, no, a) : -1;
+            if (slot >= 0) {
+                running++;
+                job_set_line(slot, cmd);    // para -g, --ordered, -r y reintentos
+                continue;
+            }
+            summary.not_launched++;
+            if (dag_mode)
+                dag_finish(no, 0);
+            // Hueco sin proceso, solo para escribir su línea en su turno
+            if (grouped)
+                placeholder_job(no, cmd, -1);
+        }
+        if (running == 0)
+            break;
+
+        fflush(stdout);
+        int n = epoll_wait(epfd, events, 64, use_pidfd ? -1 : 50);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            int slot = events[i].data.u64 >> 2;
+            int kind = events[i].data.u64 & 3;
+
+            if (kind == EV_TIMER) {
+                wheel_expire();
+                continue;
+            }
+            job_t *job = &jobs[slot];
+            if (kind == EV_PROC) {
+                // El pidfd es legible: el hijo ha terminado y wait4() no
+                // bloquea.
+                if (wait4(job->pid, &job->status, 0, &job->ru) < 0)
+                    perror("wait4");
+                job->wall = now_seconds() - job->start;
+                unwatch_close(job->pidfd);
+                job->pidfd = -1;
+                job_step(slot, &running);
+            } else if (drain_stream(job, kind == EV_STDOUT ? 0 : 1)) {
+                job_step(slot, &running);
+            }
+        }
+
+        // Sin pidfd: recoger los hijos terminados buscando su hueco
+        if (!use_pidfd) {
+            int status;
+            struct rusage ru;
+            pid_t pid;
+            while ((pid = wait4(-1, &status, WNOHANG, &ru)) > 0) {
+                for (int slot = 0; slot < jobs_cap; slot++) {
+                    if (jobs[slot].pid == pid && jobs[slot].pending > 0) {
+                        jobs[slot].status = status;
+                        jobs[slot].ru = ru;
+                        jobs[slot].wall = now_seconds() - jobs[slot].start;
+                        job_step(slot, &running);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    if (rusage_report)
+        print_summary(now_seconds() - started);
+
+    unwatch_close(wheel_fd);
+    wheel_fd = -1;
+    cg_cleanup();
+
+    free(line);
+    free(arena);
+    free(retry_arena);
+    retry_arena = NULL;
+    retry_arena_cap = 0;
+    for (int i = 0; i < jobs_cap; i++)
+        free(jobs[i].line);
+    free(jobs);
+    jobs = NULL;
+    jobs_cap = 0;
+    jobs_free = -1;
+    free(ordered_ring);
+    ordered_ring = NULL;
+    close(epfd);
+}
+
+// Opciones largas (las que no tienen letra usan valores fuera de ASCII).
+enum { OPT_ORDERED = 256 };
+
+static const struct option long_options[] = {
+    { "command",    required_argument, NULL, 'x' },
+    { "script",     required_argument, NULL, 's' },
+    { "background", no_argument,       NULL, 'b' },
+    { "jobs",       required_argument, NULL, 'j' },
+    { "prefix",     no_argument,       NULL, 'p' },
+    { "group",      no_argument,       NULL, 'g' },
+    { "ordered",    no_argument,       NULL, OPT_ORDERED },
+    { "capture",    required_argument, NULL, 'o' },
+    { "rusage",     no_argument,       NULL, 'r' },
+    { "dag",        no_argument,       NULL, 'd' },
+    { "launcher",   required_argument, NULL, 'm' },
+    { "bench",      required_argument, NULL, 'B' },
+    { "bench-mb",   required_argument, NULL, 'M' },
+    { NULL, 0, NULL, 0 }
+};
+
+// Fija el modo de salida, que solo puede ser uno.
+void set_output_mode(output_mode_t mode) {
+    if (output_mode != OUT_INHERIT && output_mode != mode) {
+        fprintf(stderr, "-p, -g, --ordered y -o son incompatibles\n");
+        exit(EXIT_FAILURE);
+    }
+    output_mode = mode;
+}
+
 int main(int argc, char *argv[]) {
     int opt;
     char *opt_x = NULL;
     char *opt_s = NULL;
     int  opt_b = 0;
+    int  opt_j = 0;
+    int  opt_B = 0;
+    long opt_M = 0;
+    char *endptr;
 
     // 1) Parseo de opciones
-    while ((opt = getopt(argc, argv, "x:s:b")) != -1) {
+    while ((opt = getopt_long(argc, argv, "x:s:bj:m:B:M:pgo:rd",
+                              long_options, NULL)) != -1) {
         switch (opt) {
         case 'x':
             opt_x = optarg;
@@ -109,18 +2249,88 @@ int main(int argc, char *argv[]) {
         case 'b':
             opt_b = 1;
             break;
+        case 'j':
+            opt_j = strtol(optarg, &endptr, 10);
+            if (*endptr != '\0' || opt_j < 1) {
+                fprintf(stderr, "-j necesita un número mayor que 0\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'p':
+            set_output_mode(OUT_PREFIX);
+            break;
+        case 'g':
+            set_output_mode(OUT_GROUP);
+            break;
+        case OPT_ORDERED:
+            set_output_mode(OUT_ORDERED);
+            break;
+        case 'o':
+            set_output_mode(OUT_CAPTURE);
+            capture_dir = optarg;
+            break;
+        case 'r':
+            rusage_report = 1;
+            break;
+        case 'd':
+            dag_mode = 1;
+            break;
+        case 'm':
+            if (strcmp(optarg, "spawn") == 0) {
+                launch_mode = LAUNCH_SPAWN;
+            } else if (strcmp(optarg, "fork") == 0) {
+                launch_mode = LAUNCH_FORK;
+            } else {
+                fprintf(stderr, "-m debe ser spawn o fork\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'B':
+            opt_B = strtol(optarg, &endptr, 10);
+            if (*endptr != '\0' || opt_B < 1) {
+                fprintf(stderr, "-B necesita un número mayor que 0\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'M':
+            opt_M = strtol(optarg, &endptr, 10);
+            if (*endptr != '\0' || opt_M < 0) {
+                fprintf(stderr, "-M necesita un número de megas\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
         default:
-            fprintf(stderr, "Usage: %s [-x cmd] [-s file] [-b]\n", argv[0]);
+            fprintf(stderr, "Usage: %s [-m spawn|fork] [-x cmd] [-s file [-d]] [-b | -j N]\n"
+                    "       [-p | -g | --ordered | -o dir] [-r]\n"
+                    "       %s -B n [-M MB] [-x cmd]\n", argv[0], argv[0]);
             exit(EXIT_FAILURE);
         }
     }
+    // Prueba de rendimiento
+    if (opt_B) {
+        if (opt_s) {
+            fprintf(stderr, "-B no se puede usar con -s\n");
+            exit(EXIT_FAILURE);
+        }
+        benchmark(opt_x ? opt_x : "true", opt_B, opt_M);
+        return EXIT_SUCCESS;
+    }
+    if (opt_M) {
+        fprintf(stderr, "-M solo tiene sentido con -B\n");
+        exit(EXIT_FAILURE);
+    }
+
     // Validación mínima
     if (!opt_x && !opt_s) {
         fprintf(stderr, "Debe usar -x o -s\n");
         exit(EXIT_FAILURE);
     }
-    if (opt_b && !opt_s) {
-        fprintf(stderr, "-b solo tiene sentido con -s\n");
+    if ((opt_b || opt_j || dag_mode || output_mode != OUT_INHERIT) && !opt_s) {
+        fprintf(stderr, "-b, -j, -d, -p, -g, --ordered y -o solo tienen sentido con -s\n");
+        exit(EXIT_FAILURE);
+    }
+    if (opt_b && opt_j) {
+        fprintf(stderr, "-b y -j son incompatibles\n");
         exit(EXIT_FAILURE);
     }
 
@@ -128,12 +2338,19 @@ int main(int argc, char *argv[]) {
     if (opt_x) {
         int cargc;
         char **cargv = parse_command(opt_x, &cargc);
-        pid_t pid = launch_command(cargv);
+        if (!cargv) exit(EXIT_FAILURE);
+        job_t job = { .start = now_seconds(), .line = opt_x };
+        pid_t pid = launch_command(cargv, NULL, NULL);
         if (pid < 0) exit(EXIT_FAILURE);
+        job.pid = pid;
         int status;
-        waitpid(pid, &status, 0);
-        // liberamos memoria
-        for (int i = 0; i < cargc; i++) free(cargv[i]);
+        wait4(pid, &status, 0, &job.ru);
+        if (rusage_report) {
+            job.wall = now_seconds() - job.start;
+            job.status = status;
+            account_job(&job);
+        }
+        // liberamos memoria (un solo bloque)
         free(cargv);
         return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
     }
@@ -145,76 +2362,15 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    if (!opt_b) {
-        // Modo secuencial
-        char line[LINEBUF];
-        int cmdno = 0;
-        while (fgets(line, sizeof(line), fp)) {
-            // quitamos '\n'
-            line[strcspn(line, "\n")] = '\0';
-            printf("@@ Running command #%d: %s\n", cmdno, line);
-
-            int cargc;
-            char **cargv = parse_command(line, &cargc);
-            pid_t pid = launch_command(cargv);
-            int status;
-            waitpid(pid, &status, 0);
-            printf("@@ Command #%d terminated (pid: %d, status: %d)\n",
-                   cmdno, pid, status);
-
-            for (int i = 0; i < cargc; i++) free(cargv[i]);
-            free(cargv);
-            cmdno++;
-        }
-    } else {
-        // Modo paralelo (-b)
-        pid_t pids[MAX_CMDS];
-        int    count = 0;
-        char * lines[MAX_CMDS];
-
-        // Lanzamos todos los comandos sin esperar
-        char buf[LINEBUF];
-        while (fgets(buf, sizeof(buf), fp) && count < MAX_CMDS) {
-            buf[strcspn(buf, "\n")] = '\0';
-            lines[count] = strdup(buf);
-            printf("@@ Running command #%d: %s\n", count, buf);
-
-            int cargc;
-            char **cargv = parse_command(buf, &cargc);
-            pid_t pid = launch_command(cargv);
-            pids[count] = pid;
-
-            // liberamos argv pero no el string principal
-            for (int i = 0; i < cargc; i++) free(cargv[i]);
-            free(cargv);
-
-            count++;
-        }
-
-        // Ahora esperamos a que terminen todos, en el orden que sea
-        int finished = 0;
-        while (finished < count) {
-            int status;
-            pid_t pid = wait(&status);
-            if (pid < 0) {
-                perror("wait");
-                break;
-            }
-            // Buscar índice de este pid
-            for (int i = 0; i < count; i++) {
-                if (pids[i] == pid) {
-                    printf("@@ Command #%d terminated (pid: %d, status: %d)\n",
-                           i, pid, status);
-                    break;
-                }
-            }
-            finished++;
-        }
-        // liberamos líneas
-        for (int i = 0; i < count; i++)
-            free(lines[i]);
+    if (dag_mode && dag_load(fp) < 0) {
+        fclose(fp);
+        exit(EXIT_FAILURE);
     }
 
+    // Secuencial = un solo comando en marcha; -b = sin límite
+    run_jobs(fp, opt_b ? 0 : (opt_j ? opt_j : 1));
+    dag_free();
+
     fclose(fp);
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,329 @@
+/* bench_mpmc.c
+ *
+ * Compara la cola sin cerrojos de mpmc.h con una cola acotada protegida
+ * por un mutex y dos variables de condición, al estilo de disco.c
+ * (contadores de esperando y pthread_cond_signal solo si hay alguien
+ * esperando), para varias combinaciones de productores y consumidores.
+ *
+ * Cada prueba pasa -n mensajes: cada productor envía su parte y cada
+ * consumidor recibe la suya (se reparte el total), así que no hace falta
+ * ningún contador compartido para saber cuándo acabar. Al final se
+ * comprueba que la suma de los índices recibidos es la esperada (ningún
+ * mensaje perdido ni repetido).
+ *
+ * Se mide:
+ *  - rendimiento: mensajes por segundo y ns por mensaje
+ *  - latencia: del envío a la recepción, en uno de cada LAT_SAMPLE
+ *    mensajes (leer el reloj cuesta más que la propia cola), con p50,
+ *    p99 y máximo
+ *
+ * Uso:
+ *   ./bench_mpmc [-n mensajes] [-q capacidad] [-p productores -c consumidores]
+ *
+ *   Sin -p/-c se prueban 1x1, 1x4, 4x1, 2x2 y 4x4.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "mpmc.h"
+
+#define LAT_SAMPLE    64        // uno de cada LAT_SAMPLE mensajes lleva hora
+#define LAT_BUCKETS   256
+#define MAX_THREADS   64
+
+typedef struct {
+    size_t             idx;
+    unsigned long long sent;    // ns, 0 si no se mide
+} msg_t;
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* ---------------- Cola con mutex y variables de condición ---------------- */
+
+typedef struct {
+    void          **buf;
+    size_t          cap, head, count;
+    int             waiting_put, waiting_get;
+    pthread_mutex_t mutex;
+    pthread_cond_t  not_full, not_empty;
+} lockq_t;
+
+static int lockq_init(lockq_t *q, size_t cap) {
+    q->buf = malloc(cap * sizeof(void *));
+    if (!q->buf)
+        return -1;
+    q->cap = cap;
+    q->head = q->count = 0;
+    q->waiting_put = q->waiting_get = 0;
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    return 0;
+}
+
+static void lockq_destroy(lockq_t *q) {
+    pthread_mutex_destroy(&q->mutex);
+    pthread_cond_destroy(&q->not_full);
+    pthread_cond_destroy(&q->not_empty);
+    free(q->buf);
+}
+
+static void lockq_put(lockq_t *q, void *data) {
+    pthread_mutex_lock(&q->mutex);
+    q->waiting_put++;
+    while (q->count == q->cap)
+        pthread_cond_wait(&q->not_full, &q->mutex);
+    q->waiting_put--;
+    q->buf[(q->head + q->count) % q->cap] = data;
+    q->count++;
+    if (q->waiting_get > 0)
+        pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+static void *lockq_get(lockq_t *q) {
+    pthread_mutex_lock(&q->mutex);
+    q->waiting_get++;
+    while (q->count == 0)
+        pthread_cond_wait(&q->not_empty, &q->mutex);
+    q->waiting_get--;
+    void *data = q->buf[q->head];
+    q->head = (q->head + 1) % q->cap;
+    q->count--;
+    if (q->waiting_put > 0)
+        pthread_cond_signal(&q->not_full);
+    pthread_mutex_unlock(&q->mutex);
+    return data;
+}
+
+/* ---------------- Colas a comparar ---------------- */
+
+typedef struct {
+    const char *name;
+    void  (*put)(void *q, void *data);
+    void *(*get)(void *q);
+} queue_ops_t;
+
+static void mpmc_put_op(void *q, void *data) { mpmc_push_wait(q, data); }
+static void *mpmc_get_op(void *q) { return mpmc_pop_wait(q); }
+static void lockq_put_op(void *q, void *data) { lockq_put(q, data); }
+static void *lockq_get_op(void *q) { return lockq_get(q); }
+
+static const queue_ops_t queues[] = {
+    { "mpmc",       mpmc_put_op,  mpmc_get_op  },
+    { "mutex+cond", lockq_put_op, lockq_get_op },
+};
+
+/* ---------------- Productores y consumidores ---------------- */
+
+typedef struct {
+    const queue_ops_t *ops;
+    void              *queue;
+    msg_t             *msgs;
+    size_t             first, count;    // productor: mensajes [first, first+count)
+    atomic_int        *go;
+    // Resultados del consumidor
+    unsigned long long sum;
+    unsigned long long hist[LAT_BUCKETS];
+    unsigned long long lat_max, lat_n;
+} worker_t;
+
+// Cubo de una latencia: cuatro por potencia de 2
+static int lat_bucket(unsigned long long ns) {
+    if (ns < 4)
+        return ns;
+    int b = 63 - __builtin_clzll(ns);
+    return b * 4 + ((ns >> (b - 2)) & 3);
+}
+
+static unsigned long long bucket_value(int bucket) {
+    if (bucket < 4)
+        return bucket;
+    int b = bucket / 4, sub = bucket % 4;
+    return ((4ull + sub) << (b - 2)) + (1ull << (b - 2)) / 2;
+}
+
+static void wait_go(atomic_int *go) {
+    while (!atomic_load_explicit(go, memory_order_acquire))
+        sched_yield();
+}
+
+static void *producer(void *arg) {
+    worker_t *w = arg;
+    wait_go(w->go);
+    for (size_t i = w->first; i < w->first + w->count; i++) {
+        msg_t *m = &w->msgs[i];
+        m->sent = (i % LAT_SAMPLE == 0 ? now_ns() : 0);
+        w->ops->put(w->queue, m);
+    }
+    return NULL;
+}
+
+static void *consumer(void *arg) {
+    worker_t *w = arg;
+    wait_go(w->go);
+    for (size_t i = 0; i < w->count; i++) {
+        msg_t *m = w->ops->get(w->queue);
+        w->sum += m->idx;
+        if (m->sent) {
+            unsigned long long lat = now_ns() - m->sent;
+            w->hist[lat_bucket(lat)]++;
+            w->lat_n++;
+            if (lat > w->lat_max)
+                w->lat_max = lat;
+        }
+    }
+    return NULL;
+}
+
+static unsigned long long quantile(const unsigned long long *hist,
+                                   unsigned long long total, double q) {
+    unsigned long long rank = q * total, seen = 0;
+    for (int i = 0; i < LAT_BUCKETS; i++) {
+        seen += hist[i];
+        if (seen > rank)
+            return bucket_value(i);
+    }
+    return 0;
+}
+
+static void run(const queue_ops_t *ops, int np, int nc, size_t n, size_t cap) {
+    mpmc_t mq;
+    lockq_t lq;
+    void *queue;
+    if (ops->put == mpmc_put_op) {
+        if (mpmc_init(&mq, cap) < 0) {
+            perror("mpmc_init");
+            exit(EXIT_FAILURE);
+        }
+        queue = &mq;
+    } else {
+        if (lockq_init(&lq, cap) < 0) {
+            perror("lockq_init");
+            exit(EXIT_FAILURE);
+        }
+        queue = &lq;
+    }
+
+    msg_t *msgs = malloc(n * sizeof(msg_t));
+    worker_t *ws = calloc(np + nc, sizeof(worker_t));
+    pthread_t *tids = malloc((np + nc) * sizeof(pthread_t));
+    if (!msgs || !ws || !tids) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < n; i++)
+        msgs[i].idx = i;
+
+    atomic_int go = 0;
+    for (int i = 0; i < np + nc; i++) {
+        worker_t *w = &ws[i];
+        int k = (i < np ? i : i - np), parts = (i < np ? np : nc);
+        w->ops = ops;
+        w->queue = queue;
+        w->msgs = msgs;
+        w->first = n * k / parts;
+        w->count = n * (k + 1) / parts - w->first;
+        w->go = &go;
+        int err = pthread_create(&tids[i], NULL, i < np ? producer : consumer, w);
+        if (err) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(err));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    unsigned long long t0 = now_ns();
+    atomic_store_explicit(&go, 1, memory_order_release);
+    for (int i = 0; i < np + nc; i++)
+        pthread_join(tids[i], NULL);
+    double secs = (now_ns() - t0) / 1e9;
+
+    // Resultados de los consumidores
+    unsigned long long sum = 0, hist[LAT_BUCKETS] = { 0 }, lat_n = 0, lat_max = 0;
+    for (int i = np; i < np + nc; i++) {
+        sum += ws[i].sum;
+        lat_n += ws[i].lat_n;
+        if (ws[i].lat_max > lat_max)
+            lat_max = ws[i].lat_max;
+        for (int b = 0; b < LAT_BUCKETS; b++)
+            hist[b] += ws[i].hist[b];
+    }
+    if (sum != (unsigned long long)n * (n - 1) / 2) {
+        fprintf(stderr, "%s %dx%d: suma de índices %llu, se esperaba %llu\n",
+                ops->name, np, nc, sum, (unsigned long long)n * (n - 1) / 2);
+        exit(EXIT_FAILURE);
+    }
+    unsigned long long p50 = quantile(hist, lat_n, 0.50);
+    unsigned long long p99 = quantile(hist, lat_n, 0.99);
+    printf("@@ %-10s %3d %3d  %9.2f  %8.1f  %9.1f  %9.1f  %9.1f\n",
+           ops->name, np, nc, n / secs / 1e6, secs * 1e9 / n,
+           (p50 < lat_max ? p50 : lat_max) / 1e3,
+           (p99 < lat_max ? p99 : lat_max) / 1e3, lat_max / 1e3);
+
+    if (queue == &mq)
+        mpmc_destroy(&mq);
+    else
+        lockq_destroy(&lq);
+    free(tids);
+    free(ws);
+    free(msgs);
+}
+
+int main(int argc, char *argv[]) {
+    static const int configs[][2] = { {1, 1}, {1, 4}, {4, 1}, {2, 2}, {4, 4} };
+    size_t n = 2000000, cap = 1024;
+    int np = 0, nc = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:q:p:c:")) != -1) {
+        switch (opt) {
+        case 'n':
+            n = atol(optarg);
+            break;
+        case 'q':
+            cap = atol(optarg);
+            break;
+        case 'p':
+            np = atoi(optarg);
+            break;
+        case 'c':
+            nc = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Uso: %s [-n mensajes] [-q capacidad]"
+                    " [-p productores -c consumidores]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if ((long)n <= 0 || (long)cap <= 0 || (np > 0) != (nc > 0) ||
+        np < 0 || nc < 0 || np + nc > MAX_THREADS) {
+        fprintf(stderr, "Uso: %s [-n mensajes] [-q capacidad]"
+                " [-p productores -c consumidores]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("@@ %zu mensajes, capacidad %zu, latencia en 1 de cada %d\n",
+           n, cap, LAT_SAMPLE);
+    printf("@@ %-10s %3s %3s  %9s  %8s  %9s  %9s  %9s\n", "cola", "P", "C",
+           "Mmsg/s", "ns/msg", "p50 us", "p99 us", "máx us");
+    int nconfigs = (np > 0 ? 1 : (int)(sizeof(configs) / sizeof(configs[0])));
+    for (int i = 0; i < nconfigs; i++) {
+        int p = (np > 0 ? np : configs[i][0]);
+        int c = (np > 0 ? nc : configs[i][1]);
+        for (size_t k = 0; k < sizeof(queues) / sizeof(queues[0]); k++)
+            run(&queues[k], p, c, n, cap);
+    }
+    return EXIT_SUCCESS;
+}
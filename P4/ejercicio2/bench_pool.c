@@ -0,0 +1,474 @@
+/* bench_pool.c
+ *
+ * Mide el coste por tarea de tres formas de ejecutar tareas diminutas:
+ *
+ *  - hilo por tarea : el modelo de la versión original de hilos.c, un
+ *                     pthread_create, un malloc del argumento y un
+ *                     pthread_join por tarea (thread_usuario sin el printf).
+ *  - pool, envío    : el main envía todas las tareas al pool desde fuera
+ *                     (cola de inyección). Las tareas salen de un anillo de
+ *                     TASK_WINDOW nodos que se reutilizan cuando su tarea
+ *                     ya ha terminado, así que no hay malloc por tarea.
+ *  - pool, reparto  : una sola tarea raíz que cubre el rango [0, n) y se
+ *                     parte en dos recursivamente desde dentro del pool; el
+ *                     trabajo se reparte por robo entre las colas de los
+ *                     workers. Los nodos se reciclan en listas libres por
+ *                     hilo.
+ *
+ * Después, con -l tareas algo más largas (LANE_WORK cálculos), se mide el
+ * reparto entre carriles: se envían de golpe mezcladas -r % al carril P y
+ * el resto al N, una vez con el envejecimiento por defecto y otra con
+ * prioridad estricta, y se escriben las métricas de cada carril (espera
+ * media, p50, p99, máxima y profundidad máxima de la cola durante el envío).
+ * Con prioridad estricta las N esperan a que se vacíe todo el carril P.
+ *
+ * Cada tarea hace un cálculo mínimo (un hash de su número) y lo acumula en
+ * una suma por hilo; al final se comprueba que la suma total es la esperada.
+ *
+ * El modelo de hilo por tarea es unas mil veces más lento, así que se mide
+ * con menos tareas (-c) y se compara el coste por tarea.
+ *
+ * Uso:
+ *   ./bench_pool [-n tareas_pool] [-c tareas_hilo] [-t hilos]
+ *                [-l tareas_carriles] [-r porcentaje_P]
+ *
+ *   -n  tareas de las pruebas con el pool (10000000 por defecto)
+ *   -c  tareas de la prueba de hilo por tarea (20000 por defecto)
+ *   -t  workers del pool (por defecto, uno por CPU)
+ *   -l  tareas de la prueba de carriles (200000 por defecto, 0 = no hacerla)
+ *   -r  porcentaje de esas tareas que van al carril P (90 por defecto)
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <time.h>
+#include "threadpool.h"
+
+#define TASK_WINDOW    (1 << 16)  // nodos del anillo de la prueba de envío
+#define THREAD_BATCH   256        // hilos vivos a la vez en hilo por tarea
+#define NODE_CHUNK     1024       // nodos que se reservan de golpe en reparto
+#define MAX_ACCS       1024       // hilos que pueden acumular resultado
+#define LANE_WORK      64         // cálculos de cada tarea en la prueba de carriles
+
+/* ---------------- Trabajo y resultado ---------------- */
+
+// El "trabajo" de cada tarea
+static inline uint64_t tarea_poca(uint64_t i) {
+    uint64_t x = i * 0x9E3779B97F4A7C15ull;
+    return x ^ (x >> 29);
+}
+
+// Suma por hilo, cada una en su línea de caché para no compartirla
+typedef struct {
+    _Alignas(64) uint64_t sum;
+} acc_t;
+
+static acc_t accs[MAX_ACCS];
+static atomic_int naccs;
+static __thread acc_t *my_acc;
+
+static void acc_add(uint64_t v) {
+    if (!my_acc) {
+        int i = atomic_fetch_add(&naccs, 1);
+        if (i >= MAX_ACCS) {
+            fprintf(stderr, "Demasiados hilos acumulando resultados\n");
+            exit(EXIT_FAILURE);
+        }
+        my_acc = &accs[i];
+    }
+    my_acc->sum += v;
+}
+
+static uint64_t acc_total_reset(void) {
+    uint64_t total = 0;
+    int n = atomic_load(&naccs);
+    for (int i = 0; i < n && i < MAX_ACCS; i++) {
+        total += accs[i].sum;
+        accs[i].sum = 0;
+    }
+    return total;
+}
+
+static uint64_t expected_sum(long n) {
+    uint64_t total = 0;
+    for (long i = 0; i < n; i++)
+        total += tarea_poca(i);
+    return total;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, long n, double secs) {
+    // El ancho de printf va en bytes: compensar los caracteres de varios
+    // bytes en UTF-8 (las tildes) para que las columnas cuadren
+    int width = 16;
+    for (const char *p = name; *p; p++)
+        if ((*p & 0xC0) == 0x80)
+            width++;
+    printf("@@ %-*s: %10ld tareas en %8.3f s  %10.1f ns/tarea  %8.2f Mtareas/s\n",
+           width, name, n, secs, secs * 1e9 / n, n / secs / 1e6);
+}
+
+static void report_pool(threadpool_t *pool, const tp_stats_t *before) {
+    tp_stats_t st;
+    tp_stats(pool, &st);
+    printf("@@   robadas %llu, inyectadas %llu, dormidas %llu\n",
+           st.stolen - before->stolen, st.injected - before->injected,
+           st.sleeps - before->sleeps);
+}
+
+static void check(const char *name, uint64_t got, uint64_t want) {
+    if (got != want) {
+        fprintf(stderr, "%s: suma %llu, se esperaba %llu\n", name,
+                (unsigned long long)got, (unsigned long long)want);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* ---------------- Hilo por tarea ---------------- */
+
+typedef struct {
+    long  num;
+    char  prio;
+} hilo_arg_t;
+
+static atomic_ullong thread_sum;
+
+// thread_usuario de la versión original, sin imprimir
+static void *thread_usuario(void *arg) {
+    hilo_arg_t *datos = (hilo_arg_t *)arg;
+    long  mi_num  = datos->num;
+    char  mi_prio = datos->prio;
+    free(datos);
+    (void)mi_prio;
+    atomic_fetch_add_explicit(&thread_sum, tarea_poca(mi_num), memory_order_relaxed);
+    return NULL;
+}
+
+static double bench_threads(long n) {
+    pthread_t tids[THREAD_BATCH];
+    atomic_store(&thread_sum, 0);
+
+    double t0 = now();
+    for (long base = 0; base < n; base += THREAD_BATCH) {
+        int batch = (n - base < THREAD_BATCH ? n - base : THREAD_BATCH);
+        for (int i = 0; i < batch; i++) {
+            hilo_arg_t *arg = malloc(sizeof(hilo_arg_t));
+            if (!arg) {
+                perror("malloc");
+                exit(EXIT_FAILURE);
+            }
+            arg->num  = base + i;
+            arg->prio = ((base + i) % 2 == 0 ? 'P' : 'N');
+            int err = pthread_create(&tids[i], NULL, thread_usuario, arg);
+            if (err) {
+                fprintf(stderr, "pthread_create: %s\n", strerror(err));
+                exit(EXIT_FAILURE);
+            }
+        }
+        for (int i = 0; i < batch; i++)
+            pthread_join(tids[i], NULL);
+    }
+    double secs = now() - t0;
+
+    check("hilo por tarea", atomic_load(&thread_sum), expected_sum(n));
+    return secs;
+}
+
+/* ---------------- Pool: envío desde fuera ---------------- */
+
+typedef struct {
+    tp_task_t   task;
+    long        num;
+    atomic_int  busy;       // la tarea de este nodo aún no ha terminado
+} slot_t;
+
+static void slot_run(tp_task_t *task) {
+    slot_t *s = TP_CONTAINER_OF(task, slot_t, task);
+    acc_add(tarea_poca(s->num));
+    atomic_store_explicit(&s->busy, 0, memory_order_release);
+}
+
+static double bench_submit(threadpool_t *pool, long n) {
+    slot_t *ring = calloc(TASK_WINDOW, sizeof(slot_t));
+    if (!ring) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    tp_stats_t before;
+    tp_stats(pool, &before);
+
+    double t0 = now();
+    for (long i = 0; i < n; i++) {
+        slot_t *s = &ring[i & (TASK_WINDOW - 1)];
+        // Si el pool va por detrás, esperar a que se libere el nodo
+        while (atomic_load_explicit(&s->busy, memory_order_acquire))
+            sched_yield();
+        s->num = i;
+        atomic_store_explicit(&s->busy, 1, memory_order_relaxed);
+        tp_task_init(&s->task, slot_run);
+        tp_submit(pool, &s->task);
+    }
+    tp_wait(pool);
+    double secs = now() - t0;
+
+    report_pool(pool, &before);
+    check("pool (envío)", acc_total_reset(), expected_sum(n));
+    free(ring);
+    return secs;
+}
+
+/* ---------------- Pool: reparto recursivo ---------------- */
+
+// Nodo que cubre [lo, hi): hace la tarea lo y reparte el resto en dos
+typedef struct node {
+    tp_task_t    task;
+    long         lo, hi;
+    struct node *free_next;
+} node_t;
+
+typedef struct chunk {
+    struct chunk *next;
+    node_t        nodes[NODE_CHUNK];
+} chunk_t;
+
+static threadpool_t *tree_pool;
+static chunk_t *chunks;                     // para liberarlos al final
+static pthread_mutex_t chunks_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread node_t *free_nodes;         // lista libre de cada hilo
+
+static node_t *node_alloc(void) {
+    if (!free_nodes) {
+        chunk_t *c = malloc(sizeof(chunk_t));
+        if (!c) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        pthread_mutex_lock(&chunks_lock);
+        c->next = chunks;
+        chunks = c;
+        pthread_mutex_unlock(&chunks_lock);
+        for (int i = 0; i < NODE_CHUNK; i++) {
+            c->nodes[i].free_next = free_nodes;
+            free_nodes = &c->nodes[i];
+        }
+    }
+    node_t *nd = free_nodes;
+    free_nodes = nd->free_next;
+    return nd;
+}
+
+static void node_free(node_t *nd) {
+    nd->free_next = free_nodes;
+    free_nodes = nd;
+}
+
+static void node_run(tp_task_t *task) {
+    node_t *nd = TP_CONTAINER_OF(task, node_t, task);
+    acc_add(tarea_poca(nd->lo));
+
+    long lo = nd->lo + 1, hi = nd->hi;
+    long mid = lo + (hi - lo) / 2;
+    if (mid < hi) {
+        // La mitad alta a un nodo nuevo, que es la que robarán
+        node_t *right = node_alloc();
+        right->lo = mid;
+        right->hi = hi;
+        tp_task_init(&right->task, node_run);
+        tp_submit(tree_pool, &right->task);
+    }
+    if (lo < mid) {
+        // La mitad baja reutiliza este nodo
+        nd->lo = lo;
+        nd->hi = mid;
+        tp_submit(tree_pool, &nd->task);
+    } else {
+        node_free(nd);
+    }
+}
+
+static double bench_spawn(threadpool_t *pool, long n) {
+    tp_stats_t before;
+    tp_stats(pool, &before);
+    tree_pool = pool;
+
+    double t0 = now();
+    node_t *root = node_alloc();
+    root->lo = 0;
+    root->hi = n;
+    tp_task_init(&root->task, node_run);
+    tp_submit(pool, &root->task);
+    tp_wait(pool);
+    double secs = now() - t0;
+
+    report_pool(pool, &before);
+    check("pool (reparto)", acc_total_reset(), expected_sum(n));
+
+    // Los workers siguen vivos con sus listas libres apuntando a los
+    // bloques: solo se liberan cuando ya no se van a usar
+    free_nodes = NULL;
+    return secs;
+}
+
+/* ---------------- Pool: carriles de prioridad ---------------- */
+
+typedef struct {
+    tp_task_t task;
+    long      num;
+} lane_task_t;
+
+static void lane_run(tp_task_t *task) {
+    lane_task_t *lt = TP_CONTAINER_OF(task, lane_task_t, task);
+    uint64_t v = 0;
+    for (int i = 0; i < LANE_WORK; i++)
+        v += tarea_poca(lt->num * LANE_WORK + i);
+    acc_add(v);
+}
+
+static void print_lane(const char *name, const tp_lane_stats_t *ls,
+                       unsigned long long max_depth) {
+    printf("@@   carril %s: %8llu tareas  espera media %9.1f us  p50 %9.1f us"
+           "  p99 %9.1f us  máx %9.1f us  cola máx %llu",
+           name, ls->executed, ls->wait_mean / 1e3, ls->wait_p50 / 1e3,
+           ls->wait_p99 / 1e3, ls->wait_max / 1e3, max_depth);
+    if (ls->aged)
+        printf("  adelantadas %llu", ls->aged);
+    printf("\n");
+}
+
+static void bench_lanes(int nworkers, long n, int pct_p, int aging) {
+    lane_task_t *tasks = calloc(n, sizeof(lane_task_t));
+    if (!tasks) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    // Un pool nuevo para que las esperas y los máximos sean solo de esta
+    // prueba
+    threadpool_t *lp = tp_create(nworkers);
+    if (!lp) {
+        fprintf(stderr, "tp_create: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    tp_set_wait_sampling(lp, 1);
+    if (!aging)
+        tp_set_aging(lp, 0, 0);
+
+    unsigned long long max_depth[TP_LANES] = { 0 };
+    double t0 = now();
+    for (long i = 0; i < n; i++) {
+        tasks[i].num = i;
+        tp_task_init(&tasks[i].task, lane_run);
+        // Reparto uniforme: i * pct_p / 100 avanza en las que van a P
+        int lane = ((i + 1) * pct_p / 100 > i * pct_p / 100 ? TP_LANE_P : TP_LANE_N);
+        tp_submit_lane(lp, &tasks[i].task, lane);
+        if ((i & 1023) == 0)
+            for (int l = 0; l < TP_LANES; l++) {
+                unsigned long long d = tp_lane_depth(lp, l);
+                if (d > max_depth[l])
+                    max_depth[l] = d;
+            }
+    }
+    tp_wait(lp);
+    double secs = now() - t0;
+
+    tp_stats_t st;
+    tp_stats(lp, &st);
+    printf("@@ carriles, %s: %ld tareas (%d%% P) en %.3f s\n",
+           aging ? "con envejecimiento" : "prioridad estricta", n, pct_p, secs);
+    print_lane("P", &st.lane[TP_LANE_P], max_depth[TP_LANE_P]);
+    print_lane("N", &st.lane[TP_LANE_N], max_depth[TP_LANE_N]);
+
+    uint64_t want = 0;
+    for (long i = 0; i < n * LANE_WORK; i++)
+        want += tarea_poca(i);
+    tp_destroy(lp);
+    check("carriles", acc_total_reset(), want);
+    free(tasks);
+}
+
+static void free_chunks(void) {
+    while (chunks) {
+        chunk_t *next = chunks->next;
+        free(chunks);
+        chunks = next;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    long ntasks = 10000000, nthread_tasks = 20000, nlane_tasks = 200000;
+    int nworkers = 0, pct_p = 90;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:c:t:l:r:")) != -1) {
+        switch (opt) {
+        case 'n':
+            ntasks = atol(optarg);
+            break;
+        case 'c':
+            nthread_tasks = atol(optarg);
+            break;
+        case 't':
+            nworkers = atoi(optarg);
+            break;
+        case 'l':
+            nlane_tasks = atol(optarg);
+            break;
+        case 'r':
+            pct_p = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Uso: %s [-n tareas_pool] [-c tareas_hilo] [-t hilos]"
+                    " [-l tareas_carriles] [-r porcentaje_P]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (ntasks <= 0 || nthread_tasks <= 0 || nworkers < 0 || nlane_tasks < 0) {
+        fprintf(stderr, "Los números de tareas deben ser > 0 y el de hilos >= 0\n");
+        exit(EXIT_FAILURE);
+    }
+    if (pct_p < 0 || pct_p > 100) {
+        fprintf(stderr, "El porcentaje de tareas P debe estar entre 0 y 100\n");
+        exit(EXIT_FAILURE);
+    }
+
+    double thr = bench_threads(nthread_tasks);
+    report("hilo por tarea", nthread_tasks, thr);
+
+    threadpool_t *pool = tp_create(nworkers);
+    if (!pool) {
+        fprintf(stderr, "tp_create: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    printf("@@ pool de %d workers\n", tp_size(pool));
+
+    double sub = bench_submit(pool, ntasks);
+    report("pool (envío)", ntasks, sub);
+    double spw = bench_spawn(pool, ntasks);
+    report("pool (reparto)", ntasks, spw);
+
+    double per_thread = thr / nthread_tasks;
+    printf("@@ coste por tarea frente a hilo por tarea: envío %.0fx menor, reparto %.0fx menor\n",
+           per_thread / (sub / ntasks), per_thread / (spw / ntasks));
+
+    tp_destroy(pool);
+    free_chunks();
+
+    if (nlane_tasks > 0) {
+        bench_lanes(nworkers, nlane_tasks, pct_p, 1);
+        bench_lanes(nworkers, nlane_tasks, pct_p, 0);
+    }
+    return EXIT_SUCCESS;
+}
@@ -2,105 +2,202 @@
  *
  * Ejercicio 2: Creación y paso de parámetros a hilos usando pthreads.
  *
- * Cada hilo recibe un puntero a una estructura dinámica con dos campos:
- *  - num   : número de hilo
- *  - prio  : 'P' si es prioritario (num par), 'N' si no (num impar)
+ * Cada tarea recibe una estructura con dos campos:
+ *  - num   : número de tarea
+ *  - prio  : 'P' si es prioritaria (num par), 'N' si no (num impar)
  *
- * El hilo:
- * 1) copia los datos en variables locales
- * 2) libera la memoria dinámica de arg
- * 3) obtiene su propio ID con pthread_self()
+ * Antes se creaba un hilo por tarea y se reservaba su argumento con malloc.
+ * Ahora las tareas se ejecutan en un pool de hilos persistente
+ * (threadpool.h): los argumentos van todos en un único array y cada uno
+ * lleva dentro su nodo de tarea, así que no hay ni un pthread_create ni un
+ * malloc por tarea.
+ *
+ * Las tareas 'P' van al carril prioritario del pool, que los hilos vacían
+ * siempre antes que el normal (donde van las 'N'), con envejecimiento para
+ * que las 'N' no se queden sin ejecutar. Al terminar se escriben por la
+ * salida de error las métricas de cada carril (tareas, espera media,
+ * p50, p99 y máxima, y 'N' adelantadas por envejecimiento).
+ *
+ * La tarea:
+ * 1) recupera su estructura a partir del nodo de tarea
+ * 2) copia los datos en variables locales
+ * 3) obtiene el ID del hilo del pool que la ejecuta con pthread_self()
  * 4) imprime: [thread 0x... num=5 prio=N]
  *
- * Al final, el main hace pthread_join() de todos ellos.
+ * Al final, el main espera a que se ejecuten todas con tp_wait().
+ *
+ * Con --pin, cada hilo del pool se fija a una CPU según la topología de
+ * /sys/devices/system/cpu (ver topology.h):
+ *   --pin compact   hilos SMT de un núcleo, núcleos de un paquete, ...
+ *   --pin scatter   un hilo por paquete/nodo, luego por núcleo, ...
+ *   --pin 0,2,4-7   las CPUs de la lista, en ese orden
+ * y el plan (hilo -> CPU, núcleo y nodo) se escribe por la salida de error.
+ * Cada hilo formatea sus mensajes en su memoria de trabajo (tp_local), que
+ * reserva él mismo ya fijado para que quede en su nodo NUMA.
  *
  * Uso:
- *   ./hilos <número_de_hilos>
+ *   ./hilos [--pin política] <número_de_tareas> [número_de_hilos]
+ *
+ *   Sin número de hilos, el pool tiene uno por CPU.
  *
  * Compilar:
- *   gcc -Wall -Wextra -std=gnu99 -pthread -o hilos hilos.c
+ *   make
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
-#include <unistd.h>     // sleep()
 #include <errno.h>
 #include <string.h>     // strerror()
+#include <getopt.h>
+#include "threadpool.h"
+#include "topology.h"
 
-// Estructura que pasaremos a cada hilo:
-//   num  = número de hilo
+#define LOCAL_SIZE  4096    // memoria de trabajo de cada hilo
+
+// Estructura que pasaremos a cada tarea:
+//   task = nodo para el pool
+//   num  = número de tarea
 //   prio = 'P' o 'N'
 typedef struct {
-    int   num;
-    char  prio;
+    tp_task_t task;
+    int       num;
+    char      prio;
 } hilo_arg_t;
 
-void *thread_usuario(void *arg) {
-    // 1) Convertir void* a nuestro tipo
-    hilo_arg_t *datos = (hilo_arg_t *)arg;
+void thread_usuario(tp_task_t *task) {
+    // 1) Recuperar nuestro tipo a partir del nodo de tarea
+    hilo_arg_t *datos = TP_CONTAINER_OF(task, hilo_arg_t, task);
 
     // 2) Copiar en variables locales
     int   mi_num  = datos->num;
     char  mi_prio = datos->prio;
 
-    // 3) Liberar la memoria dinámica ya que no la volveremos a usar
-    free(datos);
-
-    // 4) Obtener el ID del hilo
+    // 3) Obtener el ID del hilo
     pthread_t tid = pthread_self();
 
-    // 5) Imprimir mensaje
-    printf("[thread %lu num=%d prio=%c]\n",
-           (unsigned long)tid, mi_num, mi_prio);
+    // 4) Imprimir mensaje, formateado en la memoria del hilo
+    size_t size;
+    char *buf = tp_local(&size);
+    snprintf(buf, size, "[thread %lu num=%d prio=%c]\n",
+             (unsigned long)tid, mi_num, mi_prio);
+    fputs(buf, stdout);
+}
 
-    return NULL;
+// Métricas de los carriles, por la salida de error
+static void print_lanes(threadpool_t *pool) {
+    tp_stats_t st;
+    tp_stats(pool, &st);
+    for (int lane = 0; lane < TP_LANES; lane++) {
+        tp_lane_stats_t *ls = &st.lane[lane];
+        fprintf(stderr, "@@ carril %c: %llu tareas, espera media %.1f us,"
+                " p50 %.1f us, p99 %.1f us, máx %.1f us",
+                lane == TP_LANE_P ? 'P' : 'N', ls->executed,
+                ls->wait_mean / 1e3, ls->wait_p50 / 1e3,
+                ls->wait_p99 / 1e3, ls->wait_max / 1e3);
+        if (lane == TP_LANE_N)
+            fprintf(stderr, ", %llu adelantadas", ls->aged);
+        fprintf(stderr, "\n");
+    }
+}
+
+// Plan de afinidad, por la salida de error
+static void print_plan(const topology_t *topo, const int *cpus, int n) {
+    for (int i = 0; i < n; i++) {
+        const topo_cpu_t *c = topo_cpu(topo, cpus[i]);
+        fprintf(stderr, "@@ hilo %d -> cpu %d (paquete %d, núcleo %d, smt %d, nodo %d)\n",
+                i, cpus[i], c->package, c->core, c->smt, c->node);
+    }
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Uso: %s <num_hilos>\n", argv[0]);
+    static const struct option long_options[] = {
+        { "pin", required_argument, NULL, 'p' },
+        { NULL, 0, NULL, 0 }
+    };
+    const char *pin = NULL;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "p:", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'p':
+            pin = optarg;
+            break;
+        default:
+            fprintf(stderr, "Uso: %s [--pin compact|scatter|lista] <num_tareas> [num_hilos]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (argc - optind != 1 && argc - optind != 2) {
+        fprintf(stderr, "Uso: %s [--pin compact|scatter|lista] <num_tareas> [num_hilos]\n",
+                argv[0]);
         return EXIT_FAILURE;
     }
 
-    int n = atoi(argv[1]);
+    int n = atoi(argv[optind]);
     if (n <= 0) {
-        fprintf(stderr, "Número de hilos debe ser > 0\n");
+        fprintf(stderr, "Número de tareas debe ser > 0\n");
         return EXIT_FAILURE;
     }
-
-    // Array para guardar los IDs de hilo
-    pthread_t *tids = malloc(n * sizeof(pthread_t));
-    if (!tids) {
-        perror("malloc");
+    int nhilos = (argc - optind == 2 ? atoi(argv[optind + 1]) : 0);
+    if (nhilos < 0) {
+        fprintf(stderr, "Número de hilos debe ser >= 0\n");
         return EXIT_FAILURE;
     }
 
-    // 1) Creación de hilos
-    for (int i = 0; i < n; i++) {
-        // Reservamos un bloque para pasar como argumento
-        hilo_arg_t *arg = malloc(sizeof(hilo_arg_t));
-        if (!arg) {
+    // Plan de afinidad
+    int *cpus = NULL;
+    if (pin) {
+        topology_t topo;
+        if (topo_load(&topo, NULL) < 0)
+            return EXIT_FAILURE;
+        if (nhilos == 0)
+            nhilos = topo.ncpus;
+        cpus = malloc(nhilos * sizeof(int));
+        if (!cpus) {
             perror("malloc");
             return EXIT_FAILURE;
         }
-        arg->num  = i;
-        arg->prio = (i % 2 == 0 ? 'P' : 'N');
-
-        // Lanzamos el hilo, pasando arg; guardamos el pthread_t
-        int err = pthread_create(&tids[i], NULL, thread_usuario, arg);
-        if (err) {
-            fprintf(stderr, "pthread_create[%d]: %s\n", i, strerror(err));
-            free(arg);
-            // continuar intentando crear los demás
+        if (topo_plan(&topo, pin, nhilos, cpus) < 0) {
+            topo_free(&topo);
+            free(cpus);
+            return EXIT_FAILURE;
         }
+        print_plan(&topo, cpus, nhilos);
+        topo_free(&topo);
+    }
+
+    // Un solo bloque para los argumentos de todas las tareas
+    hilo_arg_t *args = malloc(n * sizeof(hilo_arg_t));
+    if (!args) {
+        perror("malloc");
+        return EXIT_FAILURE;
     }
 
-    // 2) Esperar a que todos los hilos terminen
+    threadpool_t *pool = tp_create_pinned(nhilos, cpus, LOCAL_SIZE);
+    if (!pool) {
+        fprintf(stderr, "tp_create: %s\n", strerror(errno));
+        free(args);
+        return EXIT_FAILURE;
+    }
+    tp_set_wait_sampling(pool, 1);      // medir la espera de todas
+
+    // 1) Envío de tareas
     for (int i = 0; i < n; i++) {
-        pthread_join(tids[i], NULL);
+        args[i].num  = i;
+        args[i].prio = (i % 2 == 0 ? 'P' : 'N');
+        tp_task_init(&args[i].task, thread_usuario);
+        tp_submit_lane(pool, &args[i].task,
+                       args[i].prio == 'P' ? TP_LANE_P : TP_LANE_N);
     }
 
-    free(tids);
+    // 2) Esperar a que todas las tareas terminen
+    tp_wait(pool);
+    print_lanes(pool);
+
+    tp_destroy(pool);
+    free(cpus);
+    free(args);
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,118 @@
+/* mpmc.c
+ *
+ * Implementación de mpmc.h.
+ *
+ * Órdenes de memoria: el productor escribe el dato y publica la celda con
+ * un store release de seq; el consumidor la lee con acquire antes de
+ * tocar el dato, y la devuelve a los productores igual. Los CAS sobre
+ * head/tail solo reparten posiciones, así que pueden ser relajados.
+ *
+ * Si al mirar una celda la secuencia va por detrás de la posición, la
+ * cola está llena (productor) o vacía (consumidor). Si va por delante,
+ * otro hilo ya se llevó esa posición: se vuelve a leer head/tail.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sched.h>      // sched_yield()
+#include "mpmc.h"
+
+#define SPIN_LIMIT  64          // vueltas de espera antes de ceder la CPU
+
+int mpmc_init(mpmc_t *q, size_t capacity) {
+    size_t size = 2;
+    while (size < capacity)
+        size *= 2;
+
+    q->cells = aligned_alloc(MPMC_CACHE_LINE,
+                             (size * sizeof(mpmc_cell_t) + MPMC_CACHE_LINE - 1)
+                             / MPMC_CACHE_LINE * MPMC_CACHE_LINE);
+    if (!q->cells)
+        return -1;
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&q->cells[i].seq, i);
+        q->cells[i].data = NULL;
+    }
+    q->mask = size - 1;
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->head, 0);
+    return 0;
+}
+
+void mpmc_destroy(mpmc_t *q) {
+    free(q->cells);
+    q->cells = NULL;
+}
+
+size_t mpmc_capacity(const mpmc_t *q) {
+    return q->mask + 1;
+}
+
+int mpmc_push(mpmc_t *q, void *data) {
+    size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    for (;;) {
+        mpmc_cell_t *cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+        if (dif == 0) {
+            // Libre: intentar quedarse con la posición
+            if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                cell->data = data;
+                atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+                return 0;
+            }
+            // El CAS fallido ha dejado en pos el tail actual
+        } else if (dif < 0) {
+            return -1;          // llena: la celda aún no se ha consumido
+        } else {
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        }
+    }
+}
+
+int mpmc_pop(mpmc_t *q, void **data) {
+    size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    for (;;) {
+        mpmc_cell_t *cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                *data = cell->data;
+                // La celda vuelve a los productores para la siguiente vuelta
+                atomic_store_explicit(&cell->seq, pos + q->mask + 1,
+                                      memory_order_release);
+                return 0;
+            }
+        } else if (dif < 0) {
+            return -1;          // vacía: aún no se ha escrito
+        } else {
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+}
+
+void mpmc_push_wait(mpmc_t *q, void *data) {
+    int spins = 0;
+    while (mpmc_push(q, data) < 0)
+        if (++spins >= SPIN_LIMIT) {
+            sched_yield();
+            spins = 0;
+        }
+}
+
+void *mpmc_pop_wait(mpmc_t *q) {
+    void *data;
+    int spins = 0;
+    while (mpmc_pop(q, &data) < 0)
+        if (++spins >= SPIN_LIMIT) {
+            sched_yield();
+            spins = 0;
+        }
+    return data;
+}
@@ -0,0 +1,67 @@
+/* mpmc.h
+ *
+ * Cola acotada de varios productores y varios consumidores sin cerrojos,
+ * al estilo de la de Dmitry Vyukov.
+ *
+ * Es un array circular de celdas; cada celda lleva, además del dato, un
+ * número de secuencia que dice de quién es el turno:
+ *   seq == pos        libre para el productor que reserve la posición pos
+ *   seq == pos + 1    llena, para el consumidor que reserve pos
+ * Un productor reserva posición con un CAS sobre tail y un consumidor
+ * con un CAS sobre head; después cada uno trabaja en su celda sin
+ * molestar a los demás y la entrega actualizando seq. head y tail van en
+ * líneas de caché distintas para que productores y consumidores no se
+ * peleen por la misma.
+ *
+ * Las operaciones básicas no bloquean (devuelven -1 si está llena o
+ * vacía). Las *_wait esperan dando vueltas y cediendo la CPU.
+ *
+ *   mpmc_t q;
+ *   mpmc_init(&q, 1024);
+ *   mpmc_push_wait(&q, dato);         // en los productores
+ *   void *dato = mpmc_pop_wait(&q);   // en los consumidores
+ *   mpmc_destroy(&q);
+ */
+
+#ifndef MPMC_H
+#define MPMC_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define MPMC_CACHE_LINE 64
+
+typedef struct {
+    atomic_size_t seq;
+    void *data;
+} mpmc_cell_t;
+
+typedef struct {
+    mpmc_cell_t *cells;
+    size_t mask;                                        // capacidad - 1
+    _Alignas(MPMC_CACHE_LINE) atomic_size_t tail;       // siguiente a escribir
+    _Alignas(MPMC_CACHE_LINE) atomic_size_t head;       // siguiente a leer
+} mpmc_t;       // el alineamiento deja también sola la línea de head
+
+/**
+ * mpmc_init:
+ *   Prepara una cola de 'capacity' elementos (se redondea a potencia de 2,
+ *   mínimo 2). Devuelve 0, o -1 si no hay memoria.
+ */
+int mpmc_init(mpmc_t *q, size_t capacity);
+
+void mpmc_destroy(mpmc_t *q);
+
+size_t mpmc_capacity(const mpmc_t *q);
+
+// Mete 'data'; -1 si la cola está llena
+int mpmc_push(mpmc_t *q, void *data);
+
+// Saca un elemento en *data; -1 si la cola está vacía
+int mpmc_pop(mpmc_t *q, void **data);
+
+// Como las anteriores, pero esperan a que haya sitio o datos
+void mpmc_push_wait(mpmc_t *q, void *data);
+void *mpmc_pop_wait(mpmc_t *q);
+
+#endif
@@ -0,0 +1,292 @@
+/* pingpong.c
+ *
+ * Mide lo que cuesta mover una línea de caché entre CPUs, según lo cerca
+ * que estén en la topología (ver topology.h), frente a trabajar con hilos
+ * fijados que no comparten nada.
+ *
+ * 1) Ping-pong: dos hilos se pasan el turno escribiendo por turnos en la
+ *    misma línea de caché; cada ida y vuelta son dos traspasos de la línea
+ *    de una caché a otra. Se mide con los hilos fijados (con
+ *    pthread_setaffinity_np) a:
+ *      - dos hilos SMT del mismo núcleo (comparten L1 y L2)
+ *      - dos núcleos del mismo paquete y nodo (comparten L3)
+ *      - dos paquetes o nodos NUMA distintos
+ *      - sin fijar (donde los ponga el planificador)
+ *    con las parejas que existan en esta máquina, o con la dada con -a/-b.
+ *
+ * 2) Contador: dos hilos fijados a la pareja más alejada hacen -n
+ *    incrementos atómicos cada uno, primero sobre el mismo contador (la
+ *    línea va y viene en cada incremento) y luego cada uno sobre el suyo
+ *    (en su propia línea, reservada por el propio hilo ya fijado para que
+ *    quede en su nodo). También un solo hilo, como referencia.
+ *
+ * Si los dos hilos acaban en la misma CPU (una máquina con una sola CPU o
+ * "-a 0 -b 0"), la espera activa cede la CPU cada SPIN_LIMIT vueltas y lo
+ * que se mide son cambios de contexto.
+ *
+ * Uso:
+ *   ./pingpong [-n viajes] [-a cpu -b cpu]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "topology.h"
+
+#define CACHE_LINE  64
+#define SPIN_LIMIT  1000        // vueltas de espera activa antes de ceder
+
+typedef struct {
+    _Alignas(CACHE_LINE) atomic_long value;
+} line_t;
+
+typedef struct {
+    int          cpu;           // -1 = sin fijar
+    int          me;            // 0 o 1
+    long         n;
+    line_t      *shared;        // NULL = cada hilo usa su propia línea
+    atomic_int  *ready;
+    atomic_int  *go;
+} player_t;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void pin_self(int cpu) {
+    if (cpu < 0)
+        return;
+    if (cpu >= CPU_SETSIZE) {
+        fprintf(stderr, "CPU %d fuera de rango (0 a %d)\n", cpu, CPU_SETSIZE - 1);
+        exit(EXIT_FAILURE);
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err) {
+        fprintf(stderr, "pthread_setaffinity_np(%d): %s\n", cpu, strerror(err));
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Espera activa a que 'v' valga 'want', cediendo la CPU de vez en cuando
+static void wait_for(atomic_long *v, long want) {
+    int spins = 0;
+    while (atomic_load_explicit(v, memory_order_acquire) != want)
+        if (++spins >= SPIN_LIMIT) {
+            sched_yield();
+            spins = 0;
+        }
+}
+
+// Avisar de que está listo y esperar a la salida
+static void start_line(player_t *p) {
+    atomic_fetch_add(p->ready, 1);
+    while (!atomic_load(p->go))
+        sched_yield();
+}
+
+static void *ping_player(void *arg) {
+    player_t *p = arg;
+    pin_self(p->cpu);
+    start_line(p);
+    // El turno pasa de 0 a 1 y vuelta; cada hilo espera el suyo
+    for (long i = 0; i < p->n; i++) {
+        wait_for(&p->shared->value, p->me);
+        atomic_store_explicit(&p->shared->value, 1 - p->me, memory_order_release);
+    }
+    return NULL;
+}
+
+static void *count_player(void *arg) {
+    player_t *p = arg;
+    line_t *line = p->shared;
+    pin_self(p->cpu);
+    if (!line) {
+        // Su propia línea, reservada y tocada ya fijado (first touch)
+        line = aligned_alloc(CACHE_LINE, sizeof(line_t));
+        if (!line) {
+            perror("aligned_alloc");
+            exit(EXIT_FAILURE);
+        }
+        atomic_init(&line->value, 0);
+    }
+    start_line(p);
+    for (long i = 0; i < p->n; i++)
+        atomic_fetch_add_explicit(&line->value, 1, memory_order_relaxed);
+    if (line != p->shared)
+        free(line);
+    return NULL;
+}
+
+// Lanza 'nthreads' jugadores (fijados a cpus[i]) y mide desde que están
+// todos listos hasta que terminan
+static double run(void *(*fn)(void *), int nthreads, const int *cpus, long n,
+                  line_t *shared) {
+    pthread_t tids[2];
+    player_t players[2];
+    atomic_int ready = 0, go = 0;
+
+    for (int i = 0; i < nthreads; i++) {
+        players[i] = (player_t) { cpus[i], i, n, shared, &ready, &go };
+        int err = pthread_create(&tids[i], NULL, fn, &players[i]);
+        if (err) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(err));
+            exit(EXIT_FAILURE);
+        }
+    }
+    while (atomic_load(&ready) < nthreads)
+        sched_yield();
+    double t0 = now();
+    atomic_store(&go, 1);
+    for (int i = 0; i < nthreads; i++)
+        pthread_join(tids[i], NULL);
+    return now() - t0;
+}
+
+static double ping_pong(int a, int b, long n) {
+    line_t *line = aligned_alloc(CACHE_LINE, sizeof(line_t));
+    if (!line) {
+        perror("aligned_alloc");
+        exit(EXIT_FAILURE);
+    }
+    atomic_init(&line->value, 0);
+    int cpus[2] = { a, b };
+    double secs = run(ping_player, 2, cpus, n, line);
+    free(line);
+    return secs * 1e9 / n;
+}
+
+// Primera CPU distinta de c0 que cumple 'same_core'/'same_group'
+static int find_pair(const topology_t *t, const topo_cpu_t *c0, int same_core,
+                     int same_group) {
+    for (int i = 0; i < t->ncpus; i++) {
+        const topo_cpu_t *c = &t->cpus[i];
+        if (c->cpu == c0->cpu)
+            continue;
+        int group = (c->package == c0->package && c->node == c0->node);
+        int core = (group && c->core == c0->core);
+        if (core == same_core && group == same_group)
+            return c->cpu;
+    }
+    return -1;
+}
+
+// Ancho de printf (en bytes) para ocupar 'w' columnas con 's' en UTF-8
+static int cols(const char *s, int w) {
+    for (; *s; s++)
+        if ((*s & 0xC0) == 0x80)
+            w++;
+    return w;
+}
+
+static void print_pair(const char *name, int a, int b, long n) {
+    char cpus[32] = "";
+    if (a >= 0)
+        snprintf(cpus, sizeof(cpus), "cpu %d <-> cpu %d", a, b);
+    printf("@@   %-*s %-18s: %9.1f ns por ida y vuelta\n", cols(name, 20), name,
+           cpus, ping_pong(a, b, n));
+}
+
+int main(int argc, char *argv[]) {
+    long n = 200000;
+    int a = -1, b = -1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:a:b:")) != -1) {
+        switch (opt) {
+        case 'n':
+            n = atol(optarg);
+            break;
+        case 'a':
+            a = atoi(optarg);
+            break;
+        case 'b':
+            b = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Uso: %s [-n viajes] [-a cpu -b cpu]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (n <= 0 || (a < 0) != (b < 0)) {
+        fprintf(stderr, "Uso: %s [-n viajes] [-a cpu -b cpu]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    topology_t topo;
+    if (topo_load(&topo, NULL) < 0)
+        exit(EXIT_FAILURE);
+    if (a >= 0 && (!topo_cpu(&topo, a) || !topo_cpu(&topo, b))) {
+        fprintf(stderr, "Las CPUs %d y %d tienen que estar en línea\n", a, b);
+        exit(EXIT_FAILURE);
+    }
+    printf("@@ %d CPUs en línea, %d nodos NUMA\n", topo.ncpus, topo.nnodes);
+
+    // 1) Ping-pong
+    printf("@@ ping-pong de una línea de caché, %ld idas y vueltas:\n", n);
+    int far_a, far_b;
+    if (a >= 0) {
+        print_pair("pedida", a, b, n);
+        far_a = a;
+        far_b = b;
+    } else {
+        const topo_cpu_t *c0 = &topo.cpus[0];
+        int smt = find_pair(&topo, c0, 1, 1);
+        int core = find_pair(&topo, c0, 0, 1);
+        int remote = find_pair(&topo, c0, 0, 0);
+        far_a = far_b = c0->cpu;
+        if (topo.ncpus == 1)
+            print_pair("misma CPU", c0->cpu, c0->cpu, n);
+        if (smt >= 0) {
+            print_pair("mismo núcleo (SMT)", c0->cpu, smt, n);
+            far_b = smt;
+        }
+        if (core >= 0) {
+            print_pair("mismo paquete", c0->cpu, core, n);
+            far_b = core;
+        }
+        if (remote >= 0) {
+            print_pair("otro paquete/nodo", c0->cpu, remote, n);
+            far_b = remote;
+        }
+        print_pair("sin fijar", -1, -1, n);
+    }
+
+    // 2) Contador compartido frente a uno por hilo
+    int pair[2] = { far_a, far_b };
+    line_t *shared = aligned_alloc(CACHE_LINE, sizeof(line_t));
+    if (!shared) {
+        perror("aligned_alloc");
+        exit(EXIT_FAILURE);
+    }
+    atomic_init(&shared->value, 0);
+    printf("@@ contador, %ld incrementos por hilo (cpu %d y cpu %d):\n", n,
+           far_a, far_b);
+    double same = run(count_player, 2, pair, n, shared);
+    double own = run(count_player, 2, pair, n, NULL);
+    double one = run(count_player, 1, pair, n, NULL);
+    const char *names[] = { "misma línea", "una línea por hilo", "un solo hilo" };
+    double ns[] = { same * 1e9 / (2 * n), own * 1e9 / (2 * n), one * 1e9 / n };
+    for (int i = 0; i < 3; i++)
+        printf("@@   %-*s: %9.1f ns por incremento\n", cols(names[i], 39), names[i], ns[i]);
+    if (atomic_load(&shared->value) != 2 * n) {
+        fprintf(stderr, "contador compartido: %ld, se esperaba %ld\n",
+                atomic_load(&shared->value), 2 * n);
+        exit(EXIT_FAILURE);
+    }
+
+    free(shared);
+    topo_free(&topo);
+    return EXIT_SUCCESS;
+}
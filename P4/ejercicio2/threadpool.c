@@ -0,0 +1,748 @@
+/* threadpool.c
+ *
+ * Implementación del pool de threadpool.h.
+ *
+ * Cola de Chase-Lev (de cada worker):
+ *   Un array circular con dos índices, top y bottom. El dueño mete y saca
+ *   por bottom (LIFO, lo más reciente está caliente en su caché) y los
+ *   ladrones sacan por top (FIFO, lo más antiguo, que suele ser lo más
+ *   grande en un reparto recursivo). Solo hay conflicto cuando queda un
+ *   elemento, y se resuelve con un CAS sobre top. Es la versión con
+ *   atómicos de C11 de Lê, Pop, Cohen y Zappa Nardelli (PPoPP 2013). Al
+ *   llenarse, el dueño la copia en un array del doble de tamaño; el viejo no
+ *   se libera hasta destruir el pool porque un ladrón puede estar leyéndolo.
+ *
+ * Cola de inyección:
+ *   Pila de Treiber (CAS sobre la cabeza) a la que empujan los hilos de
+ *   fuera. Un worker sin trabajo se lleva la lista entera con un exchange,
+ *   se queda la tarea más antigua y mete el resto en su cola, donde los
+ *   demás pueden robarlas.
+ *
+ * Dormir y despertar:
+ *   Un worker que no encuentra trabajo (ni en su cola, ni en la de
+ *   inyección, ni robando) se duerme en una variable de condición. Quien
+ *   envía solo coge el mutex para despertar a alguien si hay dormidos
+ *   (sleepers > 0). El worker incrementa sleepers y vuelve a mirar si hay
+ *   trabajo antes de dormirse, y quien envía publica la tarea antes de
+ *   mirar sleepers (ambos seq_cst), así que no se puede perder un aviso.
+ *
+ * Carriles de prioridad:
+ *   Cada worker tiene una cola por carril y hay una pila de inyección por
+ *   carril. Al buscar trabajo se recorre entero el carril P (cola propia,
+ *   inyección, robo) antes de mirar el N. Para que N no se muera de hambre
+ *   bajo carga P, el worker empieza por el carril N cuando lleva
+ *   max_streak tareas P seguidas o cuando hace más de max_age que nadie
+ *   sirvió el carril N (n_served, que solo se escribe como mucho cada
+ *   max_age/4 para no convertirlo en una línea de caché caliente). Para
+ *   esto basta el reloj COARSE (resolución de milisegundos, pero varias
+ *   veces más barato), y solo se consulta durante una racha de P. Si el
+ *   carril N está vacío, se olvida la racha: no hay nadie esperando.
+ *
+ * Métricas:
+ *   Una de cada wait_sample tareas lleva la hora de envío (el resto, 0); el
+ *   worker mide su espera al empezarla y la acumula en sus contadores del
+ *   carril (suma, máximo e histograma). Se muestrea porque leer el reloj
+ *   cuesta lo mismo que el resto de la gestión de una tarea (en una
+ *   máquina virtual sin TSC fiable, unos 80 ns por lectura). Los contadores de cada worker solo los escribe él, con
+ *   load + store relajados en lugar de operaciones atómicas de
+ *   lectura-escritura; tp_stats() los suma leyéndolos en cualquier momento.
+ *   La profundidad de un carril es enviadas - empezadas.
+ *
+ * Afinidad y memoria local:
+ *   tp_create_pinned() crea cada worker ya fijado a su CPU (atributo de
+ *   afinidad del hilo, así que ni su pila llega a tocarse en otra CPU). Lo
+ *   que usa sobre todo un worker (los arrays de sus colas y su memoria
+ *   local) lo reserva y lo escribe él mismo al arrancar: con la política
+ *   por defecto de Linux (first touch) las páginas quedan en el nodo NUMA
+ *   de su CPU sin necesidad de libnuma.
+ *
+ * Tareas pendientes:
+ *   pending se incrementa al enviar y se decrementa al ejecutar, pero cada
+ *   worker acumula sus tareas hechas y las resta de golpe (cada
+ *   DONE_BATCH o cuando se queda sin trabajo), para no pelearse por esa
+ *   línea de caché en cada tarea. Como se resta tarde y nunca antes de
+ *   tiempo, pending == 0 implica que de verdad no queda nada.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>     // sysconf()
+#include <sched.h>      // sched_yield()
+#include <time.h>       // clock_gettime()
+#include "threadpool.h"
+
+#define CACHE_LINE     64
+#define ROUND_UP(x, a) (((x) + (a) - 1) / (a) * (a))
+#define DEQUE_INITIAL  256      // tamaño inicial de cada cola (potencia de 2)
+#define DONE_BATCH     256      // tareas hechas que se acumulan antes de restar
+#define STEAL_ROUNDS   64       // vueltas de robo antes de dormirse
+#define WAIT_BUCKETS   256      // cubos del histograma de esperas
+
+// Contador escrito solo por su dueño y leído por cualquiera
+#define BUMP(c, v) atomic_store_explicit(&(c), \
+        atomic_load_explicit(&(c), memory_order_relaxed) + (v), memory_order_relaxed)
+#define PEEK(c) atomic_load_explicit(&(c), memory_order_relaxed)
+
+// Array circular de una cola; size es potencia de 2
+typedef struct tp_array {
+    long size;
+    struct tp_array *older;     // array anterior (se libera con el pool)
+    _Atomic(tp_task_t *) buf[];
+} tp_array_t;
+
+typedef struct {
+    // top lo tocan los ladrones y bottom sobre todo el dueño: en líneas de
+    // caché distintas
+    _Alignas(CACHE_LINE) atomic_long top;
+    _Alignas(CACHE_LINE) atomic_long bottom;
+    _Atomic(tp_array_t *) array;
+} tp_deque_t;
+
+// Contadores de un carril en un worker
+typedef struct {
+    atomic_ullong submitted;    // enviadas desde este worker
+    atomic_ullong executed;     // empezadas por este worker
+    atomic_ullong aged;
+    atomic_ullong waits;        // esperas medidas
+    atomic_ullong wait_sum, wait_max;
+    atomic_ullong hist[WAIT_BUCKETS];
+} lane_counters_t;
+
+typedef struct {
+    tp_deque_t     deque[TP_LANES];
+    threadpool_t  *pool;
+    pthread_t      tid;
+    int            index;
+    unsigned       seed;        // para elegir víctima al robar
+    long           done;        // hechas y aún no restadas de pending
+    int            streak;      // tareas P seguidas
+    int            cpu;         // CPU a la que está fijado, o -1
+    void          *local;       // memoria local (tp_local)
+    // Contadores (solo los escribe el propio worker)
+    _Alignas(CACHE_LINE) atomic_ullong executed, stolen, injected, sleeps;
+    lane_counters_t lane[TP_LANES];
+} tp_worker_t;
+
+struct threadpool {
+    tp_worker_t      *workers;
+    int               nworkers;
+    atomic_int        max_streak;
+    atomic_ullong     max_age;  // ns
+    atomic_int        wait_sample;
+    size_t            local_size;
+    _Alignas(CACHE_LINE) _Atomic(tp_task_t *) inject[TP_LANES];
+    atomic_ullong     ext_submitted[TP_LANES];  // enviadas desde fuera
+    _Alignas(CACHE_LINE) atomic_ullong n_served;    // último servicio de N (ns)
+    _Alignas(CACHE_LINE) atomic_long pending;       // enviadas sin terminar
+    _Alignas(CACHE_LINE) atomic_int sleepers;
+    atomic_int        shutdown;
+    pthread_mutex_t   lock;
+    pthread_cond_t    wake;     // hay trabajo (o hay que terminar)
+    pthread_cond_t    idle;     // pending ha llegado a 0
+};
+
+// Worker del hilo actual (NULL fuera del pool)
+static __thread tp_worker_t *tp_self;
+
+// Tareas enviadas por este hilo desde la última con espera muestreada
+static __thread int tp_unsampled;
+
+/* ---------------- Cola de Chase-Lev ---------------- */
+
+static tp_array_t *array_new(long size) {
+    tp_array_t *a = malloc(sizeof(tp_array_t) + size * sizeof(tp_task_t *));
+    if (!a) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    a->size = size;
+    a->older = NULL;
+    // Tocarlo ya, desde el hilo que lo va a usar (first touch)
+    memset(a->buf, 0, size * sizeof(tp_task_t *));
+    return a;
+}
+
+// El array lo pone deque_alloc() desde el propio worker. Hasta entonces
+// nadie lo lee: la cola está vacía y los ladrones no pasan de top/bottom
+static void deque_init(tp_deque_t *d) {
+    atomic_init(&d->top, 0);
+    atomic_init(&d->bottom, 0);
+    atomic_init(&d->array, NULL);
+}
+
+static void deque_alloc(tp_deque_t *d) {
+    atomic_store_explicit(&d->array, array_new(DEQUE_INITIAL), memory_order_release);
+}
+
+static void deque_free(tp_deque_t *d) {
+    tp_array_t *a = atomic_load(&d->array);
+    while (a) {
+        tp_array_t *older = a->older;
+        free(a);
+        a = older;
+    }
+}
+
+// Copia los elementos [t, b) en un array del doble de tamaño
+static tp_array_t *deque_grow(tp_deque_t *d, tp_array_t *a, long t, long b) {
+    tp_array_t *bigger = array_new(a->size * 2);
+    for (long i = t; i < b; i++)
+        atomic_store_explicit(&bigger->buf[i & (bigger->size - 1)],
+                              atomic_load_explicit(&a->buf[i & (a->size - 1)],
+                                                   memory_order_relaxed),
+                              memory_order_relaxed);
+    bigger->older = a;
+    atomic_store_explicit(&d->array, bigger, memory_order_release);
+    return bigger;
+}
+
+// Solo el dueño
+static void deque_push(tp_deque_t *d, tp_task_t *task) {
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    tp_array_t *a = atomic_load_explicit(&d->array, memory_order_relaxed);
+    if (b - t > a->size - 1)
+        a = deque_grow(d, a, t, b);
+    atomic_store_explicit(&a->buf[b & (a->size - 1)], task, memory_order_relaxed);
+    // Publica la tarea (y lo que escribió quien la preparó) a los ladrones,
+    // que leen bottom con acquire
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_release);
+}
+
+// Solo el dueño: saca la última que metió, o NULL
+static tp_task_t *deque_take(tp_deque_t *d) {
+    // Vacía: solo el dueño mete y los ladrones solo suben top, así que no
+    // puede dejar de estarlo por debajo de nosotros. Evita la barrera, que
+    // es lo caro, al mirar el carril P vacío antes de cada tarea N
+    if (atomic_load_explicit(&d->bottom, memory_order_relaxed) <=
+        atomic_load_explicit(&d->top, memory_order_relaxed))
+        return NULL;
+
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    tp_array_t *a = atomic_load_explicit(&d->array, memory_order_relaxed);
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&d->top, memory_order_relaxed);
+    tp_task_t *task = NULL;
+
+    if (t <= b) {
+        task = atomic_load_explicit(&a->buf[b & (a->size - 1)], memory_order_relaxed);
+        if (t == b) {
+            // La última: se la disputamos a los ladrones
+            if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                         memory_order_seq_cst,
+                                                         memory_order_relaxed))
+                task = NULL;
+            atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        }
+    } else {
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+// Cualquier hilo: saca la más antigua, o NULL (vacía o perdió la carrera)
+static tp_task_t *deque_steal(tp_deque_t *d) {
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    if (t >= b)
+        return NULL;
+    tp_array_t *a = atomic_load_explicit(&d->array, memory_order_acquire);
+    tp_task_t *task = atomic_load_explicit(&a->buf[t & (a->size - 1)],
+                                           memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed))
+        return NULL;
+    return task;
+}
+
+static int deque_empty(tp_deque_t *d) {
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    return t >= b;
+}
+
+/* ---------------- Métricas ---------------- */
+
+static unsigned long long clock_ns(clockid_t clk) {
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static unsigned long long now_ns(void) {
+    return clock_ns(CLOCK_MONOTONIC);
+}
+
+// Reloj para el envejecimiento
+static unsigned long long coarse_ns(void) {
+    return clock_ns(CLOCK_MONOTONIC_COARSE);
+}
+
+// Tiempo desde 'then' (otro worker puede haber guardado una hora posterior
+// a nuestra 'now')
+static unsigned long long elapsed(unsigned long long then, unsigned long long now) {
+    return now > then ? now - then : 0;
+}
+
+// Cubo de una espera: cuatro por potencia de 2 (por debajo de 4 ns, uno
+// por valor)
+static int wait_bucket(unsigned long long ns) {
+    if (ns < 4)
+        return ns;
+    int b = 63 - __builtin_clzll(ns);
+    return b * 4 + ((ns >> (b - 2)) & 3);
+}
+
+// Valor representativo (el centro) de un cubo
+static unsigned long long bucket_value(int bucket) {
+    if (bucket < 4)
+        return bucket;
+    int b = bucket / 4, sub = bucket % 4;
+    unsigned long long lo = (4ull + sub) << (b - 2);
+    return lo + (1ull << (b - 2)) / 2;
+}
+
+static void account_start(tp_worker_t *w, tp_task_t *task) {
+    lane_counters_t *lc = &w->lane[task->lane];
+    BUMP(lc->executed, 1);
+    if (task->submitted == 0)
+        return;         // espera no muestreada
+
+    unsigned long long wait = elapsed(task->submitted, now_ns());
+    BUMP(lc->waits, 1);
+    BUMP(lc->wait_sum, wait);
+    if (wait > PEEK(lc->wait_max))
+        atomic_store_explicit(&lc->wait_max, wait, memory_order_relaxed);
+    BUMP(lc->hist[wait_bucket(wait)], 1);
+}
+
+static unsigned long long quantile(const unsigned long long *hist,
+                                   unsigned long long total, double q) {
+    if (total == 0)
+        return 0;
+    unsigned long long rank = q * total, seen = 0;
+    for (int i = 0; i < WAIT_BUCKETS; i++) {
+        seen += hist[i];
+        if (seen > rank)
+            return bucket_value(i);
+    }
+    return bucket_value(WAIT_BUCKETS - 1);
+}
+
+/* ---------------- Pool ---------------- */
+
+// Despierta a un worker dormido, si hay alguno
+static void wake_one(threadpool_t *pool) {
+    if (atomic_load(&pool->sleepers) > 0) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+// Resta de pending las tareas hechas por el worker; si era lo último,
+// avisa a tp_wait()
+static void flush_done(tp_worker_t *w) {
+    if (w->done == 0)
+        return;
+    threadpool_t *pool = w->pool;
+    long done = w->done;
+    w->done = 0;
+    if (atomic_fetch_sub(&pool->pending, done) == done) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_broadcast(&pool->idle);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+// Se lleva la cola de inyección del carril: devuelve la primera tarea y
+// mete las demás en su cola
+static tp_task_t *take_injected(tp_worker_t *w, int lane) {
+    threadpool_t *pool = w->pool;
+    if (atomic_load_explicit(&pool->inject[lane], memory_order_relaxed) == NULL)
+        return NULL;
+    tp_task_t *list = atomic_exchange(&pool->inject[lane], NULL);
+    if (!list)
+        return NULL;
+
+    // La pila va de la más reciente a la más antigua. La más antigua se
+    // ejecuta ya y las demás se meten en ese mismo orden: el dueño las saca
+    // por abajo en orden de envío y los ladrones se llevan las más recientes
+    // Una vez en el deque la tarea puede robarse, ejecutarse y liberarse o
+    // reenviarse (lo que reescribe next): hay que leer next antes de meterla
+    tp_task_t *t = list;
+    unsigned long long n = 1;
+    for (tp_task_t *next = t->next; next; next = t->next) {
+        deque_push(&w->deque[lane], t);
+        t = next;
+        n++;
+    }
+    tp_task_t *first = t;
+    BUMP(w->injected, n);
+    if (n > 1)
+        wake_one(pool);
+    return first;
+}
+
+// Roba del carril a los demás empezando por uno al azar
+static tp_task_t *steal_any(tp_worker_t *w, int lane) {
+    threadpool_t *pool = w->pool;
+    int n = pool->nworkers;
+    w->seed = w->seed * 1103515245 + 12345;
+    int start = (w->seed >> 16) % n;
+    for (int i = 0; i < n; i++) {
+        tp_worker_t *victim = &pool->workers[(start + i) % n];
+        if (victim == w)
+            continue;
+        tp_task_t *task = deque_steal(&victim->deque[lane]);
+        if (task) {
+            BUMP(w->stolen, 1);
+            return task;
+        }
+    }
+    return NULL;
+}
+
+// ¿Queda trabajo en algún sitio?
+static int work_available(threadpool_t *pool) {
+    for (int lane = 0; lane < TP_LANES; lane++) {
+        if (atomic_load(&pool->inject[lane]) != NULL)
+            return 1;
+        for (int i = 0; i < pool->nworkers; i++)
+            if (!deque_empty(&pool->workers[i].deque[lane]))
+                return 1;
+    }
+    return 0;
+}
+
+static tp_task_t *find_in_lane(tp_worker_t *w, int lane) {
+    tp_task_t *task = deque_take(&w->deque[lane]);
+    if (!task)
+        task = take_injected(w, lane);
+    if (!task)
+        task = steal_any(w, lane);
+    return task;
+}
+
+// Busca la siguiente tarea: primero el carril P, salvo que toque servir el
+// N por envejecimiento
+static tp_task_t *find_task(tp_worker_t *w) {
+    threadpool_t *pool = w->pool;
+    unsigned long long now = 0;
+    int first = TP_LANE_P;
+    if (w->streak > 0) {
+        int max_streak = atomic_load_explicit(&pool->max_streak, memory_order_relaxed);
+        unsigned long long max_age = PEEK(pool->max_age);
+        if (max_streak > 0 && w->streak >= max_streak) {
+            first = TP_LANE_N;
+        } else if (max_age > 0) {
+            now = coarse_ns();
+            if (elapsed(PEEK(pool->n_served), now) > max_age)
+                first = TP_LANE_N;
+        }
+    }
+
+    tp_task_t *task = find_in_lane(w, first);
+    if (task) {
+        if (first == TP_LANE_N)
+            BUMP(w->lane[TP_LANE_N].aged, 1);
+    } else {
+        if (first == TP_LANE_N) {
+            // Nadie espera en N: empezar de cero
+            w->streak = 0;
+            atomic_store_explicit(&pool->n_served, now ? now : coarse_ns(),
+                                  memory_order_relaxed);
+        }
+        task = find_in_lane(w, TP_LANES - 1 - first);
+    }
+    if (!task)
+        return NULL;
+
+    if (task->lane == TP_LANE_P) {
+        w->streak++;
+    } else if (w->streak > 0) {
+        // Primera N tras una racha de P: el carril N ha sido servido. Sin
+        // racha no hace falta, porque nadie va a mirar n_served
+        w->streak = 0;
+        unsigned long long max_age = PEEK(pool->max_age);
+        if (!now)
+            now = coarse_ns();
+        if (max_age > 0 && elapsed(PEEK(pool->n_served), now) > max_age / 4)
+            atomic_store_explicit(&pool->n_served, now, memory_order_relaxed);
+    }
+    return task;
+}
+
+static void *worker_main(void *arg) {
+    tp_worker_t *w = arg;
+    threadpool_t *pool = w->pool;
+    tp_self = w;
+
+    // Reservado y tocado desde aquí para que quede en el nodo de la CPU
+    for (int lane = 0; lane < TP_LANES; lane++)
+        deque_alloc(&w->deque[lane]);
+    if (pool->local_size) {
+        w->local = aligned_alloc(CACHE_LINE, ROUND_UP(pool->local_size, CACHE_LINE));
+        if (!w->local) {
+            perror("aligned_alloc");
+            exit(EXIT_FAILURE);
+        }
+        memset(w->local, 0, pool->local_size);
+    }
+
+    for (;;) {
+        tp_task_t *task = find_task(w);
+        for (int round = 0; !task && round < STEAL_ROUNDS; round++) {
+            // Sin trabajo: lo hecho cuenta ya, y se insiste un poco antes
+            // de dormir (dormir y despertar cuesta varios microsegundos)
+            flush_done(w);
+            if (atomic_load(&pool->shutdown))
+                return NULL;
+            sched_yield();
+            task = find_task(w);
+        }
+        if (!task) {
+            pthread_mutex_lock(&pool->lock);
+            atomic_fetch_add(&pool->sleepers, 1);
+            while (!atomic_load(&pool->shutdown) && !work_available(pool)) {
+                BUMP(w->sleeps, 1);
+                pthread_cond_wait(&pool->wake, &pool->lock);
+            }
+            atomic_fetch_sub(&pool->sleepers, 1);
+            pthread_mutex_unlock(&pool->lock);
+            continue;
+        }
+
+        account_start(w, task);
+        task->fn(task);         // puede liberar o reenviar la tarea
+        BUMP(w->executed, 1);
+        if (++w->done >= DONE_BATCH)
+            flush_done(w);
+    }
+}
+
+threadpool_t *tp_create(int nthreads) {
+    return tp_create_pinned(nthreads, NULL, 0);
+}
+
+threadpool_t *tp_create_pinned(int nthreads, const int *cpus, size_t local_size) {
+    if (nthreads <= 0)
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads <= 0)
+        nthreads = 1;
+
+    threadpool_t *pool = aligned_alloc(CACHE_LINE, sizeof(threadpool_t));
+    if (!pool)
+        return NULL;
+    memset(pool, 0, sizeof(*pool));
+    pool->workers = aligned_alloc(CACHE_LINE, nthreads * sizeof(tp_worker_t));
+    if (!pool->workers) {
+        free(pool);
+        return NULL;
+    }
+    memset(pool->workers, 0, nthreads * sizeof(tp_worker_t));
+    pool->nworkers = nthreads;
+    pool->local_size = local_size;
+    for (int lane = 0; lane < TP_LANES; lane++) {
+        atomic_init(&pool->inject[lane], NULL);
+        atomic_init(&pool->ext_submitted[lane], 0);
+    }
+    atomic_init(&pool->max_streak, TP_MAX_STREAK);
+    atomic_init(&pool->max_age, TP_MAX_AGE_US * 1000ull);
+    atomic_init(&pool->wait_sample, TP_WAIT_SAMPLE);
+    atomic_init(&pool->n_served, coarse_ns());
+    atomic_init(&pool->pending, 0);
+    atomic_init(&pool->sleepers, 0);
+    atomic_init(&pool->shutdown, 0);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+
+    for (int i = 0; i < nthreads; i++) {
+        tp_worker_t *w = &pool->workers[i];
+        for (int lane = 0; lane < TP_LANES; lane++)
+            deque_init(&w->deque[lane]);
+        w->pool = pool;
+        w->index = i;
+        w->seed = i * 2654435761u + 1;
+        w->cpu = (cpus ? cpus[i] : -1);
+    }
+    for (int i = 0; i < nthreads; i++) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        int err = 0;
+        if (cpus && (cpus[i] < 0 || cpus[i] >= CPU_SETSIZE)) {
+            err = EINVAL;
+        } else if (cpus) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpus[i], &set);
+            err = pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+        }
+        if (!err)
+            err = pthread_create(&pool->workers[i].tid, &attr, worker_main,
+                                 &pool->workers[i]);
+        pthread_attr_destroy(&attr);
+        if (err) {
+            // Parar los que ya estaban en marcha
+            pool->nworkers = i;
+            tp_destroy(pool);
+            errno = err;
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+int tp_size(const threadpool_t *pool) {
+    return pool->nworkers;
+}
+
+int tp_worker_cpu(const threadpool_t *pool, int i) {
+    return pool->workers[i].cpu;
+}
+
+void *tp_local(size_t *size) {
+    tp_worker_t *w = tp_self;
+    if (size)
+        *size = (w ? w->pool->local_size : 0);
+    return (w ? w->local : NULL);
+}
+
+void tp_set_aging(threadpool_t *pool, int max_streak, unsigned max_age_us) {
+    atomic_store(&pool->max_streak, max_streak > 0 ? max_streak : 0);
+    atomic_store(&pool->max_age, max_age_us * 1000ull);
+}
+
+void tp_set_wait_sampling(threadpool_t *pool, int every) {
+    atomic_store(&pool->wait_sample, every > 0 ? every : 0);
+}
+
+void tp_task_init(tp_task_t *task, void (*fn)(tp_task_t *)) {
+    task->fn = fn;
+    task->next = NULL;
+    task->submitted = 0;
+    task->lane = TP_LANE_N;
+}
+
+void tp_submit_lane(threadpool_t *pool, tp_task_t *task, int lane) {
+    if (lane != TP_LANE_P)
+        lane = TP_LANE_N;
+    task->lane = lane;
+    task->submitted = 0;
+    int every = atomic_load_explicit(&pool->wait_sample, memory_order_relaxed);
+    if (every > 0 && ++tp_unsampled >= every) {
+        tp_unsampled = 0;
+        task->submitted = now_ns();
+    }
+    atomic_fetch_add_explicit(&pool->pending, 1, memory_order_relaxed);
+    tp_worker_t *w = tp_self;
+    if (w && w->pool == pool) {
+        BUMP(w->lane[lane].submitted, 1);
+        deque_push(&w->deque[lane], task);
+    } else {
+        atomic_fetch_add_explicit(&pool->ext_submitted[lane], 1, memory_order_relaxed);
+        _Atomic(tp_task_t *) *stack = &pool->inject[lane];
+        tp_task_t *head = atomic_load_explicit(stack, memory_order_relaxed);
+        do {
+            task->next = head;
+        } while (!atomic_compare_exchange_weak_explicit(stack, &head, task,
+                                                        memory_order_release,
+                                                        memory_order_relaxed));
+    }
+    atomic_thread_fence(memory_order_seq_cst);
+    wake_one(pool);
+}
+
+void tp_submit(threadpool_t *pool, tp_task_t *task) {
+    tp_submit_lane(pool, task, TP_LANE_N);
+}
+
+void tp_wait(threadpool_t *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (atomic_load(&pool->pending) != 0)
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+unsigned long long tp_lane_depth(const threadpool_t *pool, int lane) {
+    // Se leen las empezadas antes que las enviadas: así la resta no puede
+    // salir negativa
+    unsigned long long executed = 0, submitted;
+    for (int i = 0; i < pool->nworkers; i++)
+        executed += PEEK(pool->workers[i].lane[lane].executed);
+    atomic_thread_fence(memory_order_acquire);
+    submitted = PEEK(pool->ext_submitted[lane]);
+    for (int i = 0; i < pool->nworkers; i++)
+        submitted += PEEK(pool->workers[i].lane[lane].submitted);
+    return submitted > executed ? submitted - executed : 0;
+}
+
+void tp_stats(const threadpool_t *pool, tp_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    for (int i = 0; i < pool->nworkers; i++) {
+        tp_worker_t *w = &pool->workers[i];
+        stats->executed += PEEK(w->executed);
+        stats->stolen += PEEK(w->stolen);
+        stats->injected += PEEK(w->injected);
+        stats->sleeps += PEEK(w->sleeps);
+    }
+
+    for (int lane = 0; lane < TP_LANES; lane++) {
+        tp_lane_stats_t *ls = &stats->lane[lane];
+        unsigned long long hist[WAIT_BUCKETS] = { 0 }, sum = 0, waits = 0;
+        for (int i = 0; i < pool->nworkers; i++) {
+            lane_counters_t *lc = &pool->workers[i].lane[lane];
+            ls->executed += PEEK(lc->executed);
+            ls->aged += PEEK(lc->aged);
+            waits += PEEK(lc->waits);
+            sum += PEEK(lc->wait_sum);
+            if (PEEK(lc->wait_max) > ls->wait_max)
+                ls->wait_max = PEEK(lc->wait_max);
+            for (int b = 0; b < WAIT_BUCKETS; b++)
+                hist[b] += PEEK(lc->hist[b]);
+        }
+        ls->depth = tp_lane_depth(pool, lane);
+        ls->submitted = ls->executed + ls->depth;
+        ls->waits = waits;
+        if (waits) {
+            ls->wait_mean = sum / waits;
+            ls->wait_p50 = quantile(hist, waits, 0.50);
+            ls->wait_p99 = quantile(hist, waits, 0.99);
+            // El centro del cubo puede pasarse del máximo visto
+            if (ls->wait_p50 > ls->wait_max)
+                ls->wait_p50 = ls->wait_max;
+            if (ls->wait_p99 > ls->wait_max)
+                ls->wait_p99 = ls->wait_max;
+        }
+    }
+}
+
+void tp_destroy(threadpool_t *pool) {
+    tp_wait(pool);
+    pthread_mutex_lock(&pool->lock);
+    atomic_store(&pool->shutdown, 1);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->nworkers; i++)
+        pthread_join(pool->workers[i].tid, NULL);
+    for (int i = 0; i < pool->nworkers; i++) {
+        for (int lane = 0; lane < TP_LANES; lane++)
+            deque_free(&pool->workers[i].deque[lane]);
+        free(pool->workers[i].local);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->idle);
+    free(pool->workers);
+    free(pool);
+}
@@ -0,0 +1,167 @@
+/* threadpool.h
+ *
+ * Pool de hilos persistente con reparto de trabajo por robo (work stealing).
+ *
+ * Cada hilo del pool (worker) tiene su propia cola doble de Chase-Lev: el
+ * dueño mete y saca tareas por un extremo sin cerrojos, y los demás roban
+ * por el otro extremo con un CAS cuando se quedan sin trabajo. Las tareas
+ * que se envían desde fuera del pool van a una cola de inyección (una pila
+ * sin cerrojos de la que un worker se lleva todas las tareas de golpe).
+ *
+ * Las tareas son intrusivas: el pool no reserva memoria por tarea. El
+ * usuario mete un tp_task_t dentro de su propia estructura y recupera la
+ * estructura en la función de la tarea con TP_CONTAINER_OF:
+ *
+ *   typedef struct {
+ *       tp_task_t task;
+ *       int       num;
+ *   } trabajo_t;
+ *
+ *   void hacer(tp_task_t *t) {
+ *       trabajo_t *tr = TP_CONTAINER_OF(t, trabajo_t, task);
+ *       ...
+ *   }
+ *
+ *   trabajo_t tr = { .num = 5 };
+ *   tp_task_init(&tr.task, hacer);
+ *   tp_submit(pool, &tr.task);
+ *   tp_wait(pool);
+ *
+ * Hay dos carriles de prioridad: TP_LANE_P (prioritario) y TP_LANE_N
+ * (normal). Los workers vacían siempre antes el carril P, salvo por el
+ * envejecimiento del carril N, que evita que se quede sin servir
+ * mientras llegan tareas P (ver tp_set_aging). tp_submit() envía al
+ * carril N y tp_submit_lane() al que se diga.
+ *
+ * La memoria de una tarea es del usuario y tiene que seguir siendo válida
+ * hasta que su función empiece a ejecutarse; el pool no la toca después
+ * de llamarla, así que la función puede liberarla o volver a enviarla.
+ */
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stddef.h>
+
+// Carriles de prioridad
+enum {
+    TP_LANE_P = 0,              // prioritario: se vacía primero
+    TP_LANE_N = 1,              // normal
+    TP_LANES
+};
+
+// Nodo de tarea, para meter dentro de la estructura del usuario
+typedef struct tp_task {
+    void (*fn)(struct tp_task *task);
+    struct tp_task *next;       // enlace en la cola de inyección
+    unsigned long long submitted;   // instante del envío (ns), para la espera
+    int lane;                   // carril al que se envió
+} tp_task_t;
+
+// Estructura que contiene al miembro 'member' apuntado por 'ptr'
+#define TP_CONTAINER_OF(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
+typedef struct threadpool threadpool_t;
+
+// Métricas de un carril. Las esperas (del envío al comienzo de la
+// ejecución) van en ns y salen de las tareas muestreadas (ver
+// tp_set_wait_sampling); los cuantiles salen de un histograma con cuatro
+// cubos por potencia de 2, así que tienen un error de hasta un 12%.
+typedef struct {
+    unsigned long long submitted;   // tareas enviadas
+    unsigned long long executed;    // tareas empezadas
+    unsigned long long depth;       // en cola: enviadas y aún sin empezar
+    unsigned long long aged;        // N adelantadas a P por envejecimiento
+    unsigned long long waits;       // esperas medidas
+    unsigned long long wait_mean, wait_p50, wait_p99, wait_max;
+} tp_lane_stats_t;
+
+// Contadores del pool (sumados de todos los workers)
+typedef struct {
+    unsigned long long executed;    // tareas ejecutadas
+    unsigned long long stolen;      // tareas robadas a otro worker
+    unsigned long long injected;    // tareas sacadas de la cola de inyección
+    unsigned long long sleeps;      // veces que un worker se ha dormido
+    tp_lane_stats_t    lane[TP_LANES];
+} tp_stats_t;
+
+/**
+ * tp_create:
+ *   Crea un pool con 'nthreads' workers (0 = uno por CPU en línea).
+ *   Devuelve NULL si no se pudo (errno indica el motivo).
+ */
+threadpool_t *tp_create(int nthreads);
+
+/**
+ * tp_create_pinned:
+ *   Como tp_create, pero si 'cpus' no es NULL el worker i se crea fijado a
+ *   la CPU cpus[i] (ver topo_plan en topology.h), y si 'local_size' no es 0
+ *   cada worker reserva al arrancar 'local_size' bytes de memoria local,
+ *   que se ponen en el nodo NUMA de su CPU (ver tp_local). Si no se puede
+ *   fijar un hilo (CPU inexistente, por ejemplo) devuelve NULL con errno.
+ */
+threadpool_t *tp_create_pinned(int nthreads, const int *cpus, size_t local_size);
+
+// Número de workers del pool
+int tp_size(const threadpool_t *pool);
+
+// CPU a la que está fijado el worker i, o -1
+int tp_worker_cpu(const threadpool_t *pool, int i);
+
+// Memoria local del worker que ejecuta la tarea actual (NULL fuera del
+// pool o si se creó sin ella); si 'size' no es NULL, guarda su tamaño
+void *tp_local(size_t *size);
+
+// Prepara una tarea para ejecutar fn(task)
+void tp_task_init(tp_task_t *task, void (*fn)(tp_task_t *));
+
+/**
+ * tp_submit_lane:
+ *   Envía una tarea al carril 'lane'. Desde un worker del pool va a su
+ *   propia cola del carril (la primera que ejecutará él y la última que le
+ *   roben); desde fuera, a la cola de inyección del carril.
+ */
+void tp_submit_lane(threadpool_t *pool, tp_task_t *task, int lane);
+
+// Envía una tarea al carril normal
+void tp_submit(threadpool_t *pool, tp_task_t *task);
+
+/**
+ * tp_set_aging:
+ *   Límites para que el carril N no se quede sin servir. Un worker sirve
+ *   una tarea N (si la hay) antes que las P cuando:
+ *    - lleva 'max_streak' tareas P seguidas, o
+ *    - nadie en el pool ha servido el carril N en 'max_age_us' µs.
+ *   0 desactiva el límite correspondiente; con los dos a 0 la prioridad es
+ *   estricta. Por defecto: TP_MAX_STREAK tareas y TP_MAX_AGE_US µs.
+ */
+void tp_set_aging(threadpool_t *pool, int max_streak, unsigned max_age_us);
+
+#define TP_MAX_STREAK   32
+#define TP_MAX_AGE_US   10000
+
+/**
+ * tp_set_wait_sampling:
+ *   Mide la espera de una de cada 'every' tareas enviadas por cada hilo
+ *   (1 = todas, 0 = ninguna). Leer el reloj en el envío y al empezar
+ *   cuesta más que el resto de la gestión de una tarea diminuta, así que
+ *   por defecto se muestrea una de cada TP_WAIT_SAMPLE.
+ */
+void tp_set_wait_sampling(threadpool_t *pool, int every);
+
+#define TP_WAIT_SAMPLE  16
+
+// Tareas enviadas a un carril y aún sin empezar (barato, para muestrear)
+unsigned long long tp_lane_depth(const threadpool_t *pool, int lane);
+
+// Espera a que se hayan ejecutado todas las tareas enviadas (incluidas las
+// que envíen las propias tareas). No se puede llamar desde un worker.
+void tp_wait(threadpool_t *pool);
+
+void tp_stats(const threadpool_t *pool, tp_stats_t *stats);
+
+// Espera a que terminen las tareas, para los workers y libera el pool
+void tp_destroy(threadpool_t *pool);
+
+#endif
@@ -0,0 +1,255 @@
+/* topology.c
+ *
+ * Implementación de topology.h.
+ *
+ * Para los planes se calcula de cada CPU su grupo (paquete y nodo), el
+ * rango de su núcleo dentro del grupo y su posición SMT dentro del núcleo.
+ * compact las ordena por (grupo, núcleo, smt) y scatter por (smt, núcleo,
+ * grupo), que es la misma tabla recorrida en el otro sentido.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sched.h>      // CPU_SETSIZE
+#include "topology.h"
+
+// Orden de una CPU dentro de los planes
+typedef struct {
+    int cpu;
+    int package, node, core;
+    int group, core_rank, smt;
+} rank_t;
+
+int parse_cpulist(const char *s, int *out, int max) {
+    int n = 0;
+    while (*s && *s != '\n') {
+        char *end;
+        long lo = strtol(s, &end, 10), hi;
+        // Fuera de un cpu_set_t no se puede fijar; además así cada rango
+        // tiene como mucho CPU_SETSIZE CPUs y 'n' no se desborda
+        if (end == s || lo < 0 || lo >= CPU_SETSIZE)
+            return -1;
+        s = end;
+        hi = lo;
+        if (*s == '-') {
+            hi = strtol(s + 1, &end, 10);
+            if (end == s + 1 || hi < lo || hi >= CPU_SETSIZE)
+                return -1;
+            s = end;
+        }
+        for (long c = lo; c <= hi; c++) {
+            if (n < max)
+                out[n] = c;
+            n++;
+        }
+        if (n > INT_MAX - CPU_SETSIZE)
+            return -1;
+        if (*s == ',')
+            s++;
+        else if (*s && *s != '\n')
+            return -1;
+    }
+    return n;
+}
+
+// Lee un fichero pequeño de sysfs; devuelve 0 o -1
+static int read_sysfs(const char *path, char *buf, size_t size) {
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return -1;
+    size_t len = fread(buf, 1, size - 1, f);
+    fclose(f);
+    buf[len] = '\0';
+    return 0;
+}
+
+static int read_int(const char *root, int cpu, const char *file, int dflt) {
+    char path[PATH_MAX], buf[64];
+    snprintf(path, sizeof(path), "%s/cpu%d/topology/%s", root, cpu, file);
+    if (read_sysfs(path, buf, sizeof(buf)) < 0 || !isdigit((unsigned char)buf[0]))
+        return dflt;
+    return atoi(buf);
+}
+
+// El nodo NUMA de una CPU es la entrada nodeN de su directorio
+static int cpu_node(const char *root, int cpu) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/cpu%d", root, cpu);
+    DIR *d = opendir(path);
+    if (!d)
+        return 0;
+    int node = 0;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL)
+        if (strncmp(e->d_name, "node", 4) == 0 && isdigit((unsigned char)e->d_name[4])) {
+            node = atoi(e->d_name + 4);
+            break;
+        }
+    closedir(d);
+    return node;
+}
+
+// Posición de 'cpu' entre los hermanos SMT de su núcleo
+static int cpu_smt(const char *root, int cpu) {
+    char path[PATH_MAX], buf[256];
+    int sib[64];
+    snprintf(path, sizeof(path), "%s/cpu%d/topology/thread_siblings_list", root, cpu);
+    if (read_sysfs(path, buf, sizeof(buf)) < 0)
+        return 0;
+    int n = parse_cpulist(buf, sib, 64);
+    for (int i = 0; i < n && i < 64; i++)
+        if (sib[i] == cpu)
+            return i;
+    return 0;
+}
+
+int topo_load(topology_t *t, const char *root) {
+    char path[PATH_MAX], buf[4096];
+    if (!root)
+        root = TOPO_SYSFS;
+    memset(t, 0, sizeof(*t));
+
+    snprintf(path, sizeof(path), "%s/online", root);
+    if (read_sysfs(path, buf, sizeof(buf)) < 0) {
+        perror(path);
+        return -1;
+    }
+    int n = parse_cpulist(buf, NULL, 0);
+    if (n <= 0) {
+        fprintf(stderr, "%s: lista de CPUs no válida\n", path);
+        return -1;
+    }
+    int *ids = malloc(n * sizeof(int));
+    t->cpus = malloc(n * sizeof(topo_cpu_t));
+    if (!ids || !t->cpus) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    parse_cpulist(buf, ids, n);
+
+    for (int i = 0; i < n; i++) {
+        topo_cpu_t *c = &t->cpus[i];
+        c->cpu = ids[i];
+        c->package = read_int(root, c->cpu, "physical_package_id", 0);
+        c->core = read_int(root, c->cpu, "core_id", c->cpu);
+        c->node = cpu_node(root, c->cpu);
+        c->smt = cpu_smt(root, c->cpu);
+        if (c->node + 1 > t->nnodes)
+            t->nnodes = c->node + 1;
+    }
+    t->ncpus = n;
+    free(ids);
+    return 0;
+}
+
+void topo_free(topology_t *t) {
+    free(t->cpus);
+    t->cpus = NULL;
+    t->ncpus = 0;
+}
+
+const topo_cpu_t *topo_cpu(const topology_t *t, int cpu) {
+    for (int i = 0; i < t->ncpus; i++)
+        if (t->cpus[i].cpu == cpu)
+            return &t->cpus[i];
+    return NULL;
+}
+
+static int cmp_physical(const void *a, const void *b) {
+    const rank_t *x = a, *y = b;
+    if (x->package != y->package)
+        return x->package - y->package;
+    if (x->node != y->node)
+        return x->node - y->node;
+    if (x->core != y->core)
+        return x->core - y->core;
+    return x->cpu - y->cpu;
+}
+
+static int cmp_compact(const void *a, const void *b) {
+    const rank_t *x = a, *y = b;
+    if (x->group != y->group)
+        return x->group - y->group;
+    if (x->core_rank != y->core_rank)
+        return x->core_rank - y->core_rank;
+    return x->smt - y->smt;
+}
+
+static int cmp_scatter(const void *a, const void *b) {
+    const rank_t *x = a, *y = b;
+    if (x->smt != y->smt)
+        return x->smt - y->smt;
+    if (x->core_rank != y->core_rank)
+        return x->core_rank - y->core_rank;
+    return x->group - y->group;
+}
+
+int topo_plan(const topology_t *t, const char *policy, int n, int *cpus) {
+    int compact = strcmp(policy, "compact") == 0;
+    int scatter = strcmp(policy, "scatter") == 0;
+
+    if (!compact && !scatter) {
+        // Lista de CPUs
+        int len = parse_cpulist(policy, NULL, 0);
+        if (len <= 0) {
+            fprintf(stderr, "--pin: '%s' no es compact, scatter ni una lista de CPUs"
+                    " (de 0 a %d)\n", policy, CPU_SETSIZE - 1);
+            return -1;
+        }
+        int *list = malloc(len * sizeof(int));
+        if (!list) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        parse_cpulist(policy, list, len);
+        for (int i = 0; i < len; i++)
+            if (!topo_cpu(t, list[i])) {
+                fprintf(stderr, "--pin: la CPU %d no está en línea\n", list[i]);
+                free(list);
+                return -1;
+            }
+        for (int i = 0; i < n; i++)
+            cpus[i] = list[i % len];
+        free(list);
+        return 0;
+    }
+
+    rank_t *r = malloc(t->ncpus * sizeof(rank_t));
+    if (!r) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < t->ncpus; i++) {
+        r[i].cpu = t->cpus[i].cpu;
+        r[i].package = t->cpus[i].package;
+        r[i].node = t->cpus[i].node;
+        r[i].core = t->cpus[i].core;
+        r[i].smt = t->cpus[i].smt;
+    }
+
+    // Grupos y rango de núcleo en orden físico
+    qsort(r, t->ncpus, sizeof(rank_t), cmp_physical);
+    int group = -1, core_rank = -1;
+    for (int i = 0; i < t->ncpus; i++) {
+        if (i == 0 || r[i].package != r[i - 1].package || r[i].node != r[i - 1].node) {
+            group++;
+            core_rank = 0;
+        } else if (r[i].core != r[i - 1].core) {
+            core_rank++;
+        }
+        r[i].group = group;
+        r[i].core_rank = core_rank;
+    }
+
+    qsort(r, t->ncpus, sizeof(rank_t), compact ? cmp_compact : cmp_scatter);
+    for (int i = 0; i < n; i++)
+        cpus[i] = r[i % t->ncpus].cpu;
+    free(r);
+    return 0;
+}
@@ -0,0 +1,68 @@
+/* topology.h
+ *
+ * Topología de CPUs leída de /sys/devices/system/cpu y planes de afinidad
+ * para fijar hilos a CPUs.
+ *
+ * De cada CPU en línea se lee su paquete (physical_package_id), su núcleo
+ * (core_id), su nodo NUMA (la entrada nodeN de su directorio) y su posición
+ * entre los hilos hardware (SMT) de su núcleo (thread_siblings_list).
+ *
+ * Políticas de topo_plan():
+ *   compact  llena primero los hilos SMT de un núcleo, luego los demás
+ *            núcleos del mismo paquete/nodo y luego el siguiente: los
+ *            hilos comparten cachés.
+ *   scatter  reparte primero entre paquetes/nodos, luego entre núcleos, y
+ *            deja los hermanos SMT para el final: cada hilo tiene para sí
+ *            tantas cachés y ancho de banda de memoria como se pueda.
+ *   lista    CPUs concretas, con la sintaxis de cpulist: "0,2,4-7".
+ * Con más hilos que CPUs en el plan, se vuelve a empezar por el principio.
+ */
+
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#define TOPO_SYSFS "/sys/devices/system/cpu"
+
+typedef struct {
+    int cpu;
+    int package;
+    int core;           // core_id (puede no ser consecutivo)
+    int node;           // nodo NUMA (0 si no hay información)
+    int smt;            // posición entre los hermanos SMT de su núcleo
+} topo_cpu_t;
+
+typedef struct {
+    topo_cpu_t *cpus;   // ordenadas por número de CPU
+    int ncpus;
+    int nnodes;
+} topology_t;
+
+/**
+ * topo_load:
+ *   Lee la topología de las CPUs en línea a partir de 'root' (NULL =
+ *   TOPO_SYSFS). Devuelve 0 o -1 si no se pudo leer la lista de CPUs.
+ */
+int topo_load(topology_t *t, const char *root);
+
+void topo_free(topology_t *t);
+
+// Datos de una CPU, o NULL si no está en línea
+const topo_cpu_t *topo_cpu(const topology_t *t, int cpu);
+
+/**
+ * topo_plan:
+ *   Rellena cpus[0..n-1] con la CPU de cada hilo según 'policy' (compact,
+ *   scatter o una lista). Devuelve 0, o -1 si la política no es válida o
+ *   nombra CPUs que no están en línea (con el motivo por stderr).
+ */
+int topo_plan(const topology_t *t, const char *policy, int n, int *cpus);
+
+/**
+ * parse_cpulist:
+ *   Analiza una lista "0,2,4-7" y guarda hasta 'max' CPUs en 'out'.
+ *   Devuelve cuántas había (puede ser más que 'max') o -1 si está mal o
+ *   nombra una CPU >= CPU_SETSIZE.
+ */
+int parse_cpulist(const char *s, int *out, int max);
+
+#endif
@@ -0,0 +1,305 @@
+/* admission.c
+ *
+ * Implementación de admission.h.
+ *
+ * Invariante: al soltar el mutex, si alguien espera es porque no hay
+ * ninguna plaza que pueda ocupar. Las plazas libres que quedan son como
+ * mucho las reservadas para mínimos de clases que no tienen a nadie
+ * esperando. Por eso quien llega solo tiene que mirar su propia clase:
+ * si no hay nadie de ella esperando y hay plaza para él, entra sin colarse
+ * delante de nadie. Cada vez que se libera o se crea una plaza (salida,
+ * subida del aforo o de un mínimo) se reparte en dispatch().
+ *
+ * Reparto de una plaza libre:
+ *   1) Si alguna clase con gente esperando está por debajo de su mínimo
+ *      (solo pasa tras bajar el aforo o subir el mínimo), la plaza es
+ *      suya. Esas clases van en la lista 'urgent'.
+ *   2) Si no, y la plaza no está reservada, se da por Deficit Round Robin
+ *      entre las clases con gente esperando (lista 'active'): la clase en
+ *      cabeza recibe 'weight' plazas seguidas antes de pasar al final.
+ * Las dos listas se limpian de forma perezosa: una clase que ya no cumple
+ * la condición se quita cuando llega a la cabeza. Cada clase entra en
+ * cada lista una vez por cada vez que empieza a cumplirla, así que el
+ * coste amortizado sigue siendo O(1).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "admission.h"
+
+int adm_init(admission_t *a, int capacity, int nclasses) {
+    if (capacity < 0 || nclasses < 1)
+        return -1;
+    a->classes = calloc(nclasses, sizeof(adm_class_t));
+    if (!a->classes)
+        return -1;
+    for (int i = 0; i < nclasses; i++)
+        a->classes[i].weight = 1;
+    pthread_mutex_init(&a->mutex, NULL);
+    a->capacity = capacity;
+    a->inside = a->min_total = a->reserved = 0;
+    a->nclasses = nclasses;
+    a->active_head = a->active_tail = -1;
+    a->urgent_head = a->urgent_tail = -1;
+    return 0;
+}
+
+void adm_destroy(admission_t *a) {
+    pthread_mutex_destroy(&a->mutex);
+    free(a->classes);
+    a->classes = NULL;
+}
+
+/* ---------------- Listas de clases (índices, -1 = fin) ---------------- */
+
+static void active_push(admission_t *a, int c) {
+    a->classes[c].in_active = 1;
+    a->classes[c].next_active = -1;
+    if (a->active_tail >= 0)
+        a->classes[a->active_tail].next_active = c;
+    else
+        a->active_head = c;
+    a->active_tail = c;
+}
+
+static void active_pop(admission_t *a) {
+    adm_class_t *cl = &a->classes[a->active_head];
+    cl->in_active = 0;
+    a->active_head = cl->next_active;
+    if (a->active_head < 0)
+        a->active_tail = -1;
+}
+
+static void urgent_push(admission_t *a, int c) {
+    a->classes[c].in_urgent = 1;
+    a->classes[c].next_urgent = -1;
+    if (a->urgent_tail >= 0)
+        a->classes[a->urgent_tail].next_urgent = c;
+    else
+        a->urgent_head = c;
+    a->urgent_tail = c;
+}
+
+static void urgent_pop(admission_t *a) {
+    adm_class_t *cl = &a->classes[a->urgent_head];
+    cl->in_urgent = 0;
+    a->urgent_head = cl->next_urgent;
+    if (a->urgent_head < 0)
+        a->urgent_tail = -1;
+}
+
+/* ---------------- Plazas ---------------- */
+
+// ¿Puede entrar ahora un cliente de la clase 'cl'?
+static int fits(const admission_t *a, const adm_class_t *cl) {
+    int free_places = a->capacity - a->inside;
+    if (free_places <= 0)
+        return 0;
+    if (cl->inside < cl->min)
+        return 1;               // usa una de sus plazas reservadas
+    return free_places > a->reserved;
+}
+
+static void take_place(admission_t *a, adm_class_t *cl) {
+    if (cl->inside < cl->min)
+        a->reserved--;
+    cl->inside++;
+    cl->admitted++;
+    a->inside++;
+}
+
+static void release_place(admission_t *a, adm_class_t *cl) {
+    cl->inside--;
+    a->inside--;
+    if (cl->inside < cl->min)
+        a->reserved++;
+}
+
+// Si la clase 'c' espera por debajo de su mínimo, a la lista urgente
+static void check_urgent(admission_t *a, int c) {
+    adm_class_t *cl = &a->classes[c];
+    if (cl->head && cl->inside < cl->min && !cl->in_urgent)
+        urgent_push(a, c);
+}
+
+// Cede una plaza al primero de la cola de 'cl' y le despierta solo a él
+static void admit_head(admission_t *a, adm_class_t *cl) {
+    adm_ticket_t *t = cl->head;
+    cl->head = t->next;
+    if (!cl->head)
+        cl->tail = NULL;
+    cl->waiting--;
+    take_place(a, cl);
+    t->inside = a->inside;
+    t->admitted = 1;
+    pthread_cond_signal(&t->cond);
+}
+
+static adm_class_t *pick_urgent(admission_t *a) {
+    while (a->urgent_head >= 0) {
+        adm_class_t *cl = &a->classes[a->urgent_head];
+        if (cl->head && cl->inside < cl->min)
+            return cl;
+        urgent_pop(a);
+    }
+    return NULL;
+}
+
+static adm_class_t *pick_drr(admission_t *a) {
+    while (a->active_head >= 0) {
+        int c = a->active_head;
+        adm_class_t *cl = &a->classes[c];
+        if (!cl->head) {
+            // Se quedó sin nadie esperando: pierde lo que le quedara
+            cl->deficit = 0;
+            active_pop(a);
+            continue;
+        }
+        if (cl->deficit == 0)
+            cl->deficit = cl->weight;   // empieza su turno en la ronda
+        if (--cl->deficit == 0) {
+            // Turno agotado: al final de la lista
+            active_pop(a);
+            active_push(a, c);
+        }
+        return cl;
+    }
+    return NULL;
+}
+
+// Reparte las plazas libres entre los que esperan. Con el mutex cogido.
+static void dispatch(admission_t *a) {
+    while (a->capacity - a->inside > 0) {
+        adm_class_t *cl = pick_urgent(a);
+        if (!cl) {
+            if (a->capacity - a->inside <= a->reserved)
+                break;          // solo quedan plazas reservadas
+            cl = pick_drr(a);
+            if (!cl)
+                break;          // nadie espera
+        }
+        admit_head(a, cl);
+    }
+}
+
+/* ---------------- Interfaz ---------------- */
+
+int adm_set_class(admission_t *a, int c, int weight, int min) {
+    if (c < 0 || c >= a->nclasses || weight < 1 || min < 0)
+        return -1;
+    pthread_mutex_lock(&a->mutex);
+    adm_class_t *cl = &a->classes[c];
+    if (a->min_total - cl->min + min > a->capacity) {
+        pthread_mutex_unlock(&a->mutex);
+        return -1;
+    }
+    // Plazas reservadas que le faltan a la clase, antes y después
+    int before = (cl->min > cl->inside ? cl->min - cl->inside : 0);
+    int after = (min > cl->inside ? min - cl->inside : 0);
+    a->reserved += after - before;
+    a->min_total += min - cl->min;
+    cl->min = min;
+    cl->weight = weight;
+    if (cl->deficit > weight)
+        cl->deficit = weight;
+    check_urgent(a, c);
+    dispatch(a);
+    pthread_mutex_unlock(&a->mutex);
+    return 0;
+}
+
+int adm_set_capacity(admission_t *a, int capacity) {
+    pthread_mutex_lock(&a->mutex);
+    if (capacity < a->min_total) {
+        pthread_mutex_unlock(&a->mutex);
+        return -1;
+    }
+    a->capacity = capacity;
+    dispatch(a);
+    pthread_mutex_unlock(&a->mutex);
+    return 0;
+}
+
+int adm_arrive(admission_t *a, int c, adm_ticket_t *t) {
+    pthread_mutex_lock(&a->mutex);
+    adm_class_t *cl = &a->classes[c];
+
+    // Nadie de su clase delante y plaza para él: entra (ver invariante)
+    if (!cl->head && fits(a, cl)) {
+        take_place(a, cl);
+        t->ticket = -1;
+        t->waiting = 0;
+        t->inside = a->inside;
+        pthread_mutex_unlock(&a->mutex);
+        return 0;
+    }
+
+    // Coge turno y se pone al final de la cola de su clase
+    pthread_cond_init(&t->cond, NULL);
+    t->admitted = 0;
+    t->next = NULL;
+    t->ticket = cl->next_ticket++;
+    if (cl->tail)
+        cl->tail->next = t;
+    else
+        cl->head = t;
+    cl->tail = t;
+    t->waiting = ++cl->waiting;
+    if (!cl->in_active)
+        active_push(a, c);
+    check_urgent(a, c);
+    pthread_mutex_unlock(&a->mutex);
+    return 1;
+}
+
+void adm_wait(admission_t *a, adm_ticket_t *t) {
+    pthread_mutex_lock(&a->mutex);
+    // Solo nos despierta quien nos cede la plaza (o un despertar espurio)
+    while (!t->admitted)
+        pthread_cond_wait(&t->cond, &a->mutex);
+    pthread_mutex_unlock(&a->mutex);
+    pthread_cond_destroy(&t->cond);
+}
+
+int adm_enter(admission_t *a, int c, adm_ticket_t *t) {
+    adm_ticket_t local;
+    if (!t)
+        t = &local;
+    if (adm_arrive(a, c, t))
+        adm_wait(a, t);
+    return t->ticket;
+}
+
+int adm_try_enter(admission_t *a, int c) {
+    int ret = -1;
+    pthread_mutex_lock(&a->mutex);
+    adm_class_t *cl = &a->classes[c];
+    if (!cl->head && fits(a, cl)) {
+        take_place(a, cl);
+        ret = 0;
+    }
+    pthread_mutex_unlock(&a->mutex);
+    return ret;
+}
+
+int adm_exit(admission_t *a, int c) {
+    pthread_mutex_lock(&a->mutex);
+    release_place(a, &a->classes[c]);
+    int inside = a->inside;
+    check_urgent(a, c);
+    dispatch(a);
+    pthread_mutex_unlock(&a->mutex);
+    return inside;
+}
+
+void adm_counts(admission_t *a, int c, int *inside, int *waiting, int *total) {
+    pthread_mutex_lock(&a->mutex);
+    if (inside)
+        *inside = a->classes[c].inside;
+    if (waiting)
+        *waiting = a->classes[c].waiting;
+    if (total)
+        *total = a->inside;
+    pthread_mutex_unlock(&a->mutex);
+}
@@ -0,0 +1,146 @@
+/* admission.h
+ *
+ * Control de admisión con aforo y K clases de clientes, generalizando el
+ * VIP/normal de disco.c. Sirve igual para una discoteca que para limitar
+ * conexiones simultáneas a un servidor.
+ *
+ *   - Aforo (capacity): plazas ocupadas a la vez como mucho. Se puede
+ *     cambiar en marcha; si baja, nadie sale, simplemente no entra nadie
+ *     hasta que se vuelva a estar por debajo.
+ *   - Mínimo garantizado (min) por clase: esas plazas quedan reservadas
+ *     para la clase mientras no las use; las demás clases no pueden
+ *     ocuparlas. La suma de los mínimos no puede pasar del aforo.
+ *   - Peso (weight) por clase: las plazas que no son de ningún mínimo se
+ *     reparten entre las clases que esperan con Deficit Round Robin; con
+ *     pesos 3 y 1, por cada 4 plazas 3 son para la primera clase y 1 para
+ *     la segunda, pero ninguna clase con clientes esperando se queda sin
+ *     entrar nunca (al contrario que con prioridad estricta).
+ *   - Dentro de cada clase la entrada es FIFO estricta por turnos: cada
+ *     cliente que espera coge número y duerme en su propia variable de
+ *     condición; quien sale le cede la plaza directamente y solo le
+ *     despierta a él.
+ *
+ * Entrar y salir cuestan O(1) con el mutex cogido (amortizado: cada plaza
+ * que se libera se cede a lo sumo a un cliente).
+ *
+ *   admission_t a;
+ *   adm_init(&a, 5, 2);
+ *   adm_set_class(&a, 0, 1, 1);       // clase 0: peso 1, mínimo 1
+ *   adm_set_class(&a, 1, 3, 0);       // clase 1: peso 3
+ *   adm_enter(&a, c, NULL);
+ *   ...
+ *   adm_exit(&a, c);
+ *   adm_destroy(&a);
+ *
+ * Para saber qué pasó (turno, cola, ocupación) sin volver a coger el
+ * mutex, la entrada se puede hacer en dos pasos con un adm_ticket_t: los
+ * datos se rellenan con el mutex cogido, en el mismo momento en que se
+ * entra o se pasa a esperar.
+ *
+ *   adm_ticket_t t;
+ *   if (adm_arrive(&a, c, &t))        // a la cola: t.ticket, t.waiting
+ *       adm_wait(&a, &t);
+ *   // dentro: t.inside
+ */
+
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <pthread.h>
+
+/*
+ * Turno de un cliente. Lo pone quien llama (por ejemplo en su pila) y
+ * tiene que seguir vivo hasta que vuelve adm_wait(); mientras espera es
+ * el nodo de la cola de su clase.
+ */
+typedef struct adm_ticket {
+    int ticket;                 // turno en su clase; -1 si entró sin esperar
+    int waiting;                // de su clase esperando al ponerse en cola,
+                                // él incluido (0 si entró sin esperar)
+    int inside;                 // ocupación total justo al entrar
+
+    // Internos
+    int admitted;               // 1 cuando se le ha cedido una plaza
+    pthread_cond_t cond;        // solo se señaliza a este cliente
+    struct adm_ticket *next;
+} adm_ticket_t;
+
+typedef struct {
+    adm_ticket_t *head, *tail;  // clientes esperando, por orden de llegada
+    int weight;                 // plazas por ronda de reparto
+    int min;                    // plazas garantizadas
+    int inside;                 // clientes de la clase dentro
+    int waiting;                // clientes de la clase esperando
+    int deficit;                // plazas que le quedan en la ronda actual
+    int next_ticket;            // turno para el siguiente que espere
+    unsigned long admitted;     // total de entradas
+    int in_active, next_active; // en la lista de reparto (con esperando)
+    int in_urgent, next_urgent; // en la lista de clases bajo su mínimo
+} adm_class_t;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    int capacity;
+    int inside;
+    int min_total;              // suma de los mínimos
+    int reserved;               // plazas de mínimos aún sin usar
+    int nclasses;
+    adm_class_t *classes;
+    int active_head, active_tail;   // lista de reparto (DRR)
+    int urgent_head, urgent_tail;   // clases que esperan bajo su mínimo
+} admission_t;
+
+/**
+ * adm_init:
+ *   Prepara un control con aforo 'capacity' y 'nclasses' clases, todas
+ *   con peso 1 y sin mínimo. Devuelve 0, o -1 si los parámetros no son
+ *   válidos o no hay memoria.
+ */
+int adm_init(admission_t *a, int capacity, int nclasses);
+
+void adm_destroy(admission_t *a);
+
+/**
+ * adm_set_class:
+ *   Cambia el peso (>= 1) y el mínimo garantizado (>= 0) de la clase 'c'.
+ *   Devuelve -1 si no son válidos o la suma de mínimos pasaría del aforo.
+ */
+int adm_set_class(admission_t *a, int c, int weight, int min);
+
+/**
+ * adm_set_capacity:
+ *   Cambia el aforo en marcha. Si sube, entran los que esperaban y quepan.
+ *   Devuelve -1 si es menor que la suma de los mínimos.
+ */
+int adm_set_capacity(admission_t *a, int capacity);
+
+/**
+ * adm_arrive:
+ *   Llega un cliente de la clase 'c'. Si puede entrar ya, entra y devuelve
+ *   0; si no, coge turno, se pone en la cola y devuelve 1, y hay que llamar
+ *   a adm_wait() con el mismo 't'.
+ */
+int adm_arrive(admission_t *a, int c, adm_ticket_t *t);
+
+// Espera en la cola hasta que se le cede una plaza
+void adm_wait(admission_t *a, adm_ticket_t *t);
+
+/**
+ * adm_enter:
+ *   adm_arrive() y, si hace falta, adm_wait(). 't' puede ser NULL.
+ *   Devuelve el turno con el que entró dentro de su clase, o -1 si entró
+ *   sin esperar.
+ */
+int adm_enter(admission_t *a, int c, adm_ticket_t *t);
+
+// Como adm_enter, pero sin esperar: 0 si entra, -1 si tendría que esperar
+int adm_try_enter(admission_t *a, int c);
+
+// Sale un cliente de la clase 'c'; su plaza pasa al siguiente que toque.
+// Devuelve la ocupación tras su salida, antes de ceder la plaza.
+int adm_exit(admission_t *a, int c);
+
+// Clientes de la clase 'c' dentro y esperando, y total dentro
+void adm_counts(admission_t *a, int c, int *inside, int *waiting, int *total);
+
+#endif
@@ -4,32 +4,45 @@
  * Simulación de control de aforo en una discoteca con prioridad a VIPs.
  *
  * Premisas:
- *   - Aforo máximo: CAPACITY clientes dentro simultáneamente.
+ *   - Aforo máximo: -c clientes dentro simultáneamente (CAPACITY si no se
+ *     indica).
  *   - Dos tipos de clientes: VIP (isvip==1) y normales (isvip==0).
- *   - Si hay hueco y no hay VIP esperando, entra el siguiente normal.
- *   - Si hay VIP esperando, éstos siempre tienen preferencia sobre los normales.
+ *   - Si hay hueco y no hay nadie esperando, entra quien llegue.
+ *   - Las plazas que se liberan se reparten entre VIPs y normales que
+ *     esperan en proporción -w a 1 (VIP_WEIGHT si no se indica): los VIPs
+ *     tienen preferencia, pero los normales no se quedan sin entrar nunca
+ *     aunque no dejen de llegar VIPs.
+ *   - -m plazas (NORMAL_MIN si no se indica, ninguna) están garantizadas a
+ *     los normales: los VIPs no las ocupan nunca, aunque no haya normales
+ *     esperando.
  *   - La entrada es FIFO dentro de cada categoría: VIPs se atienden en orden
- *     de llegada, luego normales en orden de llegada.
+ *     de llegada, normales también.
  *   - Se crean M hilos: cada hilo representa un cliente que entra, baila y sale.
  *
- * Sincronización:
- *   - Mutex para proteger el acceso a variables globales de estado.
- *   - Dos variables de condición: una para VIPs, otra para normales.
- *   - Contadores de cuántos están dentro y cuántos esperan de cada tipo.
+ * Sincronización: ver admission.h (dos clases: 0 normales, 1 VIPs).
  *
- * Compilación:
- *   gcc -Wall -Wextra -std=gnu99 -pthread -o disco disco.c
+ * Uso:
+ *   ./disco [-c aforo] [-w peso_vip] [-m mínimo_normales] <input_file>
  */
 
 #include <stdio.h>      // printf, perror
 #include <stdlib.h>     // exit, EXIT_FAILURE, malloc, free, srand, rand
-#include <unistd.h>     // sleep, getpid
-#include <pthread.h>    // pthread_t, pthread_create, pthread_join, mutex, cond
+#include <unistd.h>     // sleep, getpid, getopt
+#include <pthread.h>    // pthread_t, pthread_create, pthread_join
+#include "admission.h"
 
-// CAPACITY: número máximo de clientes dentro a la vez.
+// CAPACITY: número máximo de clientes dentro a la vez, por defecto.
 // Ajusta este valor según las reglas de la discoteca.
 #define CAPACITY 5
 
+// Por cada plaza que se cede a un normal que espera se ceden hasta
+// VIP_WEIGHT a VIPs que esperan.
+#define VIP_WEIGHT 3
+
+// Plazas reservadas para clientes normales. Por defecto ninguna, así que
+// el aforo entero está disponible para todos.
+#define NORMAL_MIN 0
+
 // Macro auxiliar para imprimir " vip " o "not vip"
 #define VIPSTR(vip) ((vip) ? "  vip  " : "not vip")
 
@@ -42,118 +55,41 @@ typedef struct {
     int isvip;    // bandera VIP (1) o normal (0)
 } client_arg_t;
 
-// --------------------------------------------------
-// Variables de estado global protegidas por mutex:
-// --------------------------------------------------
-
-// inside_count: cuántos clientes están actualmente dentro de la discoteca.
-static int inside_count = 0;
-
-// waiting_vip:   cuántos clientes VIP están esperando fuera (bloqueados).
-static int waiting_vip = 0;
-
-// waiting_norm: cuántos clientes normales están esperando fuera.
-static int waiting_normal = 0;
-
-// Mutex para proteger todas las variables de estado anteriores.
-// Toda modificación/lectura de inside_count, waiting_vip o waiting_normal
-// debe hacerse dentro de pthread_mutex_lock/mutex_unlock.
-static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-
-// Condición para despertar clientes VIP.
-// Cuando haya hueco y no haya aún VIPs por atender, se señaliza vip_cond.
-static pthread_cond_t vip_cond = PTHREAD_COND_INITIALIZER;
-
-// Condición para despertar clientes normales.
-// Se usa cuando no hay VIP esperando y hay hueco.
-static pthread_cond_t normal_cond = PTHREAD_COND_INITIALIZER;
-
-// --------------------------------------------------
-// enter_vip_client:
-//   Función que llama un hilo VIP para entrar en la disco.
-//   Bloquea hasta que haya hueco (< CAPACITY).
-// --------------------------------------------------
-void enter_vip_client(int id) {
-    // 1) Bloqueamos el mutex para leer/modificar estado compartido.
-    pthread_mutex_lock(&mutex);
-
-    // 2) Incrementamos el contador de VIP esperando.
-    waiting_vip++;
-    printf("Client %2d (%s) wants to enter (waiting_vip=%d)\n",
-           id, VIPSTR(1), waiting_vip);
-
-    // 3) Mientras no haya hueco (inside_count >= CAPACITY), esperamos.
-    //    Nota: usamos pthread_cond_wait, que desbloquea el mutex y duerme.
-    //    Al volver de la espera, retranca el mutex antes de seguir.
-    while (inside_count >= CAPACITY) {
-        pthread_cond_wait(&vip_cond, &mutex);
-    }
-
-    // 4) Hemos salido del bucle: hay hueco y soy el siguiente VIP.
-    //    Decremento VIP esperando e incrementamos ocupación.
-    waiting_vip--;
-    inside_count++;
-    printf("Client %2d (%s) entering, occupancy=%d\n",
-           id, VIPSTR(1), inside_count);
-
-    // 5) Desbloqueo el mutex para liberar la sección crítica.
-    pthread_mutex_unlock(&mutex);
-}
+// Control de aforo; la clase de cada cliente es su isvip.
+static admission_t disco;
 
 // --------------------------------------------------
-// enter_normal_client:
-//   Función que llama un hilo normal para entrar.
-//   Bloquea si no hay hueco oSI hay VIPs esperando.
+// disco_enter:
+//   Función que llama cada hilo para entrar en la disco.
+//   Bloquea hasta que le toque una plaza.
 // --------------------------------------------------
-void enter_normal_client(int id) {
-    pthread_mutex_lock(&mutex);
-
-    waiting_normal++;
-    printf("Client %2d (%s) wants to enter (waiting_norm=%d)\n",
-           id, VIPSTR(0), waiting_normal);
-
-    // Condición de espera para clientes normales:
-    //  - no debe superarse CAPACITY
-    //  - no debe haber VIPs esperando (donde waiting_vip>0)
-    while (inside_count >= CAPACITY || waiting_vip > 0) {
-        pthread_cond_wait(&normal_cond, &mutex);
+void disco_enter(int id, int isvip) {
+    adm_ticket_t t;
+
+    // Si no puede entrar ya, se queda en la cola con su turno; los datos
+    // de 't' se leyeron con el mutex cogido al llegar o al entrar.
+    if (adm_arrive(&disco, isvip, &t)) {
+        printf("Client %2d (%s) wants to enter (%s=%d, ticket=%d)\n",
+               id, VIPSTR(isvip), isvip ? "waiting_vip" : "waiting_norm",
+               t.waiting, t.ticket);
+        adm_wait(&disco, &t);
+        printf("Client %2d (%s) entering with ticket %d, occupancy=%d\n",
+               id, VIPSTR(isvip), t.ticket, t.inside);
+    } else {
+        printf("Client %2d (%s) entering, occupancy=%d\n",
+               id, VIPSTR(isvip), t.inside);
     }
-
-    // Tras salir del bucle, se puede entrar:
-    waiting_normal--;
-    inside_count++;
-    printf("Client %2d (%s) entering, occupancy=%d\n",
-           id, VIPSTR(0), inside_count);
-
-    pthread_mutex_unlock(&mutex);
 }
 
 // --------------------------------------------------
 // disco_exit:
-//   Llamada al salir un cliente (VIP o normal).
-//   Reduce inside_count y despierta a clientes esperando
-//   (primero a VIPs si los hay, sino a normales).
+//   Llamada al salir un cliente (VIP o normal). Su plaza pasa al
+//   siguiente que toque según el reparto de admission.h.
 // --------------------------------------------------
 void disco_exit(int id, int isvip) {
-    // 1) Bloquear mutex para modificar shared state.
-    pthread_mutex_lock(&mutex);
-
-    inside_count--;
+    int occupancy = adm_exit(&disco, isvip);
     printf("Client %2d (%s) leaving, occupancy=%d\n",
-           id, VIPSTR(isvip), inside_count);
-
-    // 2) Si hay VIP esperando, señalizamos vip_cond.
-    //    Esto despierta exactamente un VIP bloqueado.
-    if (waiting_vip > 0) {
-        pthread_cond_signal(&vip_cond);
-    }
-    // 3) Si no hay VIP esperando, pero sí normales, señalizamos normal_cond.
-    else if (waiting_normal > 0) {
-        pthread_cond_signal(&normal_cond);
-    }
-
-    // 4) Liberamos el mutex.
-    pthread_mutex_unlock(&mutex);
+           id, VIPSTR(isvip), occupancy);
 }
 
 // --------------------------------------------------
@@ -184,12 +120,8 @@ void *client(void *arg) {
     // Liberamos la memoria dinámica ocupada por arg
     free(ca);
 
-    // Lógica VIP vs normal
-    if (isvip) {
-        enter_vip_client(id);
-    } else {
-        enter_normal_client(id);
-    }
+    // Entra cuando le toque según su categoría
+    disco_enter(id, isvip);
 
     // Ahora el cliente está dentro. Simulamos baile...
     dance(id, isvip);
@@ -202,18 +134,50 @@ void *client(void *arg) {
 
 // --------------------------------------------------
 // main:
+//   - Lee las opciones -c, -w y -m y prepara el control de aforo.
 //   - Lee un fichero de entrada con M y luego M líneas 0/1.
 //   - Para cada línea crea un hilo client(...) con id e isvip.
 //   - Espera a que todos los hilos terminen.
 // --------------------------------------------------
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <input_file>\n", argv[0]);
+    int capacity = CAPACITY, vip_weight = VIP_WEIGHT, normal_min = NORMAL_MIN;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:w:m:")) != -1) {
+        switch (opt) {
+        case 'c':
+            capacity = atoi(optarg);
+            break;
+        case 'w':
+            vip_weight = atoi(optarg);
+            break;
+        case 'm':
+            normal_min = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-c capacity] [-w vip_weight]"
+                    " [-m normal_min] <input_file>\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "Usage: %s [-c capacity] [-w vip_weight]"
+                " [-m normal_min] <input_file>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // 0) Control de aforo: clase 0 normales, clase 1 VIPs
+    if (capacity < 1 || adm_init(&disco, capacity, 2) < 0 ||
+        adm_set_class(&disco, 0, 1, normal_min) < 0 ||
+        adm_set_class(&disco, 1, vip_weight, 0) < 0) {
+        fprintf(stderr, "Error: need capacity >= 1, vip_weight >= 1 and"
+                " 0 <= normal_min <= capacity\n");
         return EXIT_FAILURE;
     }
 
     // 1) Abrir el fichero de configuración
-    FILE *fp = fopen(argv[1], "r");
+    const char *input = argv[optind];
+    FILE *fp = fopen(input, "r");
     if (!fp) {
         perror("fopen input_file");
         return EXIT_FAILURE;
@@ -222,7 +186,7 @@ int main(int argc, char *argv[]) {
     // 2) Leer el número de clientes M
     int M;
     if (fscanf(fp, "%d\n", &M) != 1) {
-        fprintf(stderr, "Error: bad format in %s\n", argv[1]);
+        fprintf(stderr, "Error: bad format in %s\n", input);
         fclose(fp);
         return EXIT_FAILURE;
     }
@@ -243,7 +207,7 @@ int main(int argc, char *argv[]) {
         int vipflag;
         // leemos 0 (normal) o 1 (VIP)
         if (fscanf(fp, "%d\n", &vipflag) != 1) {
-            fprintf(stderr, "Error: missing entry %d in %s\n", i, argv[1]);
+            fprintf(stderr, "Error: missing entry %d in %s\n", i, input);
             free(threads);
             fclose(fp);
             return EXIT_FAILURE;
@@ -276,5 +240,6 @@ int main(int argc, char *argv[]) {
 
     // 6) Liberamos memoria y salimos
     free(threads);
+    adm_destroy(&disco);
     return EXIT_SUCCESS;
 }
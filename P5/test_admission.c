@@ -0,0 +1,248 @@
+/* test_admission.c
+ *
+ * Pruebas de admission.h:
+ *
+ *   1) Sin mínimos se ocupan todas las plazas; con un mínimo, las demás
+ *      clases dejan libre la plaza reservada, y la clase del mínimo entra
+ *      en ella aunque el resto esté lleno.
+ *   2) Reparto por pesos (DRR): con aforo 1, dos clases con gente esperando
+ *      y pesos 3 y 1, las plazas se ceden en el orden 3-1-3-1...
+ *   3) Subir el aforo en marcha deja entrar a los que esperaban.
+ *   4) Estrés con K clases, pesos y un mínimo: muchos hilos entran y salen
+ *      sin parar mientras el aforo cambia en marcha. Nunca hay más clientes
+ *      dentro que el aforo (una vez vaciado el exceso tras bajarlo), y
+ *      ninguna clase se queda sin entrar.
+ *
+ * Uso:
+ *   ./test_admission
+ *
+ * Termina con EXIT_FAILURE y un mensaje en la primera prueba que falla.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "admission.h"
+
+#define check(cond, ...)                                            \
+    do {                                                            \
+        if (!(cond)) {                                              \
+            fprintf(stderr, "%s:%d: ", __FILE__, __LINE__);         \
+            fprintf(stderr, __VA_ARGS__);                           \
+            fprintf(stderr, "\n");                                  \
+            exit(EXIT_FAILURE);                                     \
+        }                                                           \
+    } while (0)
+
+static int total_inside(admission_t *a) {
+    int total;
+    adm_counts(a, 0, NULL, NULL, &total);
+    return total;
+}
+
+/* ---------------- 1) Mínimos ---------------- */
+
+static void test_minimums(void) {
+    admission_t a;
+    check(adm_init(&a, 3, 2) == 0, "adm_init");
+
+    // Sin mínimos, una sola clase llena el aforo
+    for (int i = 0; i < 3; i++)
+        check(adm_try_enter(&a, 1) == 0, "sin mínimo no entra el %d", i + 1);
+    check(adm_try_enter(&a, 1) == -1, "entra por encima del aforo");
+    for (int i = 0; i < 3; i++)
+        adm_exit(&a, 1);
+
+    // Con mínimo 1 para la clase 0, la clase 1 solo ocupa 2 plazas...
+    check(adm_set_class(&a, 0, 1, 1) == 0, "adm_set_class");
+    check(adm_try_enter(&a, 1) == 0 && adm_try_enter(&a, 1) == 0,
+          "no entran en las plazas libres");
+    check(adm_try_enter(&a, 1) == -1, "ocupa la plaza reservada");
+    // ...y la clase 0 entra en la suya
+    check(adm_try_enter(&a, 0) == 0, "no entra en su plaza reservada");
+    check(total_inside(&a) == 3, "ocupación %d, se esperaba 3",
+          total_inside(&a));
+
+    // Un mínimo que no cabe en el aforo se rechaza
+    check(adm_set_class(&a, 1, 1, 3) == -1, "mínimos por encima del aforo");
+    check(adm_set_capacity(&a, 0) == -1, "aforo por debajo de los mínimos");
+    adm_destroy(&a);
+}
+
+/* ---------------- 2) Reparto por pesos ---------------- */
+
+#define DRR_WAITERS 8
+
+static admission_t drr;
+static atomic_int drr_next;
+static int drr_order[2 * DRR_WAITERS];
+
+typedef struct {
+    int cls;
+    adm_ticket_t t;
+    pthread_t tid;
+} waiter_t;
+
+// Espera su plaza, apunta su clase en el orden de entrada y sale
+static void *drr_waiter(void *arg) {
+    waiter_t *w = arg;
+    adm_wait(&drr, &w->t);
+    drr_order[atomic_fetch_add(&drr_next, 1)] = w->cls;
+    adm_exit(&drr, w->cls);
+    return NULL;
+}
+
+static void test_drr(void) {
+    waiter_t w[2 * DRR_WAITERS];
+
+    check(adm_init(&drr, 1, 2) == 0, "adm_init");
+    check(adm_set_class(&drr, 0, 3, 0) == 0 && adm_set_class(&drr, 1, 1, 0) == 0,
+          "adm_set_class");
+    check(adm_try_enter(&drr, 0) == 0, "no entra el primero");
+
+    // Todos a la cola desde este hilo, así el orden de llegada es fijo
+    for (int i = 0; i < 2 * DRR_WAITERS; i++) {
+        w[i].cls = i % 2;
+        check(adm_arrive(&drr, w[i].cls, &w[i].t) == 1, "no espera el %d", i);
+        check(w[i].t.ticket == i / 2, "turno %d, se esperaba %d",
+              w[i].t.ticket, i / 2);
+        check(w[i].t.waiting == i / 2 + 1, "%d esperando, se esperaban %d",
+              w[i].t.waiting, i / 2 + 1);
+    }
+    for (int i = 0; i < 2 * DRR_WAITERS; i++)
+        check(pthread_create(&w[i].tid, NULL, drr_waiter, &w[i]) == 0,
+              "pthread_create");
+
+    // Con aforo 1 cada salida cede la plaza al siguiente: el orden de
+    // entrada es el del reparto
+    adm_exit(&drr, 0);
+    for (int i = 0; i < 2 * DRR_WAITERS; i++)
+        pthread_join(w[i].tid, NULL);
+
+    // Mientras las dos clases esperan: 3 de la clase 0 por cada 1 de la 1
+    static const int expected[2 * DRR_WAITERS] = {
+        0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 1, 1, 1, 1, 1, 1,
+    };
+    for (int i = 0; i < 2 * DRR_WAITERS; i++)
+        check(drr_order[i] == expected[i],
+              "entrada %d de la clase %d, se esperaba la %d",
+              i, drr_order[i], expected[i]);
+    adm_destroy(&drr);
+}
+
+/* ---------------- 3) Subir el aforo ---------------- */
+
+static void test_raise_capacity(void) {
+    admission_t a;
+    adm_ticket_t t[3];
+
+    check(adm_init(&a, 1, 1) == 0, "adm_init");
+    check(adm_try_enter(&a, 0) == 0, "no entra el primero");
+    for (int i = 0; i < 3; i++)
+        check(adm_arrive(&a, 0, &t[i]) == 1, "no espera el %d", i);
+
+    // Entran dos de los tres que esperaban, en orden
+    check(adm_set_capacity(&a, 3) == 0, "adm_set_capacity");
+    int waiting, total;
+    adm_counts(&a, 0, NULL, &waiting, &total);
+    check(total == 3 && waiting == 1, "dentro %d y esperando %d tras subir"
+          " el aforo, se esperaban 3 y 1", total, waiting);
+    adm_wait(&a, &t[0]);
+    adm_wait(&a, &t[1]);
+    check(t[0].inside == 2 && t[1].inside == 3, "ocupación al entrar %d y %d",
+          t[0].inside, t[1].inside);
+
+    adm_exit(&a, 0);
+    adm_wait(&a, &t[2]);
+    for (int i = 0; i < 3; i++)
+        adm_exit(&a, 0);
+    check(total_inside(&a) == 0, "quedan %d dentro", total_inside(&a));
+    adm_destroy(&a);
+}
+
+/* ---------------- 4) Estrés ---------------- */
+
+#define STRESS_CLASSES 3
+#define STRESS_THREADS 30
+
+static admission_t stress;
+static atomic_int inside_now, inside_max, stop;
+static atomic_long served[STRESS_CLASSES];
+
+static void *stress_client(void *arg) {
+    int c = (int)(long)arg % STRESS_CLASSES;
+    while (!atomic_load(&stop)) {
+        adm_enter(&stress, c, NULL);
+        int n = atomic_fetch_add(&inside_now, 1) + 1;
+        int m = atomic_load(&inside_max);
+        while (n > m && !atomic_compare_exchange_weak(&inside_max, &m, n))
+            ;
+        usleep(200);
+        atomic_fetch_sub(&inside_now, 1);
+        atomic_fetch_add(&served[c], 1);
+        adm_exit(&stress, c);
+    }
+    return NULL;
+}
+
+// Deja correr a los clientes con aforo 'capacity' y comprueba el máximo
+static void stress_phase(int capacity) {
+    check(adm_set_capacity(&stress, capacity) == 0, "adm_set_capacity(%d)",
+          capacity);
+    // Si el aforo ha bajado, los que sobran salen sin que entre nadie.
+    // Se mira la cuenta del control: un cliente ya admitido puede no haber
+    // llegado aún a contarse en 'inside_now'.
+    while (total_inside(&stress) > capacity)
+        usleep(100);
+    atomic_store(&inside_max, 0);
+    long before[STRESS_CLASSES];
+    for (int c = 0; c < STRESS_CLASSES; c++)
+        before[c] = atomic_load(&served[c]);
+
+    usleep(300000);
+
+    int max = atomic_load(&inside_max);
+    check(max <= capacity, "%d dentro con aforo %d", max, capacity);
+    for (int c = 0; c < STRESS_CLASSES; c++)
+        check(atomic_load(&served[c]) > before[c],
+              "la clase %d no entra con aforo %d", c, capacity);
+}
+
+static void test_stress(void) {
+    pthread_t tids[STRESS_THREADS];
+
+    check(adm_init(&stress, 4, STRESS_CLASSES) == 0, "adm_init");
+    check(adm_set_class(&stress, 0, 4, 0) == 0 &&
+          adm_set_class(&stress, 1, 2, 0) == 0 &&
+          adm_set_class(&stress, 2, 1, 1) == 0, "adm_set_class");
+    for (long i = 0; i < STRESS_THREADS; i++)
+        check(pthread_create(&tids[i], NULL, stress_client, (void *)i) == 0,
+              "pthread_create");
+
+    stress_phase(4);
+    stress_phase(8);
+    stress_phase(2);            // la reservada y una para las tres clases
+    stress_phase(6);
+
+    atomic_store(&stop, 1);
+    for (int i = 0; i < STRESS_THREADS; i++)
+        pthread_join(tids[i], NULL);
+    check(total_inside(&stress) == 0, "quedan %d dentro",
+          total_inside(&stress));
+    printf("@@ estrés: %ld, %ld y %ld entradas por clase (pesos 4, 2 y 1)\n",
+           atomic_load(&served[0]), atomic_load(&served[1]),
+           atomic_load(&served[2]));
+    adm_destroy(&stress);
+}
+
+int main(void) {
+    test_minimums();
+    test_drr();
+    test_raise_capacity();
+    test_stress();
+    printf("@@ admission: todas las pruebas pasan\n");
+    return EXIT_SUCCESS;
+}